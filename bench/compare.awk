@@ -0,0 +1,35 @@
+# Compares two files of `name: value unit` benchmark results
+# (baseline first), as written by `make bench-folk`:
+#
+#   awk -f bench/compare.awk bench_baseline.txt bench_output.txt
+#
+# Rates (units ending in /s) are better when higher; everything else
+# (latency, CPU, memory) is better when lower. Changes of more than
+# 5% are flagged.
+
+function parse(line) {
+    split(line, parts, ": ")
+    name = parts[1]
+    split(parts[2], fields, " ")
+    value = fields[1]; unit = fields[2]
+}
+
+NR == FNR {
+    parse($0)
+    baseline[name] = value
+    next
+}
+
+{
+    parse($0)
+    if (!(name in baseline)) {
+        printf "%-44s %14s %14.4g %-14s (new)\n", name, "", value, unit
+        next
+    }
+    before = baseline[name]
+    change = before == 0 ? 0 : (value - before) / before * 100
+    better = unit ~ /\/s$/ ? change > 0 : change < 0
+    flag = ""
+    if (change > 5 || change < -5) { flag = better ? "better" : "WORSE" }
+    printf "%-44s %14.4g %14.4g %-14s %+7.1f%% %s\n", name, before, value, unit, change, flag
+}
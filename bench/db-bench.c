@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "db.h"
+#include "epoch.h"
+#include "bench/microbench.h"
+
+static Clause* benchDbClause(int i) {
+    return clauseFormat("tag %d has center %d %d", i, i % 640, i % 480);
+}
+
+// Assert n statements into a fresh db, query them back, then retract
+// them one by one. (The Db is leaked, since there's no dbFree; it's
+// mostly the 64k-slot statement and match pools.)
+static void benchDbInsertQueryRetract(int n) {
+    Db* db = dbNew();
+    BenchParams params = { .n = n };
+
+    int64_t t0 = benchNow();
+    for (int i = 0; i < n; i++) {
+        Statement* stmt = dbInsertOrReuseStatement(db, benchDbClause(i),
+                                                   0, NULL, "microbench", i,
+                                                   MATCH_REF_NULL, NULL);
+        dbInflightDecr(db, stmt);
+        statementRelease(db, stmt);
+    }
+    benchReport("db-insert", params, n, benchNow() - t0, NULL);
+
+    // Asserting something that's already there just bumps its
+    // parent count.
+    t0 = benchNow();
+    for (int i = 0; i < n; i++) {
+        Statement* stmt = dbInsertOrReuseStatement(db, benchDbClause(i),
+                                                   0, NULL, "microbench", i,
+                                                   MATCH_REF_NULL, NULL);
+        if (stmt != NULL) {
+            dbInflightDecr(db, stmt);
+            statementRelease(db, stmt);
+        }
+    }
+    benchReport("db-insert-existing", params, n, benchNow() - t0, NULL);
+
+    int queries = n < 10000 ? n : 10000;
+    Clause** patterns = malloc(queries * sizeof(Clause*));
+    for (int i = 0; i < queries; i++) {
+        patterns[i] = clauseFormat("tag %d has center /x/ /y/", (i * 7919) % n);
+    }
+    t0 = benchNow();
+    for (int i = 0; i < queries; i++) {
+        ResultSet* rs = dbQuery(db, patterns[i]);
+        if (rs->nResults != 1) {
+            fprintf(stderr, "benchDb: expected 1 result, got %zu\n", rs->nResults);
+            exit(1);
+        }
+        free(rs);
+    }
+    params.shape = "literal-prefix";
+    benchReport("db-query", params, queries, benchNow() - t0, NULL);
+    params.shape = NULL;
+    for (int i = 0; i < queries; i++) { clauseFree(patterns[i]); }
+    free(patterns);
+
+    // Each retract has to run twice, since we asserted everything
+    // twice.
+    t0 = benchNow();
+    for (int k = 0; k < 2; k++) {
+        for (int i = 0; i < n; i++) {
+            Clause* pattern = benchDbClause(i);
+            dbRetractStatements(db, pattern);
+            clauseFree(pattern);
+        }
+    }
+    benchReport("db-retract", params, 2 * n, benchNow() - t0, NULL);
+}
+
+// Hold! the same key over and over: every hold creates a new
+// statement and removes the previous version.
+static void benchDbHold(int n) {
+    Db* db = dbNew();
+    int64_t t0 = benchNow();
+    for (int i = 0; i < n; i++) {
+        StatementRef oldRef;
+        Statement* stmt = dbHoldStatement(db, "microbench", i,
+                                          benchDbClause(i), 0,
+                                          "microbench", i, &oldRef);
+        if (stmt != NULL) {
+            dbInflightDecr(db, stmt);
+            statementRelease(db, stmt);
+        }
+        if (!statementRefIsNull(oldRef)) {
+            Statement* old;
+            if ((old = statementAcquire(db, oldRef))) {
+                statementDecrParentCountAndMaybeRemoveSelf(db, old);
+                statementRelease(db, old);
+            }
+        }
+    }
+    benchReport("db-hold", (BenchParams) { .n = n }, n, benchNow() - t0, NULL);
+}
+
+// Hold! the same clause over and over, like a program that re-Holds
+// an unchanged value every frame: each hold after the first should
+// be a no-op.
+static void benchDbHoldSame(int n) {
+    Db* db = dbNew();
+    int64_t t0 = benchNow();
+    for (int i = 0; i < n; i++) {
+        Statement* stmt = dbHoldStatement(db, "microbench", -1,
+                                          benchDbClause(0), 0,
+                                          "microbench", i, NULL);
+        if (stmt != NULL) {
+            dbInflightDecr(db, stmt);
+            statementRelease(db, stmt);
+        }
+    }
+    char extra[100];
+    snprintf(extra, sizeof(extra), "\"suppressed\": %" PRId64, dbReinsertsSuppressedCount(db));
+    benchReport("db-hold-same", (BenchParams) { .n = n }, n, benchNow() - t0, extra);
+}
+
+// One Atomically key that gets a fresh version every frame, with
+// each version converging `lag` frames after it's created (like a
+// When -atomically on a 60Hz statement whose body is slow). Each
+// convergence reaps the versions older than it.
+static void benchDbAtomicallyVersions(int n, int lag) {
+    Db* db = dbNew();
+    Statement* parent = dbInsertOrReuseStatement(db, benchDbClause(0),
+                                                 0, NULL, "microbench", 0,
+                                                 MATCH_REF_NULL, NULL);
+    StatementRef parentRef = statementRef(db, parent);
+    AtomicallyVersion** versions = calloc(n, sizeof(AtomicallyVersion*));
+
+    int64_t t0 = benchNow();
+    for (int i = 0; i < n; i++) {
+        Match* match = dbInsertMatch(db, 1, &parentRef, NULL, 0);
+        versions[i] = dbFreshAtomicallyVersionOnKey(db, "microbench",
+                                                    matchRef(db, match));
+        matchSetAtomicallyVersion(db, match, versions[i]);
+        matchCompleted(match);
+        matchRelease(db, match);
+        if (i >= lag) {
+            dbAtomicallyVersionInflightDecr(db, versions[i - lag]);
+            dbAtomicallyVersionRelease(db, versions[i - lag]);
+        }
+    }
+    benchReport("db-atomically-versions", (BenchParams) { .n = n, .fanout = lag },
+                n, benchNow() - t0, NULL);
+    free(versions);
+}
+
+// Statement acquire/release, which every When run does on its
+// statement(s). With `shared`, all threads hammer the same statement
+// (a popular statement, like the clock time); otherwise each thread
+// has its own.
+typedef struct BenchDbAcquireArg {
+    Db* db;
+    StatementRef ref;
+    int n;
+} BenchDbAcquireArg;
+static void* benchDbAcquireMain(void* ptr) {
+    BenchDbAcquireArg* arg = ptr;
+    for (int i = 0; i < arg->n; i++) {
+        Statement* stmt = statementAcquire(arg->db, arg->ref);
+        if (stmt == NULL) {
+            fprintf(stderr, "benchDbAcquire: statement is gone\n"); exit(1);
+        }
+        statementRelease(arg->db, stmt);
+    }
+    return NULL;
+}
+static void benchDbAcquire(Db* db, StatementRef refs[], int n, int threadsCount, bool shared) {
+    pthread_t threads[threadsCount];
+    BenchDbAcquireArg args[threadsCount];
+
+    int64_t t0 = benchNow();
+    for (int t = 0; t < threadsCount; t++) {
+        args[t] = (BenchDbAcquireArg) {
+            .db = db, .ref = refs[shared ? 0 : t], .n = n / threadsCount
+        };
+        pthread_create(&threads[t], NULL, benchDbAcquireMain, &args[t]);
+    }
+    for (int t = 0; t < threadsCount; t++) { pthread_join(threads[t], NULL); }
+    int64_t ns = benchNow() - t0;
+
+    benchReport("db-acquire-release",
+                (BenchParams) { .threads = threadsCount,
+                                .shape = shared ? "shared" : "private" },
+                args[0].n * threadsCount, ns, NULL);
+}
+
+void benchDb() {
+    benchCollectorStart();
+
+    int ns[] = { 1000, 10000 };
+    for (int i = 0; i < sizeof(ns)/sizeof(ns[0]); i++) {
+        benchDbInsertQueryRetract(ns[i]);
+    }
+    benchDbHold(100000);
+    benchDbHoldSame(100000);
+    int lags[] = { 1, 60, 600 };
+    for (int i = 0; i < sizeof(lags)/sizeof(lags[0]); i++) {
+        benchDbAtomicallyVersions(50000, lags[i]);
+    }
+
+    Db* db = dbNew();
+    StatementRef refs[8];
+    for (int i = 0; i < 8; i++) {
+        Statement* stmt = dbInsertOrReuseStatement(db, benchDbClause(i),
+                                                   0, NULL, "microbench", i,
+                                                   MATCH_REF_NULL, NULL);
+        refs[i] = statementRef(db, stmt);
+        dbInflightDecr(db, stmt);
+        statementRelease(db, stmt);
+    }
+    int threadCounts[] = { 1, 2, 4, 8 };
+    for (int i = 0; i < sizeof(threadCounts)/sizeof(threadCounts[0]); i++) {
+        benchDbAcquire(db, refs, 1 << 22, threadCounts[i], true);
+        benchDbAcquire(db, refs, 1 << 22, threadCounts[i], false);
+    }
+
+    benchCollectorStop();
+}
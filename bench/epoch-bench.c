@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "epoch.h"
+#include "bench/microbench.h"
+
+// Enter and leave an (empty) epoch, as every dbQuery does.
+typedef struct BenchEpochArg {
+    int n;
+    int allocsPerEpoch;
+} BenchEpochArg;
+static void* benchEpochMain(void* ptr) {
+    BenchEpochArg* arg = ptr;
+    epochThreadInit();
+    for (int i = 0; i < arg->n; i++) {
+        epochBegin();
+        // Each allocation replaces (and retires) the previous one,
+        // like trieAdd copying a path.
+        void* prev = NULL;
+        for (int j = 0; j < arg->allocsPerEpoch; j++) {
+            void* p = epochAlloc(64);
+            if (prev != NULL) { epochFree(prev); }
+            prev = p;
+        }
+        if (prev != NULL) { epochFree(prev); }
+        epochEnd();
+    }
+    epochThreadDestroy();
+    return NULL;
+}
+static void benchEpochBeginEnd(int n, int allocsPerEpoch, int threadsCount) {
+    pthread_t threads[threadsCount];
+    BenchEpochArg arg = { .n = n / threadsCount, .allocsPerEpoch = allocsPerEpoch };
+
+    int64_t t0 = benchNow();
+    for (int t = 0; t < threadsCount; t++) {
+        pthread_create(&threads[t], NULL, benchEpochMain, &arg);
+    }
+    for (int t = 0; t < threadsCount; t++) { pthread_join(threads[t], NULL); }
+    int64_t ns = benchNow() - t0;
+
+    char extra[100];
+    snprintf(extra, sizeof(extra), "\"allocsPerEpoch\":%d", allocsPerEpoch);
+    benchReport(allocsPerEpoch == 0 ? "epoch-begin-end" : "epoch-alloc-free",
+                (BenchParams) { .threads = threadsCount },
+                arg.n * threadsCount, ns, extra);
+}
+
+// How fast epochGlobalCollect frees a backlog of n retired pointers
+// (this runs on the sysmon thread, so it bounds how much garbage we
+// can churn through per tick).
+static void benchEpochCollect(int n) {
+    for (int i = 0; i < n; i += 1000) {
+        epochBegin();
+        for (int j = 0; j < 1000 && i + j < n; j++) {
+            epochFree(malloc(64));
+        }
+        epochEnd();
+    }
+    int pending = epochGarbageCount();
+    int64_t t0 = benchNow();
+    // Garbage is freed two epochs after it's retired.
+    for (int i = 0; i < 3; i++) { epochGlobalCollect(); }
+    int64_t ns = benchNow() - t0;
+
+    benchReport("epoch-collect", (BenchParams) { .n = n },
+                pending - epochGarbageCount(), ns, NULL);
+}
+
+void benchEpoch() {
+    int threadCounts[] = { 1, 2, 4, 8 };
+    for (int i = 0; i < sizeof(threadCounts)/sizeof(threadCounts[0]); i++) {
+        benchCollectorStart();
+        benchEpochBeginEnd(1 << 21, 0, threadCounts[i]);
+        benchEpochBeginEnd(1 << 16, 8, threadCounts[i]);
+        benchCollectorStop();
+    }
+
+    int ns[] = { 1000, 100000 };
+    for (int i = 0; i < sizeof(ns)/sizeof(ns[0]); i++) {
+        benchEpochCollect(ns[i]);
+    }
+}
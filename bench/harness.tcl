@@ -0,0 +1,58 @@
+# Measurement helpers for the workload benchmarks in bench/*.folk.
+#
+# Source this at the top of a benchmark, call benchBegin once the
+# workload is set up, and benchEnd when it's done. benchEnd prints
+# the standard metrics as `name: value unit` lines, which `make
+# bench-folk` collects and compares against the saved baseline.
+
+# Prints a result line on Folk's real stdout (program output
+# otherwise goes to the per-program log under /var/tmp/folk-PID).
+proc benchPuts {line} {
+    puts $::realStdout $line
+    flush $::realStdout
+}
+
+proc benchBegin {} {
+    set ::benchStartMs [clock milliseconds]
+    set ::benchStartStats [__evaluatorStats]
+    set ::benchStartReactions [lindex [__reactionLatencyTotal] 0]
+}
+
+proc benchEnd {name} {
+    set seconds [expr {([clock milliseconds] - $::benchStartMs) / 1000.0}]
+    set stats [__evaluatorStats]
+    lassign [__reactionLatencyTotal] reactions p50Ns p99Ns maxNs
+
+    set statements [expr {[dict get $stats statementsCreated] -
+                          [dict get $::benchStartStats statementsCreated]}]
+    set reactions [expr {$reactions - $::benchStartReactions}]
+    set cpuSeconds [expr {([dict get $stats cpuNs] -
+                           [dict get $::benchStartStats cpuNs]) / 1e9}]
+
+    benchPuts [format "%s statements: %.0f statements/s" $name [expr {$statements / $seconds}]]
+    benchPuts [format "%s reactions: %.0f reactions/s" $name [expr {$reactions / $seconds}]]
+    # The latency histograms can't be reset, so this covers the whole
+    # run (including setup), not just the measured window.
+    benchPuts [format "%s reaction latency p99: %.2f ms" $name [expr {$p99Ns / 1e6}]]
+    # Average number of cores busy.
+    benchPuts [format "%s cpu: %.2f cores" $name [expr {$cpuSeconds / $seconds}]]
+    benchPuts [format "%s peak rss: %.1f MB" $name [expr {[dict get $stats peakRssKb] / 1024.0}]]
+}
+
+# Polls until the pattern `args` has a match, or exits Folk with
+# status 1 after `timeoutMs` (so `make bench-folk` sees the failure;
+# an error here would only end up in the program log). The poll interval starts at 50us and doubles up to 5ms,
+# so a quick match is still seen quickly, but a long wait doesn't
+# spin on Query! (which would show up in the cpu number).
+proc benchWaitFor {timeoutMs args} {
+    set start [clock milliseconds]
+    set interval 0.00005
+    while {[llength [Query! {*}$args]] == 0} {
+        if {[clock milliseconds] - $start > $timeoutMs} {
+            benchPuts "bench: timed out waiting for ($args)"
+            Exit! 1
+        }
+        sleep $interval
+        if {$interval < 0.005} { set interval [expr {$interval * 2}] }
+    }
+}
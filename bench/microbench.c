@@ -0,0 +1,126 @@
+// Native microbenchmarks of the core data structures (trie,
+// workqueue, epoch, db), linked straight against trie.o,
+// workqueue.o, epoch.o and db.o -- no Jim interpreter and no worker
+// pool.
+//
+// Run with `make bench`, or `make bench/microbench` and then
+//
+//   ./bench/microbench [group...]
+//
+// where group is any of trie, workqueue, epoch, db (default: all).
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define STB_DS_IMPLEMENTATION
+#include "vendor/stb_ds.h"
+
+#include "common.h"
+#include "epoch.h"
+#include "sysmon.h"
+#include "bench/microbench.h"
+
+// Stand-ins for the pieces of folk.c, sysmon.c and query-profile.c
+// that db.o links against. Nothing here runs Whens, so no match
+// ever belongs to a real worker thread.
+ThreadControlBlock threads[THREADS_MAX];
+void traceItem(char* buf, size_t bufsz, WorkQueueItem item) {
+    snprintf(buf, bufsz, "(microbench)");
+}
+void sysmonScheduleRemoveAfter(StatementRef stmtRef, int afterMs) {}
+bool queryProfileShouldSample(void) { return false; }
+void queryProfileRecord(Clause* pattern, int64_t elapsedNs,
+                        int nodesVisited, int nResults) {}
+
+static int selectedGroupsCount;
+static char** selectedGroups;
+static const char* commit;
+
+bool benchSelected(const char* group) {
+    if (selectedGroupsCount == 0) { return true; }
+    for (int i = 0; i < selectedGroupsCount; i++) {
+        if (strcmp(selectedGroups[i], group) == 0) { return true; }
+    }
+    return false;
+}
+
+void benchReport(const char* bench, BenchParams params,
+                 int64_t ops, int64_t ns, const char* extraJson) {
+    double nsPerOp = ops > 0 ? (double)ns / ops : 0;
+    double opsPerSec = ns > 0 ? ops * 1e9 / ns : 0;
+
+    // The parameters, as both JSON fields and a human-readable
+    // summary.
+    char json[256] = ""; int jsonLen = 0;
+    char human[256] = ""; int humanLen = 0;
+    if (params.shape) {
+        jsonLen += snprintf(json + jsonLen, sizeof(json) - jsonLen,
+                            ",\"shape\":\"%s\"", params.shape);
+        humanLen += snprintf(human + humanLen, sizeof(human) - humanLen,
+                             " %s", params.shape);
+    }
+#define BENCH_PARAM(name)                                               \
+    if (params.name) {                                                  \
+        jsonLen += snprintf(json + jsonLen, sizeof(json) - jsonLen,     \
+                            ",\"" #name "\":%d", params.name);          \
+        humanLen += snprintf(human + humanLen, sizeof(human) - humanLen, \
+                             " " #name "=%d", params.name);             \
+    }
+    BENCH_PARAM(n);
+    BENCH_PARAM(fanout);
+    BENCH_PARAM(threads);
+#undef BENCH_PARAM
+
+    printf("{\"bench\":\"%s\"%s,\"ops\":%" PRId64 ",\"ns\":%" PRId64
+           ",\"nsPerOp\":%.1f,\"opsPerSec\":%.0f%s%s%s%s%s}\n",
+           bench, json, ops, ns, nsPerOp, opsPerSec,
+           extraJson ? "," : "", extraJson ? extraJson : "",
+           commit ? ",\"commit\":\"" : "", commit ? commit : "", commit ? "\"" : "");
+    fflush(stdout);
+
+    fprintf(stderr, "%-20s %-36s %12.1f ns/op %14.0f ops/s%s%s\n",
+            bench, human, nsPerOp, opsPerSec,
+            extraJson ? "  " : "", extraJson ? extraJson : "");
+}
+
+static pthread_t collectorThread;
+static atomic_bool collectorRunning;
+static void* collectorMain(void* ptr) {
+    epochThreadInit();
+    while (collectorRunning) {
+        epochGlobalCollect();
+        usleep(1000);
+    }
+    epochThreadDestroy();
+    return NULL;
+}
+void benchCollectorStart() {
+    collectorRunning = true;
+    pthread_create(&collectorThread, NULL, collectorMain, NULL);
+}
+void benchCollectorStop() {
+    collectorRunning = false;
+    pthread_join(collectorThread, NULL);
+}
+
+int main(int argc, char** argv) {
+    selectedGroupsCount = argc - 1;
+    selectedGroups = argv + 1;
+    commit = getenv("FOLK_BENCH_COMMIT");
+    if (commit != NULL && commit[0] == '\0') { commit = NULL; }
+
+    epochThreadInit();
+    workQueueInit();
+
+    if (benchSelected("trie")) { benchTrie(); }
+    if (benchSelected("workqueue")) { benchWorkQueue(); }
+    if (benchSelected("epoch")) { benchEpoch(); }
+    if (benchSelected("db")) { benchDb(); }
+
+    return 0;
+}
@@ -0,0 +1,57 @@
+#ifndef MICROBENCH_H
+#define MICROBENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+// Tiny harness for the native microbenchmarks in bench/*-bench.c.
+//
+// Every measurement is printed to stdout as one JSON object per line,
+// e.g.
+//
+//   {"bench":"trie-add","n":10000,"fanout":16,"threads":1,"ops":10000,"ns":4210000,"nsPerOp":421.0,"opsPerSec":2375296,"commit":"632df89"}
+//
+// so runs can be appended to a file and diffed/plotted across
+// commits. A human-readable summary goes to stderr.
+
+static inline int64_t benchNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + (int64_t)ts.tv_nsec;
+}
+
+// Soft cap on how long any one measurement loop should run.
+#define BENCH_MAX_NS 500000000
+
+// Parameters of one measurement. Fields left at 0 are omitted from
+// the output.
+typedef struct BenchParams {
+    int n;
+    int fanout;
+    int threads;
+    const char* shape;
+} BenchParams;
+
+// Prints one result line. `extraJson` (may be NULL) is spliced into
+// the object as-is, for benchmark-specific counters, e.g.
+// "\"casRetries\":12".
+void benchReport(const char* bench, BenchParams params,
+                 int64_t ops, int64_t ns, const char* extraJson);
+
+// Returns true if the benchmark group `group` was selected on the
+// command line (or if nothing was selected).
+bool benchSelected(const char* group);
+
+// Starts/stops a thread that calls epochGlobalCollect every
+// millisecond, like the sysmon does in Folk. Needed by anything that
+// retires trie nodes or statements through the epoch allocator.
+void benchCollectorStart();
+void benchCollectorStop();
+
+void benchTrie();
+void benchWorkQueue();
+void benchEpoch();
+void benchDb();
+
+#endif
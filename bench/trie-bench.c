@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "trie.h"
+#include "epoch.h"
+#include "bench/microbench.h"
+
+// Statements look like `tag <digit> <digit> ... <digit>`, the digits
+// of i in base `fanout` (at least 3 of them), so every internal node
+// of the trie under `tag` has up to `fanout` branches.
+static int benchTrieDepth(int n, int fanout) {
+    int depth = 1; int64_t capacity = fanout;
+    while (capacity < n) { capacity *= fanout; depth++; }
+    return depth < 3 ? 3 : depth;
+}
+// If varIdx >= 0, that digit is replaced with a variable.
+static Clause* benchTrieClauseWithVar(int i, int n, int fanout, int varIdx) {
+    int depth = benchTrieDepth(n, fanout);
+    char s[256] = "tag"; int len = 3;
+    int digits[32];
+    for (int d = depth - 1; d >= 0; d--) { digits[d] = i % fanout; i /= fanout; }
+    for (int d = 0; d < depth; d++) {
+        if (d == varIdx) {
+            len += snprintf(s + len, sizeof(s) - len, " /d%d/", d);
+        } else {
+            len += snprintf(s + len, sizeof(s) - len, " %d", digits[d]);
+        }
+    }
+    return clauseFormat("%s", s);
+}
+static Clause* benchTrieClause(int i, int n, int fanout) {
+    return benchTrieClauseWithVar(i, n, fanout, -1);
+}
+
+// The lookup pattern shapes we care about, from cheapest to most
+// expensive to match.
+static const char* shapes[] = { "literal", "trailing-var", "middle-var", "leading-var" };
+static Clause* benchTriePattern(const char* shape, int i, int n, int fanout) {
+    int depth = benchTrieDepth(n, fanout);
+    if (shape == shapes[0]) {
+        return benchTrieClauseWithVar(i, n, fanout, -1);
+    } else if (shape == shapes[1]) {
+        // Matches all the siblings of one leaf.
+        return benchTrieClauseWithVar(i, n, fanout, depth - 1);
+    } else if (shape == shapes[2]) {
+        // Has to walk every branch of one internal node halfway down.
+        return benchTrieClauseWithVar(i, n, fanout, depth / 2);
+    } else {
+        // Has to walk every branch right under `tag`.
+        return benchTrieClauseWithVar(i, n, fanout, 0);
+    }
+}
+
+static void benchTrieFree(const Trie* trie, int n, int fanout) {
+    int depth = benchTrieDepth(n, fanout);
+    Clause* all = clauseNew(1 + depth);
+    for (int d = 0; d <= depth; d++) {
+        char var[16]; snprintf(var, sizeof(var), "/v%d/", d);
+        all->terms[d] = termNew(var, -1);
+    }
+    uint64_t* results = malloc(n * sizeof(uint64_t)); int resultsCount;
+    trie = trieRemove(trie, malloc, free, all, results, n, &resultsCount);
+    clauseFree(all);
+    free((void*)trie);
+    free(results);
+}
+
+static void benchTrieSingleThreaded(int n, int fanout) {
+    BenchParams params = { .n = n, .fanout = fanout };
+
+    // Pre-build the clauses so we time only the trie.
+    Clause** clauses = malloc(n * sizeof(Clause*));
+    for (int i = 0; i < n; i++) { clauses[i] = benchTrieClause(i, n, fanout); }
+
+    const Trie* trie = trieNew();
+    int64_t t0 = benchNow();
+    for (int i = 0; i < n; i++) {
+        trie = trieAdd(trie, malloc, free, clauses[i], i + 1);
+    }
+    benchReport("trie-add", params, n, benchNow() - t0, NULL);
+
+    // Re-adding an existing clause is the common case on every
+    // Claim that's re-derived; it should not allocate.
+    t0 = benchNow();
+    for (int i = 0; i < n; i++) {
+        trie = trieAdd(trie, malloc, free, clauses[i], i + 1);
+    }
+    benchReport("trie-add-existing", params, n, benchNow() - t0, NULL);
+
+    uint64_t* results = malloc(n * sizeof(uint64_t));
+    for (int s = 0; s < sizeof(shapes)/sizeof(shapes[0]); s++) {
+        params.shape = shapes[s];
+        int lookups = n < 10000 ? n : 10000;
+        Clause** patterns = malloc(lookups * sizeof(Clause*));
+        for (int i = 0; i < lookups; i++) {
+            patterns[i] = benchTriePattern(shapes[s], (i * 7919) % n, n, fanout);
+        }
+
+        // Stop early if it's a slow shape, so the whole suite stays
+        // quick to run.
+        int64_t resultsTotal = 0;
+        t0 = benchNow();
+        int done;
+        for (done = 0; done < lookups; done++) {
+            if (done % 64 == 63 && benchNow() - t0 > BENCH_MAX_NS) { break; }
+            resultsTotal += trieLookup(trie, patterns[done], results, n);
+        }
+        int64_t ns = benchNow() - t0;
+        char extra[100];
+        snprintf(extra, sizeof(extra), "\"resultsPerOp\":%.1f",
+                 (double)resultsTotal / done);
+        benchReport("trie-lookup", params, done, ns, extra);
+
+        for (int i = 0; i < lookups; i++) { clauseFree(patterns[i]); }
+        free(patterns);
+    }
+    params.shape = NULL;
+
+    t0 = benchNow();
+    for (int i = 0; i < n; i++) {
+        int resultsCount;
+        trie = trieRemove(trie, malloc, free, clauses[i], results, 1, &resultsCount);
+    }
+    benchReport("trie-remove", params, n, benchNow() - t0, NULL);
+
+    free((void*)trie);
+    free(results);
+    for (int i = 0; i < n; i++) { clauseFree(clauses[i]); }
+    free(clauses);
+}
+
+// Concurrent insertion, the way db.c does it: each thread builds a
+// new trie off the current root with the epoch allocator and tries
+// to CAS it in, starting over on conflict.
+typedef struct BenchTrieCasArg {
+    const Trie* _Atomic* root;
+    int from, to, n, fanout;
+    atomic_long* retries;
+} BenchTrieCasArg;
+static void* benchTrieCasMain(void* ptr) {
+    BenchTrieCasArg* arg = ptr;
+    epochThreadInit();
+    long retries = 0;
+    for (int i = arg->from; i < arg->to; i++) {
+        Clause* c = benchTrieClause(i, arg->n, arg->fanout);
+        epochBegin();
+        const Trie* oldRoot; const Trie* newRoot;
+        oldRoot = *arg->root;
+        while (true) {
+            newRoot = trieAdd(oldRoot, epochAlloc, epochFree, c, i + 1);
+            if (atomic_compare_exchange_weak(arg->root, &oldRoot, newRoot)) { break; }
+            epochReset();
+            retries++;
+        }
+        epochEnd();
+        clauseFree(c);
+    }
+    atomic_fetch_add(arg->retries, retries);
+    epochThreadDestroy();
+    return NULL;
+}
+static void benchTrieCas(int n, int fanout, int threadsCount) {
+    const Trie* _Atomic root = trieNew();
+    atomic_long retries = 0;
+    pthread_t threads[threadsCount];
+    BenchTrieCasArg args[threadsCount];
+
+    int64_t t0 = benchNow();
+    for (int t = 0; t < threadsCount; t++) {
+        args[t] = (BenchTrieCasArg) {
+            .root = &root,
+            .from = n * t / threadsCount, .to = n * (t + 1) / threadsCount, .n = n,
+            .fanout = fanout, .retries = &retries
+        };
+        pthread_create(&threads[t], NULL, benchTrieCasMain, &args[t]);
+    }
+    for (int t = 0; t < threadsCount; t++) { pthread_join(threads[t], NULL); }
+    int64_t ns = benchNow() - t0;
+
+    char extra[100];
+    snprintf(extra, sizeof(extra), "\"casRetries\":%ld", (long)retries);
+    benchReport("trie-cas-insert",
+                (BenchParams) { .n = n, .fanout = fanout, .threads = threadsCount },
+                n, ns, extra);
+
+    // All the writers are done, so it's safe to free directly.
+    benchTrieFree(root, n, fanout);
+}
+
+void benchTrie() {
+    int ns[] = { 1000, 10000, 100000 };
+    int fanouts[] = { 4, 16, 256 };
+    for (int i = 0; i < sizeof(ns)/sizeof(ns[0]); i++) {
+        for (int j = 0; j < sizeof(fanouts)/sizeof(fanouts[0]); j++) {
+            benchTrieSingleThreaded(ns[i], fanouts[j]);
+        }
+    }
+
+    benchCollectorStart();
+    int threadCounts[] = { 1, 2, 4, 8 };
+    for (int i = 0; i < sizeof(threadCounts)/sizeof(threadCounts[0]); i++) {
+        benchTrieCas(20000, 16, threadCounts[i]);
+    }
+    benchCollectorStop();
+}
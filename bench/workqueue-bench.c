@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "workqueue.h"
+#include "bench/microbench.h"
+
+static WorkQueueItem benchItem(int i) {
+    return (WorkQueueItem) { .op = EVAL, .eval = { .code = (char*)(intptr_t)(i + 1) } };
+}
+
+// Owner-only push then take, in batches of `batch` (which is how deep
+// the deque gets, so it also exercises the resize path once).
+static void benchWorkQueuePushTake(int n, int batch) {
+    WorkQueue* q = workQueueNew();
+    int64_t t0 = benchNow();
+    for (int i = 0; i < n; i += batch) {
+        for (int j = 0; j < batch; j++) { workQueuePush(q, benchItem(i + j)); }
+        for (int j = 0; j < batch; j++) {
+            if (workQueueTake(q).op == NONE) {
+                fprintf(stderr, "benchWorkQueuePushTake: queue ran dry\n"); exit(1);
+            }
+        }
+    }
+    benchReport("workqueue-push-take", (BenchParams) { .n = batch, .threads = 1 },
+                n, benchNow() - t0, NULL);
+    free(q);
+}
+
+// The owner keeps pushing (and occasionally taking, like a worker
+// that runs its own work between pushes) while `thieves` other
+// threads steal, until all n items have been consumed.
+typedef struct BenchStealState {
+    WorkQueue* q;
+    int n;
+    atomic_int consumed;
+    atomic_long stolen;
+    atomic_long failedSteals;
+} BenchStealState;
+static void* benchThiefMain(void* ptr) {
+    BenchStealState* st = ptr;
+    long stolen = 0, failed = 0;
+    while (atomic_load(&st->consumed) < st->n) {
+        WorkQueueItem item = workQueueSteal(st->q);
+        if (item.op == NONE) { failed++; continue; }
+        stolen++;
+        atomic_fetch_add(&st->consumed, 1);
+    }
+    atomic_fetch_add(&st->stolen, stolen);
+    atomic_fetch_add(&st->failedSteals, failed);
+    return NULL;
+}
+static void benchWorkQueueSteal(int n, int thieves) {
+    BenchStealState st = { .q = workQueueNew(), .n = n };
+    pthread_t threads[thieves];
+
+    int64_t t0 = benchNow();
+    for (int t = 0; t < thieves; t++) {
+        pthread_create(&threads[t], NULL, benchThiefMain, &st);
+    }
+    long taken = 0;
+    for (int i = 0; i < n; i++) {
+        workQueuePush(st.q, benchItem(i));
+        if (i % 4 == 3) {
+            // Keep the deque shallow, as a busy worker would.
+            if (workQueueTake(st.q).op != NONE) {
+                taken++; atomic_fetch_add(&st.consumed, 1);
+            }
+        }
+    }
+    // Drain whatever the thieves didn't get to.
+    WorkQueueItem item;
+    while ((item = workQueueTake(st.q)).op != NONE) {
+        taken++; atomic_fetch_add(&st.consumed, 1);
+    }
+    for (int t = 0; t < thieves; t++) { pthread_join(threads[t], NULL); }
+    int64_t ns = benchNow() - t0;
+
+    char extra[200];
+    snprintf(extra, sizeof(extra),
+             "\"taken\":%ld,\"stolen\":%ld,\"failedSteals\":%ld",
+             taken, (long)st.stolen, (long)st.failedSteals);
+    benchReport("workqueue-steal", (BenchParams) { .threads = thieves + 1 },
+                n, ns, extra);
+    free(st.q);
+}
+
+void benchWorkQueue() {
+    int batches[] = { 1, 16, 1024 };
+    for (int i = 0; i < sizeof(batches)/sizeof(batches[0]); i++) {
+        benchWorkQueuePushTake(1 << 20, batches[i]);
+    }
+    int thieves[] = { 1, 2, 4, 8 };
+    for (int i = 0; i < sizeof(thieves)/sizeof(thieves[0]); i++) {
+        benchWorkQueueSteal(1 << 18, thieves[i]);
+    }
+}
@@ -1,6 +1,8 @@
 #define _GNU_SOURCE
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
 
@@ -8,70 +10,155 @@
 
 #include <jim.h>
 
+#include "common.h"
+#include "histogram.h"
 #include "block-stats.h"
 
-// Running EWMA of Jim_EvalObjVector runtime per filename:lineno.
-// rwlock: rlock for updates to existing entries (ewma/count updated with
-// relaxed atomics), wlock only when inserting a new entry.
-typedef struct {
-    char *key;       // stb_ds string hashmap key ("filename:lineno")
-    uint64_t count;
-    double ewma_ns;
-} BlockStat;
-static BlockStat *blockStats = NULL;
-static pthread_rwlock_t blockStatsLock = PTHREAD_RWLOCK_INITIALIZER;
+// Runtime stats for When bodies, per source location
+// (filename:lineno).
+//
+// Each location is interned once (the first time a given When
+// statement runs) into a small integer id. Each thread that runs
+// blocks has its own shard of stats, indexed by id, which only that
+// thread ever writes to (with relaxed atomic stores, so no locks on
+// the hot path). __blockRuntimeStats sums up all the shards when
+// someone asks.
+//
+// For each location we keep a count, total time, max time, and a
+// log-linear (HDR-style) histogram of runtimes, so we can report tail
+// latency (p99) and not just averages.
+
+static char* blockStatsKeys[BLOCK_STATS_IDS_MAX];
+static int _Atomic blockStatsKeysCount;
+static struct { char* key; int value; }* blockStatsIds;
+static pthread_mutex_t blockStatsIdsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+typedef Histogram BlockStat;
+
+// Shards are allocated in chunks of ids, on demand, so a thread only
+// pays for the locations it actually runs.
+#define BLOCK_STATS_CHUNK 64
+typedef struct BlockStatsShard {
+    BlockStat* _Atomic chunks[BLOCK_STATS_IDS_MAX / BLOCK_STATS_CHUNK];
+    struct BlockStatsShard* next;
+} BlockStatsShard;
+
+// All shards ever created. Shards are never freed (so stats from
+// exited threads still count); new ones are pushed onto the front.
+static BlockStatsShard* _Atomic blockStatsShards;
+static __thread BlockStatsShard* blockStatsShard;
+// Shard of each worker slot, so a worker that replaces a retired one
+// takes over its shard instead of making another.
+static BlockStatsShard* blockStatsShardsBySlot[THREADS_MAX];
 
 void blockStatsInit(void) {
-    sh_new_arena(blockStats);
+    sh_new_strdup(blockStatsIds);
+    blockStatsKeys[0] = "(other)";
+    blockStatsKeysCount = 1;
 }
 
-void blockStatsUpdate(const char *sourceFileName, int sourceLineNumber,
-                      int64_t elapsed_ns) {
+int blockStatsIntern(const char *sourceFileName, int sourceLineNumber) {
     char key[1024];
-    if (snprintf(key, sizeof(key), "%s:%d", sourceFileName, sourceLineNumber)
-            >= (int)sizeof(key)) return;
-
-    // Fast path: entry already exists — update under rlock with relaxed atomics.
-    pthread_rwlock_rdlock(&blockStatsLock);
-    BlockStat *e = shgetp_null(blockStats, key);
-    if (e != NULL) {
-        __atomic_fetch_add(&e->count, 1, __ATOMIC_RELAXED);
-        double prev, next;
-        __atomic_load(&e->ewma_ns, &prev, __ATOMIC_RELAXED);
-        next = 0.1 * elapsed_ns + 0.9 * prev;
-        __atomic_store(&e->ewma_ns, &next, __ATOMIC_RELAXED);
-        pthread_rwlock_unlock(&blockStatsLock);
-        return;
+    snprintf(key, sizeof(key), "%s:%d", sourceFileName, sourceLineNumber);
+
+    pthread_mutex_lock(&blockStatsIdsMutex);
+    int id = shget(blockStatsIds, key);
+    if (id == 0 && blockStatsKeysCount < BLOCK_STATS_IDS_MAX) {
+        id = blockStatsKeysCount;
+        shput(blockStatsIds, key, id);
+        blockStatsKeys[id] = shgets(blockStatsIds, key).key;
+        // Publish the key before the id is visible to readers.
+        __atomic_store_n(&blockStatsKeysCount, id + 1, __ATOMIC_RELEASE);
     }
-    pthread_rwlock_unlock(&blockStatsLock);
+    pthread_mutex_unlock(&blockStatsIdsMutex);
+    return id;
+}
+
+#define BLOCK_STATS_INTERN_CACHE_SIZE 64
+int blockStatsInternCached(const char *sourceFileName, int sourceLineNumber) {
+    // (Inline names, so nothing's left to free when the thread exits.
+    // Longer names just don't get cached.)
+    static __thread struct {
+        char sourceFileName[256];
+        int sourceLineNumber;
+        int id;
+    } cache[BLOCK_STATS_INTERN_CACHE_SIZE];
 
-    // Slow path: new entry — acquire wlock, recheck, insert.
-    pthread_rwlock_wrlock(&blockStatsLock);
-    if (shgetp_null(blockStats, key) == NULL) {
-        BlockStat new_entry = { .key = (char *)key, .count = 0, .ewma_ns = 0.0 };
-        shputs(blockStats, new_entry);
+    uint32_t h = ((uint32_t)sourceLineNumber * 2654435761u) % BLOCK_STATS_INTERN_CACHE_SIZE;
+    if (cache[h].id > 0 && cache[h].sourceLineNumber == sourceLineNumber &&
+        strcmp(cache[h].sourceFileName, sourceFileName) == 0) {
+        return cache[h].id;
     }
-    e = shgetp_null(blockStats, key);
-    e->count++;
-    e->ewma_ns = e->count == 1 ? (double)elapsed_ns
-                               : 0.1 * elapsed_ns + 0.9 * e->ewma_ns;
-    pthread_rwlock_unlock(&blockStatsLock);
+
+    int id = blockStatsIntern(sourceFileName, sourceLineNumber);
+    size_t len = strlen(sourceFileName);
+    if (len < sizeof(cache[h].sourceFileName)) {
+        memcpy(cache[h].sourceFileName, sourceFileName, len + 1);
+        cache[h].sourceLineNumber = sourceLineNumber;
+        cache[h].id = id;
+    }
+    return id;
 }
 
+const char* blockStatsLocation(int id) {
+    if (id < 0 || id >= __atomic_load_n(&blockStatsKeysCount, __ATOMIC_ACQUIRE)) { id = 0; }
+    return blockStatsKeys[id];
+}
+
+void blockStatsUpdate(int id, int64_t elapsed_ns) {
+    if (id < 0 || id >= BLOCK_STATS_IDS_MAX) { id = 0; }
+
+    BlockStatsShard* shard = blockStatsShard;
+    if (shard == NULL) {
+        int slot = self != NULL ? self->index : -1;
+        if (slot >= 0) { shard = blockStatsShardsBySlot[slot]; }
+        if (shard == NULL) {
+            shard = calloc(1, sizeof(BlockStatsShard));
+            shard->next = blockStatsShards;
+            while (!__atomic_compare_exchange_n(&blockStatsShards, &shard->next, shard,
+                                                true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {}
+            if (slot >= 0) { blockStatsShardsBySlot[slot] = shard; }
+        }
+        blockStatsShard = shard;
+    }
+    BlockStat* chunk = shard->chunks[id / BLOCK_STATS_CHUNK];
+    if (chunk == NULL) {
+        chunk = calloc(BLOCK_STATS_CHUNK, sizeof(BlockStat));
+        __atomic_store_n(&shard->chunks[id / BLOCK_STATS_CHUNK], chunk, __ATOMIC_RELEASE);
+    }
+
+    histogramRecord(&chunk[id % BLOCK_STATS_CHUNK], elapsed_ns);
+}
+
+// Returns a list of {location count totalNs p50Ns p99Ns maxNs}, one
+// per location that has run at least once.
 int __blockRuntimeStatsFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
     Jim_Obj *result = Jim_NewListObj(interp, NULL, 0);
-    pthread_rwlock_rdlock(&blockStatsLock);
-    for (int i = 0; i < shlen(blockStats); i++) {
-        Jim_Obj *entry = Jim_NewListObj(interp, NULL, 0);
-        Jim_ListAppendElement(interp, entry,
-                              Jim_NewStringObj(interp, blockStats[i].key, -1));
-        Jim_ListAppendElement(interp, entry,
-                              Jim_NewDoubleObj(interp, blockStats[i].ewma_ns));
-        Jim_ListAppendElement(interp, entry,
-                              Jim_NewIntObj(interp, (jim_wide)blockStats[i].count));
-        Jim_ListAppendElement(interp, result, entry);
+    int keysCount = __atomic_load_n(&blockStatsKeysCount, __ATOMIC_ACQUIRE);
+    BlockStatsShard* shards = __atomic_load_n(&blockStatsShards, __ATOMIC_ACQUIRE);
+
+    BlockStat merged;
+    for (int id = 0; id < keysCount; id++) {
+        memset(&merged, 0, sizeof(merged));
+        for (BlockStatsShard* shard = shards; shard != NULL; shard = shard->next) {
+            BlockStat* chunk = __atomic_load_n(&shard->chunks[id / BLOCK_STATS_CHUNK],
+                                               __ATOMIC_ACQUIRE);
+            if (chunk == NULL) { continue; }
+            histogramMerge(&merged, &chunk[id % BLOCK_STATS_CHUNK]);
+        }
+        if (merged.count == 0) { continue; }
+
+        Jim_Obj *entry[] = {
+            Jim_NewStringObj(interp, blockStatsKeys[id], -1),
+            Jim_NewIntObj(interp, (jim_wide)merged.count),
+            Jim_NewIntObj(interp, (jim_wide)merged.totalNs),
+            Jim_NewIntObj(interp, (jim_wide)histogramPercentile(&merged, 0.5)),
+            Jim_NewIntObj(interp, (jim_wide)histogramPercentile(&merged, 0.99)),
+            Jim_NewIntObj(interp, (jim_wide)merged.maxNs)
+        };
+        Jim_ListAppendElement(interp, result,
+                              Jim_NewListObj(interp, entry, sizeof(entry)/sizeof(entry[0])));
     }
-    pthread_rwlock_unlock(&blockStatsLock);
     Jim_SetResult(interp, result);
     return JIM_OK;
 }
@@ -4,9 +4,21 @@
 #include <stdint.h>
 #include <jim.h>
 
+// Id 0 is where everything goes if we run out of ids.
+#define BLOCK_STATS_IDS_MAX 65536
+
 void blockStatsInit(void);
-void blockStatsUpdate(const char *sourceFileName, int sourceLineNumber,
-                      int64_t elapsed_ns);
+// Returns the id to pass to blockStatsUpdate for this source
+// location. Takes a lock, so callers should intern once and keep the
+// id around.
+int blockStatsIntern(const char *sourceFileName, int sourceLineNumber);
+// Like blockStatsIntern, but checks a small per-thread cache of
+// recent locations first, for call sites (like Assert!) that can't
+// keep the id around themselves.
+int blockStatsInternCached(const char *sourceFileName, int sourceLineNumber);
+void blockStatsUpdate(int id, int64_t elapsed_ns);
+// The "file:line" for an id (valid forever).
+const char* blockStatsLocation(int id);
 int __blockRuntimeStatsFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv);
 
 #endif
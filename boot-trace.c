@@ -0,0 +1,611 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "vendor/stb_ds.h"
+
+#include <jim.h>
+
+#include "common.h"
+#include "boot-trace.h"
+
+// Boot tracer. While FOLK_BOOT_TRACE is set and boot hasn't finished,
+// we record every When block run (which program, which line, which
+// program made the statement that fired it), every C compile and
+// `exec` (attributed to the block that did it), and when each
+// program's code got held. Boot is complete once nothing new has
+// happened for FOLK_BOOT_TRACE_QUIET_MS -- no program has started or
+// fired its first When, no new dependency edge has shown up, no
+// compile/exec is running -- or after FOLK_BOOT_TRACE_MAX_MS. Then
+// we write a Chrome trace (load it in chrome://tracing or Perfetto)
+// and a critical-path summary, and stop tracing.
+
+bool _Atomic bootTracing;
+
+typedef enum {
+    BOOT_TRACE_HELD,
+    BOOT_TRACE_PROGRAM, // a program's top-level code
+    BOOT_TRACE_WHEN,
+    BOOT_TRACE_COMPILE,
+    BOOT_TRACE_EXEC
+} BootTraceEventKind;
+static const char* bootTraceEventKindNames[] = {
+    "held", "program", "when", "compile", "exec"
+};
+
+typedef struct BootTraceEvent {
+    BootTraceEventKind kind;
+    int program;
+    int line;
+    int enabler;
+    int worker;
+    int64_t startNs;
+    int64_t durNs;
+
+    // For blocks: this block's id. For spans: the id of the block
+    // the span ran in (or -1).
+    int64_t blockId;
+    bool isMilestone;
+    bool isNewEdge;
+    // For spans: what was compiled/exec-ed.
+    char* label;
+} BootTraceEvent;
+
+typedef struct BootTraceProgram {
+    int64_t heldNs;
+    int64_t startedNs;
+    int64_t firstWhenNs;
+    int64_t compileNs; int compiles;
+    int64_t execNs; int execs;
+} BootTraceProgram;
+
+typedef struct BootTraceEdge {
+    int64_t count;
+    int64_t firstNs;
+    // The first statement we saw along this edge.
+    char* example;
+} BootTraceEdge;
+
+static pthread_mutex_t bootTraceMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char* bootTracePath;
+static int64_t bootTraceStartNs;
+static int64_t bootTraceQuietNs;
+static int64_t bootTraceMaxNs;
+
+// Interned program names -> index into bootTracePrograms (and
+// programNames, which points at the same strings).
+static struct { char* key; int value; }* programIndices;
+static char** programNames;
+static BootTraceProgram* bootTracePrograms;
+static BootTraceEvent* bootTraceEvents;
+// (enabler << 32 | program) -> edge.
+static struct { uint64_t key; BootTraceEdge value; }* bootTraceEdges;
+
+#define BOOT_TRACE_EVENTS_MAX 200000
+static int64_t droppedEvents;
+
+static int64_t _Atomic nextBlockId;
+static int64_t _Atomic lastMilestoneNs;
+// Milestone blocks and spans currently running.
+static int _Atomic inflightCount;
+
+static bool finished;
+static char* summary; // stb_ds array, NUL-terminated
+
+static __thread BootTraceBlock* currentBlock;
+
+void bootTraceInit(void) {
+    bootTracePath = getenv("FOLK_BOOT_TRACE");
+    if (bootTracePath == NULL || bootTracePath[0] == '\0') { return; }
+
+    const char* quiet = getenv("FOLK_BOOT_TRACE_QUIET_MS");
+    bootTraceQuietNs = (quiet ? atoll(quiet) : 3000) * 1000000;
+    const char* max = getenv("FOLK_BOOT_TRACE_MAX_MS");
+    bootTraceMaxNs = (max ? atoll(max) : 120000) * 1000000;
+
+    sh_new_strdup(programIndices);
+    bootTraceStartNs = timestamp_get(CLOCK_MONOTONIC);
+    lastMilestoneNs = bootTraceStartNs;
+    bootTracing = true;
+}
+
+// Call with bootTraceMutex held.
+static int programIntern(const char* name) {
+    if (name == NULL) { name = "?"; }
+    int idx = shgeti(programIndices, name);
+    if (idx >= 0) { return programIndices[idx].value; }
+
+    BootTraceProgram p = { .heldNs = -1, .startedNs = -1, .firstWhenNs = -1 };
+    arrput(bootTracePrograms, p);
+    shput(programIndices, name, arrlen(bootTracePrograms) - 1);
+    arrput(programNames, programIndices[shgeti(programIndices, name)].key);
+    return arrlen(bootTracePrograms) - 1;
+}
+static const char* programName(int program) {
+    return programNames[program];
+}
+
+// Call with bootTraceMutex held.
+static void eventAdd(BootTraceEvent ev) {
+    if (arrlen(bootTraceEvents) >= BOOT_TRACE_EVENTS_MAX) {
+        droppedEvents++;
+        free(ev.label);
+        return;
+    }
+    arrput(bootTraceEvents, ev);
+}
+
+static void milestone(void) {
+    lastMilestoneNs = timestamp_get(CLOCK_MONOTONIC);
+}
+
+void bootTraceBlockBegin(BootTraceBlock* b,
+                         const char* sourceFileName, int sourceLineNumber,
+                         const char* enablerFileName, Clause* enablerClause) {
+    b->program = -1;
+    if (!bootTracing) { return; }
+
+    b->id = nextBlockId++;
+    b->line = sourceLineNumber;
+    b->isMilestone = false;
+    b->isNewEdge = false;
+    b->hasSpans = false;
+
+    pthread_mutex_lock(&bootTraceMutex);
+    if (finished) {
+        pthread_mutex_unlock(&bootTraceMutex);
+        return;
+    }
+    b->program = programIntern(sourceFileName);
+    b->enabler = enablerClause ? programIntern(enablerFileName) : -1;
+    b->startNs = timestamp_get(CLOCK_MONOTONIC);
+
+    BootTraceProgram* p = &bootTracePrograms[b->program];
+    if (enablerClause == NULL && p->startedNs < 0) {
+        p->startedNs = b->startNs;
+        b->isMilestone = true;
+    } else if (enablerClause != NULL && p->firstWhenNs < 0) {
+        p->firstWhenNs = b->startNs;
+        b->isMilestone = true;
+    }
+
+    if (enablerClause != NULL) {
+        uint64_t key = (uint64_t)b->enabler << 32 | (uint32_t)b->program;
+        ptrdiff_t i = hmgeti(bootTraceEdges, key);
+        if (i < 0) {
+            BootTraceEdge edge = {
+                .count = 0, .firstNs = b->startNs,
+                .example = clauseToString(enablerClause)
+            };
+            for (char* c = edge.example; *c; c++) {
+                if (*c == '\n') { *c = ' '; }
+            }
+            hmput(bootTraceEdges, key, edge);
+            i = hmgeti(bootTraceEdges, key);
+            b->isNewEdge = true;
+            b->isMilestone = true;
+        }
+        bootTraceEdges[i].value.count++;
+    }
+    pthread_mutex_unlock(&bootTraceMutex);
+
+    if (b->isMilestone) {
+        inflightCount++;
+        milestone();
+    }
+    b->prev = currentBlock;
+    currentBlock = b;
+}
+
+void bootTraceBlockEnd(BootTraceBlock* b) {
+    if (b->program < 0) { return; }
+    currentBlock = b->prev;
+
+    int64_t endNs = timestamp_get(CLOCK_MONOTONIC);
+    pthread_mutex_lock(&bootTraceMutex);
+    if (!finished) {
+        BootTraceEvent ev = {
+            .kind = b->enabler < 0 && b->isMilestone ?
+                BOOT_TRACE_PROGRAM : BOOT_TRACE_WHEN,
+            .program = b->program, .line = b->line, .enabler = b->enabler,
+            .worker = self ? self->index : -1,
+            .startNs = b->startNs, .durNs = endNs - b->startNs,
+            .blockId = b->id,
+            .isMilestone = b->isMilestone || b->hasSpans,
+            .isNewEdge = b->isNewEdge
+        };
+        eventAdd(ev);
+    }
+    pthread_mutex_unlock(&bootTraceMutex);
+
+    if (b->isMilestone) {
+        milestone();
+        inflightCount--;
+    }
+}
+
+//////////////////////////////////////////////////////////
+// Critical path & output
+//////////////////////////////////////////////////////////
+
+// Appends to an stb_ds char array, keeping it NUL-terminated. (We
+// build output in memory rather than using stdio, since fprintf is
+// overridden in output-redirection.c and doesn't mix with buffered
+// stdio.)
+static void bufAppendf(char** buf, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    if (arrlen(*buf) > 0) { arrpop(*buf); } // the NUL
+    char* dst = arraddnptr(*buf, len + 1);
+    va_start(args, fmt);
+    vsnprintf(dst, len + 1, fmt, args);
+    va_end(args);
+}
+#define summaryAppendf(...) bufAppendf(&summary, __VA_ARGS__)
+
+// Ordering of events by start time, with index as tiebreaker, so
+// walking back through predecessors always terminates.
+static bool eventIsBefore(int a, int b) {
+    BootTraceEvent* ea = &bootTraceEvents[a];
+    BootTraceEvent* eb = &bootTraceEvents[b];
+    return ea->startNs < eb->startNs ||
+        (ea->startNs == eb->startNs && a < b);
+}
+
+// The latest event of the given kinds in `program` that started
+// before event `before`, or -1.
+static int latestEventBefore(int program, bool held, bool blocks, int before) {
+    int best = -1;
+    for (int i = 0; i < arrlen(bootTraceEvents); i++) {
+        BootTraceEvent* ev = &bootTraceEvents[i];
+        if (ev->program != program || i == before) { continue; }
+        bool isBlock = ev->kind == BOOT_TRACE_PROGRAM || ev->kind == BOOT_TRACE_WHEN;
+        if (!((held && ev->kind == BOOT_TRACE_HELD) || (blocks && isBlock))) { continue; }
+        if (!eventIsBefore(i, before)) { continue; }
+        if (best < 0 || eventIsBefore(best, i)) { best = i; }
+    }
+    return best;
+}
+
+// What had to happen before event i could: the held code for a
+// program's top-level run, or the block (in the enabling program)
+// that made the statement that fired a When.
+static int eventPredecessor(int i) {
+    BootTraceEvent* ev = &bootTraceEvents[i];
+    switch (ev->kind) {
+    case BOOT_TRACE_PROGRAM:
+        return latestEventBefore(ev->program, true, false, i);
+    case BOOT_TRACE_HELD:
+    case BOOT_TRACE_WHEN:
+        if (ev->enabler < 0) { return -1; }
+        return latestEventBefore(ev->enabler, false, true, i);
+    default:
+        return -1;
+    }
+}
+
+static double ms(int64_t ns) { return ns / 1000000.0; }
+
+static void summaryAppendSpans(int64_t blockId) {
+    for (int i = 0; i < arrlen(bootTraceEvents); i++) {
+        BootTraceEvent* ev = &bootTraceEvents[i];
+        if (ev->blockId != blockId ||
+            (ev->kind != BOOT_TRACE_COMPILE && ev->kind != BOOT_TRACE_EXEC)) { continue; }
+        summaryAppendf("%21s %9.1fms  %s %.80s\n", "",
+                       ms(ev->durNs), bootTraceEventKindNames[ev->kind], ev->label);
+    }
+}
+
+static void buildSummary(int64_t endNs) {
+    summaryAppendf("Boot trace: boot complete at %.1fms; %d programs, %d events",
+                   ms(endNs - bootTraceStartNs),
+                   (int)arrlen(bootTracePrograms), (int)arrlen(bootTraceEvents));
+    if (droppedEvents > 0) {
+        summaryAppendf(" (%" PRId64 " dropped)", droppedEvents);
+    }
+    summaryAppendf("\n\nCritical path:\n");
+
+    // The path ends at the milestone that finished last.
+    int sink = -1;
+    for (int i = 0; i < arrlen(bootTraceEvents); i++) {
+        BootTraceEvent* ev = &bootTraceEvents[i];
+        if (!ev->isMilestone) { continue; }
+        if (sink < 0 ||
+            ev->startNs + ev->durNs > bootTraceEvents[sink].startNs + bootTraceEvents[sink].durNs) {
+            sink = i;
+        }
+    }
+    int* path = NULL;
+    for (int i = sink; i >= 0; i = eventPredecessor(i)) { arrput(path, i); }
+
+    // `waited` is the time between the previous step on the path
+    // finishing and this one starting (queueing, mostly).
+    summaryAppendf("%10s %10s %11s  %s\n", "start", "waited", "duration", "event");
+    for (int j = arrlen(path) - 1; j >= 0; j--) {
+        BootTraceEvent* ev = &bootTraceEvents[path[j]];
+        int64_t waitedNs = 0;
+        if (j + 1 < arrlen(path)) {
+            BootTraceEvent* prev = &bootTraceEvents[path[j + 1]];
+            waitedNs = ev->startNs - (prev->startNs + prev->durNs);
+            if (waitedNs < 0) { waitedNs = 0; }
+        }
+        summaryAppendf("%8.1fms %8.1fms %9.1fms  %s %s",
+                       ms(ev->startNs - bootTraceStartNs), ms(waitedNs), ms(ev->durNs),
+                       bootTraceEventKindNames[ev->kind], programName(ev->program));
+        if (ev->kind != BOOT_TRACE_HELD) { summaryAppendf(":%d", ev->line); }
+        if (ev->enabler >= 0) {
+            summaryAppendf(" (%s by %s)",
+                           ev->kind == BOOT_TRACE_HELD ? "held" : "fired",
+                           programName(ev->enabler));
+        }
+        summaryAppendf("\n");
+        summaryAppendSpans(ev->blockId);
+    }
+    arrfree(path);
+
+    summaryAppendf("\nPrograms (by compile + exec time):\n");
+    summaryAppendf("%10s %10s %10s %11s %11s  %s\n",
+                   "held", "started", "first When", "compiles", "execs", "program");
+    int* order = NULL;
+    for (int i = 0; i < arrlen(bootTracePrograms); i++) { arrput(order, i); }
+    for (int i = 1; i < arrlen(order); i++) {
+        for (int j = i; j > 0; j--) {
+            BootTraceProgram* a = &bootTracePrograms[order[j - 1]];
+            BootTraceProgram* b = &bootTracePrograms[order[j]];
+            if (a->compileNs + a->execNs >= b->compileNs + b->execNs) { break; }
+            int t = order[j]; order[j] = order[j - 1]; order[j - 1] = t;
+        }
+    }
+    for (int i = 0; i < arrlen(order); i++) {
+        BootTraceProgram* p = &bootTracePrograms[order[i]];
+        char held[20], started[20], firstWhen[20];
+        snprintf(held, sizeof(held), p->heldNs < 0 ? "-" : "%.1fms",
+                 ms(p->heldNs - bootTraceStartNs));
+        snprintf(started, sizeof(started), p->startedNs < 0 ? "-" : "%.1fms",
+                 ms(p->startedNs - bootTraceStartNs));
+        snprintf(firstWhen, sizeof(firstWhen), p->firstWhenNs < 0 ? "-" : "%.1fms",
+                 ms(p->firstWhenNs - bootTraceStartNs));
+        summaryAppendf("%10s %10s %10s %3d %5.0fms %3d %5.0fms  %s\n",
+                       held, started, firstWhen,
+                       p->compiles, ms(p->compileNs), p->execs, ms(p->execNs),
+                       programName(order[i]));
+    }
+    arrfree(order);
+
+    summaryAppendf("\nDependency edges (program that made the statement -> program whose When it fired):\n");
+    for (int i = 0; i < hmlen(bootTraceEdges); i++) {
+        uint64_t key = bootTraceEdges[i].key;
+        BootTraceEdge* edge = &bootTraceEdges[i].value;
+        summaryAppendf("%8.1fms %6" PRId64 "x  %s -> %s (%.100s)\n",
+                       ms(edge->firstNs - bootTraceStartNs), edge->count,
+                       programName((int)(key >> 32)), programName((int)(uint32_t)key),
+                       edge->example);
+    }
+}
+
+static void bufAppendJsonString(char** buf, const char* s) {
+    bufAppendf(buf, "\"");
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') { bufAppendf(buf, "\\%c", c); }
+        else if (c < 0x20) { bufAppendf(buf, "\\u%04x", c); }
+        else { (*buf)[arrlen(*buf) - 1] = c; arrput(*buf, '\0'); }
+    }
+    bufAppendf(buf, "\"");
+}
+
+static void buildTrace(char** out) {
+    bufAppendf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    bufAppendf(out, "{\"ph\": \"M\", \"pid\": 1, \"name\": \"process_name\", "
+               "\"args\": {\"name\": \"folk boot\"}}");
+    for (int i = 0; i < THREADS_MAX; i++) {
+        if (threads[i].tid == 0) { continue; }
+        bufAppendf(out, ",\n{\"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"name\": \"thread_name\", "
+                   "\"args\": {\"name\": \"worker %d\"}}", i, i);
+    }
+
+    for (int i = 0; i < arrlen(bootTraceEvents); i++) {
+        BootTraceEvent* ev = &bootTraceEvents[i];
+        double ts = (ev->startNs - bootTraceStartNs) / 1000.0;
+        bufAppendf(out, ",\n{\"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"cat\": \"%s\", \"name\": ",
+                   ev->worker, ts, bootTraceEventKindNames[ev->kind]);
+        if (ev->label) {
+            char name[200];
+            snprintf(name, sizeof(name), "%s %s", bootTraceEventKindNames[ev->kind], ev->label);
+            bufAppendJsonString(out, name);
+        } else if (ev->kind == BOOT_TRACE_HELD) {
+            char name[300];
+            snprintf(name, sizeof(name), "held %s", programName(ev->program));
+            bufAppendJsonString(out, name);
+        } else {
+            char name[300];
+            snprintf(name, sizeof(name), "%s:%d", programName(ev->program), ev->line);
+            bufAppendJsonString(out, name);
+        }
+        if (ev->kind == BOOT_TRACE_HELD) {
+            bufAppendf(out, ", \"ph\": \"i\", \"s\": \"t\"");
+        } else {
+            bufAppendf(out, ", \"ph\": \"X\", \"dur\": %.3f", ev->durNs / 1000.0);
+        }
+        bufAppendf(out, ", \"args\": {\"program\": ");
+        bufAppendJsonString(out, programName(ev->program));
+        if (ev->enabler >= 0) {
+            bufAppendf(out, ", \"enabledBy\": ");
+            bufAppendJsonString(out, programName(ev->enabler));
+        }
+        bufAppendf(out, "}}");
+
+        // Draw an arrow for the first time each dependency edge fires.
+        if (ev->isNewEdge) {
+            int pred = eventPredecessor(i);
+            if (pred >= 0) {
+                BootTraceEvent* pe = &bootTraceEvents[pred];
+                int64_t fromNs = ev->startNs < pe->startNs + pe->durNs ?
+                    ev->startNs : pe->startNs + pe->durNs;
+                bufAppendf(out, ",\n{\"ph\": \"s\", \"id\": %d, \"pid\": 1, \"tid\": %d, "
+                           "\"ts\": %.3f, \"cat\": \"edge\", \"name\": \"enables\"}",
+                           i, pe->worker, (fromNs - bootTraceStartNs) / 1000.0);
+                bufAppendf(out, ",\n{\"ph\": \"f\", \"bp\": \"e\", \"id\": %d, \"pid\": 1, \"tid\": %d, "
+                           "\"ts\": %.3f, \"cat\": \"edge\", \"name\": \"enables\"}",
+                           i, ev->worker, ts);
+            }
+        }
+    }
+    bufAppendf(out, "\n]}\n");
+}
+
+static void writeFile(const char* path, const char* s) {
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "bootTrace: Couldn't open %s\n", path);
+        return;
+    }
+    fwrite(s, 1, strlen(s), fp);
+    fclose(fp);
+}
+
+// Stops tracing and writes everything out. Returns false if tracing
+// had already finished.
+static bool bootTraceFinish(void) {
+    pthread_mutex_lock(&bootTraceMutex);
+    if (finished) {
+        pthread_mutex_unlock(&bootTraceMutex);
+        return false;
+    }
+    finished = true;
+    bootTracing = false;
+
+    int64_t endNs = timestamp_get(CLOCK_MONOTONIC);
+    buildSummary(endNs);
+
+    char* trace = NULL;
+    buildTrace(&trace);
+    writeFile(bootTracePath, trace);
+    arrfree(trace);
+
+    char summaryPath[1024];
+    snprintf(summaryPath, sizeof(summaryPath), "%s.txt", bootTracePath);
+    writeFile(summaryPath, summary);
+
+    fwrite(summary, 1, strlen(summary), stderr);
+    fprintf(stderr, "\nbootTrace: Wrote %s and %s\n", bootTracePath, summaryPath);
+    pthread_mutex_unlock(&bootTraceMutex);
+    return true;
+}
+
+void bootTraceTick(void) {
+    if (!bootTracing) { return; }
+
+    int64_t now = timestamp_get(CLOCK_MONOTONIC);
+    bool quiet = inflightCount == 0 && now - lastMilestoneNs > bootTraceQuietNs;
+    if (quiet || now - bootTraceStartNs > bootTraceMaxNs) {
+        bootTraceFinish();
+    }
+}
+
+//////////////////////////////////////////////////////////
+// Tcl interface
+//////////////////////////////////////////////////////////
+
+int __bootTraceEnabledFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    Jim_SetResultBool(interp, bootTracing);
+    return JIM_OK;
+}
+
+// __bootTraceHeld program: records that program's code just got held.
+int __bootTraceHeldFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    if (argc != 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "program");
+        return JIM_ERR;
+    }
+    if (!bootTracing) { return JIM_OK; }
+
+    pthread_mutex_lock(&bootTraceMutex);
+    if (!finished) {
+        BootTraceEvent ev = {
+            .kind = BOOT_TRACE_HELD,
+            .program = programIntern(Jim_String(argv[1])),
+            .enabler = currentBlock ? currentBlock->program : -1,
+            .worker = self ? self->index : -1,
+            .startNs = timestamp_get(CLOCK_MONOTONIC),
+            .blockId = currentBlock ? currentBlock->id : -1
+        };
+        if (bootTracePrograms[ev.program].heldNs < 0) {
+            bootTracePrograms[ev.program].heldNs = ev.startNs;
+        }
+        eventAdd(ev);
+    }
+    pthread_mutex_unlock(&bootTraceMutex);
+    milestone();
+    return JIM_OK;
+}
+
+// __bootTraceSpan compile|exec label script: evaluates script and,
+// while tracing, records how long it took against the current block.
+int __bootTraceSpanFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    if (argc != 4) {
+        Jim_WrongNumArgs(interp, 1, argv, "compile|exec label script");
+        return JIM_ERR;
+    }
+    if (!bootTracing || currentBlock == NULL) {
+        return Jim_EvalObj(interp, argv[3]);
+    }
+    const char* kindName = Jim_String(argv[1]);
+    BootTraceEventKind kind;
+    if (strcmp(kindName, "compile") == 0) { kind = BOOT_TRACE_COMPILE; }
+    else if (strcmp(kindName, "exec") == 0) { kind = BOOT_TRACE_EXEC; }
+    else {
+        Jim_SetResultFormatted(interp, "bad span kind \"%s\": must be compile or exec", kindName);
+        return JIM_ERR;
+    }
+
+    BootTraceBlock* block = currentBlock;
+    block->hasSpans = true;
+    inflightCount++;
+    milestone();
+    int64_t startNs = timestamp_get(CLOCK_MONOTONIC);
+    int ret = Jim_EvalObj(interp, argv[3]);
+    int64_t durNs = timestamp_get(CLOCK_MONOTONIC) - startNs;
+    milestone();
+    inflightCount--;
+
+    pthread_mutex_lock(&bootTraceMutex);
+    if (!finished) {
+        BootTraceProgram* p = &bootTracePrograms[block->program];
+        if (kind == BOOT_TRACE_COMPILE) { p->compiles++; p->compileNs += durNs; }
+        else { p->execs++; p->execNs += durNs; }
+
+        BootTraceEvent ev = {
+            .kind = kind, .program = block->program, .line = block->line,
+            .enabler = -1, .worker = self ? self->index : -1,
+            .startNs = startNs, .durNs = durNs,
+            .blockId = block->id, .isMilestone = true,
+            .label = strdup(Jim_String(argv[2]))
+        };
+        eventAdd(ev);
+    }
+    pthread_mutex_unlock(&bootTraceMutex);
+    return ret;
+}
+
+// __bootTraceFinish: declares boot complete now (rather than waiting
+// for things to go quiet), writes the trace, and returns the summary.
+int __bootTraceFinishFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    if (bootTracePath != NULL && bootTracePath[0] != '\0') {
+        bootTraceFinish();
+    }
+    pthread_mutex_lock(&bootTraceMutex);
+    Jim_SetResultString(interp, summary ? summary : "", -1);
+    pthread_mutex_unlock(&bootTraceMutex);
+    return JIM_OK;
+}
@@ -0,0 +1,47 @@
+#ifndef BOOT_TRACE_H
+#define BOOT_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <jim.h>
+
+#include "trie.h"
+
+// Startup tracing, enabled by setting FOLK_BOOT_TRACE to the path of
+// a Chrome trace JSON file to write at boot complete.
+
+// True while tracing is on (until boot complete).
+extern bool _Atomic bootTracing;
+
+// One When block run, from the point of view of the boot tracer. The
+// caller owns it (it lives on the caller's stack) and brackets the
+// block run with bootTraceBlockBegin/bootTraceBlockEnd.
+typedef struct BootTraceBlock {
+    int64_t id;
+    int program;
+    int line;
+    // Program that made the statement that fired this block, or -1.
+    int enabler;
+    int64_t startNs;
+    bool isMilestone;
+    bool isNewEdge;
+    bool hasSpans;
+    struct BootTraceBlock* prev;
+} BootTraceBlock;
+
+void bootTraceInit(void);
+// enablerClause is NULL for blocks with an empty When pattern (the
+// program's own top-level code).
+void bootTraceBlockBegin(BootTraceBlock* b,
+                         const char* sourceFileName, int sourceLineNumber,
+                         const char* enablerFileName, Clause* enablerClause);
+void bootTraceBlockEnd(BootTraceBlock* b);
+// Called from sysmon; writes the trace once boot has gone quiet.
+void bootTraceTick(void);
+
+int __bootTraceEnabledFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv);
+int __bootTraceHeldFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv);
+int __bootTraceSpanFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv);
+int __bootTraceFinishFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv);
+
+#endif
@@ -30,16 +30,25 @@ typedef struct Mutex {
 typedef pthread_mutex_t Mutex;
 #endif
 
+struct mpmc_queue;
 typedef struct ThreadControlBlock {
     int index;
     pid_t _Atomic tid;
     pthread_t pthread;
 
     WorkQueue* workQueue;
+    // Items sent here by other workers because this is their home
+    // worker (see worker affinity in folk.c).
+    struct mpmc_queue* _Atomic affinityInbox;
+    int _Atomic affinityInboxSize;
 
     // Used for -serially and for profiling & diagnostics.
     WorkQueueItem currentItem;
     Mutex currentItemMutex;
+    // What's left of the RUN_WHEN_BATCH or RUN_SUBSCRIBE being run
+    // (if applicable), so it can be handed off if this worker exits
+    // partway through.
+    WorkQueueItem currentBatchRest;
 
     // Used for managing the threadpool.
     clockid_t clockid;
@@ -50,6 +59,16 @@ typedef struct ThreadControlBlock {
     // non-benched threads to utilize the CPUs.
     bool _Atomic isDeactivated;
     sem_t reactivate;
+    // Set by sysmon when this worker is surplus; the worker exits
+    // (freeing its interpreter) the next time it's idle.
+    bool _Atomic shouldRetire;
+    // When this worker last finished a work item (CLOCK_MONOTONIC
+    // ns), so sysmon can tell how long it's been idle.
+    int64_t _Atomic lastItemEndNs;
+    // Set while this worker waits on the compiler pool. A compiler
+    // is using a CPU on its behalf, so sysmon counts it as busy, not
+    // blocked (and doesn't deactivate it afterward).
+    bool _Atomic isWaitingOnCompile;
 
     // Current match being constructed (if applicable).
     Match* currentMatch;
@@ -60,6 +79,10 @@ typedef struct ThreadControlBlock {
     // FOR DEBUGGING:
     int _Atomic _allocs;
     int _Atomic _frees;
+    int _Atomic _allocCount;
+    // Hit/miss counts for the statement clause Jim object cache.
+    int64_t _clauseObjCacheHits;
+    int64_t _clauseObjCacheMisses;
 } ThreadControlBlock;
 
 #define THREADS_MAX 100
@@ -92,10 +115,18 @@ static inline int64_t timestamp_get(clockid_t clk_id) {
         pthread_mutex_unlock(&((m)->mutex));    \
         TracyCLockAfterUnlock((m)->tracyCtx);   \
     } while (0)
+
+// Evaluates to true if it got the lock.
+#define mutexTryLock(m) ({                                          \
+        bool _acquired = pthread_mutex_trylock(&((m)->mutex)) == 0; \
+        TracyCLockAfterTryLock((m)->tracyCtx, _acquired);           \
+        _acquired;                                                  \
+    })
 #else
 #define mutexInit(m) pthread_mutex_init(m, NULL)
 #define mutexLock pthread_mutex_lock
 #define mutexUnlock pthread_mutex_unlock
+#define mutexTryLock(m) (pthread_mutex_trylock(m) == 0)
 #endif
 
 #endif
@@ -0,0 +1,321 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include "vendor/stb_ds.h"
+
+#include <jim.h>
+
+#include "common.h"
+#include "compile-pool.h"
+
+extern char **environ;
+
+// Bounded pool of threads that run compiler subprocesses for
+// lib/c.tcl. A job is a sequence of commands (compile, then link)
+// that run one after another. Jobs are keyed (by the C module's cache
+// key), and a job submitted while an identical one is queued or
+// running just waits for that one's result instead of running again.
+
+typedef struct CompileJob {
+    char* key;
+    // The .so path. Every caller waiting on this job gets its own
+    // copy, and this file is deleted once they all have.
+    char* product;
+
+    // stb_ds array of NULL-terminated argvs.
+    char*** cmds;
+
+    bool done;
+    int status;
+    char* output; // stb_ds array, not NUL-terminated
+    int64_t elapsedNs;
+
+    // Number of threads waiting on this job.
+    int waiters;
+
+    struct CompileJob* next;
+} CompileJob;
+
+static pthread_mutex_t compilePoolMutex = PTHREAD_MUTEX_INITIALIZER;
+// Signaled when a job is queued.
+static pthread_cond_t compilePoolQueued = PTHREAD_COND_INITIALIZER;
+// Broadcast when any job finishes.
+static pthread_cond_t compilePoolDone = PTHREAD_COND_INITIALIZER;
+
+static CompileJob* queueHead;
+static CompileJob* queueTail;
+// Queued and running jobs by key.
+static struct { char* key; CompileJob* value; }* inflightJobs;
+
+static int runnersMax;
+static int runnersCount;
+
+// Stats.
+static int queuedCount;
+static int runningCount;
+static int64_t jobsRun;
+static int64_t jobsShared;
+static int64_t jobsFailed;
+static int maxQueuedCount;
+
+void compilePoolInit(void) {
+    const char* jobs = getenv("FOLK_COMPILE_JOBS");
+    runnersMax = jobs != NULL ? atoi(jobs) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (runnersMax < 1) { runnersMax = 1; }
+}
+
+// Runs argv to completion, appending its stdout and stderr to
+// job->output. Returns its exit status.
+static int compileJobRunCommand(CompileJob* job, char** argv) {
+    // Close-on-exec, so compilers spawned concurrently from other
+    // runners don't inherit this pipe and hold it open.
+    int fds[2];
+#ifdef __APPLE__
+    if (pipe(fds) != 0 ||
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC) != 0 ||
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC) != 0) {
+#else
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+#endif
+        perror("compilePool: pipe");
+        return -1;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addclose(&actions, fds[0]);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
+    posix_spawn_file_actions_addclose(&actions, fds[1]);
+
+    // The runner thread has all signals blocked; don't pass that on.
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t mask; sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    sigset_t defaults; sigfillset(&defaults);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    pid_t pid;
+    int err = posix_spawnp(&pid, argv[0], &actions, &attr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    close(fds[1]);
+    if (err != 0) {
+        close(fds[0]);
+        char msg[1000];
+        int len = snprintf(msg, sizeof(msg), "couldn't exec \"%s\": %s\n",
+                           argv[0], strerror(err));
+        memcpy(arraddnptr(job->output, len), msg, len);
+        return 127;
+    }
+
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) { continue; }
+            break;
+        }
+        memcpy(arraddnptr(job->output, n), buf, n);
+    }
+    close(fds[0]);
+
+    int wstatus;
+    while (waitpid(pid, &wstatus, 0) < 0 && errno == EINTR) {}
+    if (WIFEXITED(wstatus)) { return WEXITSTATUS(wstatus); }
+    return 128 + WTERMSIG(wstatus);
+}
+
+static void* compilePoolRunnerMain(void* arg) {
+    sigset_t all; sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, NULL);
+
+    pthread_mutex_lock(&compilePoolMutex);
+    for (;;) {
+        while (queueHead == NULL) {
+            pthread_cond_wait(&compilePoolQueued, &compilePoolMutex);
+        }
+        CompileJob* job = queueHead;
+        queueHead = job->next;
+        if (queueHead == NULL) { queueTail = NULL; }
+        queuedCount--; runningCount++;
+        pthread_mutex_unlock(&compilePoolMutex);
+
+        int64_t start = timestamp_get(CLOCK_MONOTONIC);
+        int status = 0;
+        for (int i = 0; i < arrlen(job->cmds) && status == 0; i++) {
+            status = compileJobRunCommand(job, job->cmds[i]);
+        }
+        int64_t elapsedNs = timestamp_get(CLOCK_MONOTONIC) - start;
+
+        pthread_mutex_lock(&compilePoolMutex);
+        job->status = status;
+        job->elapsedNs = elapsedNs;
+        job->done = true;
+        shdel(inflightJobs, job->key);
+        runningCount--; jobsRun++;
+        if (status != 0) { jobsFailed++; }
+        pthread_cond_broadcast(&compilePoolDone);
+    }
+    return NULL;
+}
+
+// Copies src to dst (through a temporary file, so nobody sees a
+// partial dst). Returns false on failure.
+static bool compileCopyFile(const char* src, const char* dst) {
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", dst, getpid());
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in < 0) { return false; }
+    int out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0755);
+    if (out < 0) { close(in); return false; }
+
+    bool ok = true;
+    char buf[65536];
+    ssize_t n;
+    while (ok && (n = read(in, buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) { continue; }
+            ok = false; break;
+        }
+        for (ssize_t off = 0; off < n; ) {
+            ssize_t w = write(out, buf + off, n - off);
+            if (w < 0) {
+                if (errno == EINTR) { continue; }
+                ok = false; break;
+            }
+            off += w;
+        }
+    }
+    close(in);
+    if (close(out) != 0) { ok = false; }
+    if (ok && rename(tmp, dst) != 0) { ok = false; }
+    if (!ok) { unlink(tmp); }
+    return ok;
+}
+
+static void compileJobFree(CompileJob* job) {
+    for (int i = 0; i < arrlen(job->cmds); i++) {
+        for (char** arg = job->cmds[i]; *arg != NULL; arg++) { free(*arg); }
+        free(job->cmds[i]);
+    }
+    arrfree(job->cmds);
+    arrfree(job->output);
+    free(job->key);
+    unlink(job->product);
+    free(job->product);
+    free(job);
+}
+
+// __compile key product dest cmd ?cmd ...?: runs each cmd (a list)
+// in order on the compiler pool, stopping at the first failure, and
+// blocks until they're done, then copies product (which the cmds
+// should make) to dest. Returns [list status output elapsedMs
+// isShared], where isShared is true if an identical job (same key)
+// was already queued or running and we got its results (and a copy
+// of its product) instead. product is deleted once every caller
+// waiting on the job has its copy.
+int __compileFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    if (argc < 5) {
+        Jim_WrongNumArgs(interp, 1, argv, "key product dest cmd ?cmd ...?");
+        return JIM_ERR;
+    }
+    const char* key = Jim_String(argv[1]);
+    const char* dest = Jim_String(argv[3]);
+
+    pthread_mutex_lock(&compilePoolMutex);
+    if (inflightJobs == NULL) { sh_new_strdup(inflightJobs); }
+
+    CompileJob* job = shget(inflightJobs, key);
+    bool isShared = job != NULL;
+    if (isShared) {
+        jobsShared++;
+    } else {
+        job = calloc(1, sizeof(CompileJob));
+        job->key = strdup(key);
+        job->product = strdup(Jim_String(argv[2]));
+        for (int i = 4; i < argc; i++) {
+            int cmdc = Jim_ListLength(interp, argv[i]);
+            char** cmd = calloc(cmdc + 1, sizeof(char*));
+            for (int j = 0; j < cmdc; j++) {
+                cmd[j] = strdup(Jim_String(Jim_ListGetIndex(interp, argv[i], j)));
+            }
+            arrput(job->cmds, cmd);
+        }
+
+        shput(inflightJobs, key, job);
+        if (queueTail == NULL) { queueHead = job; } else { queueTail->next = job; }
+        queueTail = job;
+        queuedCount++;
+        if (queuedCount > maxQueuedCount) { maxQueuedCount = queuedCount; }
+
+        if (runnersCount < runnersMax) {
+            pthread_t th;
+            pthread_create(&th, NULL, compilePoolRunnerMain, NULL);
+            pthread_detach(th);
+            runnersCount++;
+        }
+        pthread_cond_signal(&compilePoolQueued);
+    }
+
+    job->waiters++;
+    if (self != NULL) { self->isWaitingOnCompile = true; }
+    while (!job->done) {
+        pthread_cond_wait(&compilePoolDone, &compilePoolMutex);
+    }
+    if (self != NULL) { self->isWaitingOnCompile = false; }
+    pthread_mutex_unlock(&compilePoolMutex);
+
+    // Still counted as a waiter, so the product is still there.
+    int status = job->status;
+    Jim_Obj* outputObj = Jim_NewStringObj(interp, job->output, arrlen(job->output));
+    if (status == 0 && !compileCopyFile(job->product, dest)) {
+        status = -1;
+        Jim_AppendStrings(interp, outputObj, "couldn't copy ", job->product,
+                          " to ", dest, ": ", strerror(errno), NULL);
+    }
+
+    pthread_mutex_lock(&compilePoolMutex);
+    job->waiters--;
+    Jim_Obj* result[] = {
+        Jim_NewIntObj(interp, status),
+        outputObj,
+        Jim_NewIntObj(interp, job->elapsedNs / 1000000),
+        Jim_NewIntObj(interp, isShared)
+    };
+    if (job->waiters == 0) { compileJobFree(job); }
+    pthread_mutex_unlock(&compilePoolMutex);
+
+    Jim_SetResult(interp, Jim_NewListObj(interp, result, 4));
+    return JIM_OK;
+}
+
+int __compilePoolStatsFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    pthread_mutex_lock(&compilePoolMutex);
+    Jim_Obj* objv[] = {
+        Jim_NewStringObj(interp, "runners", -1), Jim_NewIntObj(interp, runnersCount),
+        Jim_NewStringObj(interp, "runnersMax", -1), Jim_NewIntObj(interp, runnersMax),
+        Jim_NewStringObj(interp, "queued", -1), Jim_NewIntObj(interp, queuedCount),
+        Jim_NewStringObj(interp, "maxQueued", -1), Jim_NewIntObj(interp, maxQueuedCount),
+        Jim_NewStringObj(interp, "running", -1), Jim_NewIntObj(interp, runningCount),
+        Jim_NewStringObj(interp, "jobsRun", -1), Jim_NewIntObj(interp, jobsRun),
+        Jim_NewStringObj(interp, "jobsShared", -1), Jim_NewIntObj(interp, jobsShared),
+        Jim_NewStringObj(interp, "jobsFailed", -1), Jim_NewIntObj(interp, jobsFailed),
+    };
+    pthread_mutex_unlock(&compilePoolMutex);
+    Jim_SetResult(interp, Jim_NewListObj(interp, objv, sizeof(objv)/sizeof(objv[0])));
+    return JIM_OK;
+}
@@ -0,0 +1,10 @@
+#ifndef COMPILE_POOL_H
+#define COMPILE_POOL_H
+
+#include <jim.h>
+
+void compilePoolInit(void);
+int __compileFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv);
+int __compilePoolStatsFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv);
+
+#endif
@@ -21,6 +21,8 @@
 #include "epoch.h"
 #include "sysmon.h"
 #include "db.h"
+#include "query-profile.h"
+#include "histogram.h"
 
 #include "vendor/stb_ds.h"
 
@@ -186,6 +188,8 @@ typedef struct Statement {
     // Owned by the DB. clause cannot be mutated or invalidated while
     // rc > 0.
     Clause* _Atomic clause;
+    // clauseHash(clause).
+    uint64_t clauseHash;
 
     // If the statement is removed, we wait keepMs milliseconds before
     // removing its child matches.
@@ -204,6 +208,16 @@ typedef struct Statement {
     // Used for debugging (and stack traces for When bodies).
     char sourceFileName[100];
     int sourceLineNumber;
+    // Interned id of sourceFileName:sourceLineNumber for block
+    // runtime stats, or -1 if not assigned yet (see folk.c).
+    _Atomic int blockStatsId;
+
+    // When the causal root of this statement was inserted, and the
+    // root's block stats id (or -1 if this statement is itself a
+    // root, i.e., it was made by Hold! or Assert! rather than Said by
+    // a When body). Used for end-to-end reaction latency.
+    int64_t causeNs;
+    int causeId;
 
     // Mutable statement properties:
     // -----
@@ -249,6 +263,12 @@ typedef struct Match {
     DestructorSet destructorSet;
     pthread_mutex_t destructorSetMutex;
 
+    // Causal root of the statement that fired this match (see
+    // matchSetCause), inherited by the statements it Says. causeNs
+    // is 0 if unset.
+    int64_t causeNs;
+    int causeId;
+
     // ListOfEdgeTo StatementRef. Used for removal.
     // NULL means the slot is fully destroyed and ready for reuse (matchNew
     // checks this). CHILD_STATEMENTS_REMOVING means matchRemoveSelf has
@@ -269,13 +289,38 @@ typedef struct Hold {
     // used for a new hold key.
     const char* key; // Owned by the DB.
     double version;
+    // clauseHash of the held statement's clause, so a re-Hold of the
+    // same clause can usually be told apart without touching the
+    // statement.
+    uint64_t clauseHash;
 
     StatementRef statement;
 } Hold;
 
+// The hold table is split into shards by key hash, each with its own
+// lock, so Holds on unrelated keys (camera, tags, clock) don't
+// serialize on one lock.
+#define HOLD_SHARDS 64
+typedef struct HoldShard {
+    Hold* holds; // stb_ds string hash map (keyed by Hold.key)
+    Mutex mutex;
+
+    // How many times the shard lock was taken, and how many of those
+    // times some other thread already had it (see dbHoldStats).
+    int64_t _Atomic lockCount;
+    int64_t _Atomic contendedCount;
+} HoldShard;
+
 typedef struct AtomicallyVersion {
     int number;
 
+    // References from the Atomically's version ring, from
+    // statements and matches in this version, and from a worker
+    // thread running a block in this version. The version goes back
+    // to the db's pool when this hits 0 (see
+    // atomicallyVersionRelease).
+    int _Atomic rc;
+
     // Used to find older version to reap.
     struct Atomically* atomically;
 
@@ -297,37 +342,98 @@ typedef struct AtomicallyVersion {
     // Atomically times out), we walk all older versions' rootMatches
     // and NULL them out.
     Match* _Atomic rootMatch;
+
+    // For the Atomically's stats.
+    int64_t createdNs;
+    bool _Atomic hasConverged;
 } AtomicallyVersion;
 
-typedef struct AtomicallyVersionList {
-    AtomicallyVersion* version;
-    struct AtomicallyVersionList* next;
-} AtomicallyVersionList;
+// Atomically.heapIdx while the sysmon has it popped off the heap.
+#define ATOMICALLY_REAPING -2
+// How long an Atomically with no live versions stays registered
+// (keeping its stats) before it's freed.
+#define ATOMICALLY_IDLE_NS 1000000000
+// The key -> Atomically map is split this many ways by key hash, so
+// that Whens on different keys don't contend on one lock.
+#define ATOMICALLY_SHARDS 16
+// Most freed AtomicallyVersions each shard keeps around for reuse.
+#define ATOMICALLY_VERSION_POOL_MAX 64
+
+typedef struct AtomicallyShard {
+    // `atomically` key -> Atomically (stb_ds string hash map, keyed
+    // by Atomically.key).
+    struct { const char* key; struct Atomically* value; }* byKey;
+    // Freed AtomicallyVersions of this shard's keys, for reuse
+    // (stb_ds array).
+    AtomicallyVersion** versionPool;
+    // Guards the map and the pool, and each of the shard's
+    // Atomicallys' liveVersionsCount. (Take it before
+    // atomicallysReapMutex.)
+    Mutex mutex;
+} AtomicallyShard;
 
 typedef struct Atomically {
-    // If key == NULL, then this Atomically is an empty slot that can
-    // be used for a new key.
-    const char* _Atomic key; // Owned by the DB.
-
-    int _Atomic nextNumber;
-
-    // This is used by a newly converged version to reap older
-    // versions.
-    AtomicallyVersionList* _Atomic allVersions;
-
-    AtomicallyVersion* _Atomic latestConvergedVersion;
+    const char* key; // Owned by the DB.
+    AtomicallyShard* shard;
+    // Stable for as long as the key is registered (unlike the
+    // pointer, which can be reused once the Atomically is freed).
+    int id;
+
+    // Versions that haven't been reaped yet, by number: version n
+    // is at versions[n & (versionsCap - 1)] for oldestNumber <= n <
+    // nextNumber, or NULL if it was reaped out of order. This is
+    // used by a newly converged version to reap older versions
+    // without walking newer ones. Guarded by versionsMutex.
+    AtomicallyVersion** versions;
+    int versionsCap; // Power of 2.
+    int versionsCount;
+    int oldestNumber;
+    int nextNumber;
+    pthread_mutex_t versionsMutex;
+
+    // -1 if no version has converged yet. (Versions can be freed, so
+    // we don't keep a pointer to it.)
+    int _Atomic latestConvergedNumber;
 
     // Records the last time that a version of this Atomically
-    // converged. The sysmon will check this every 50ms or so and
-    // reap any Atomicallys that haven't converged in a while.
+    // converged. The sysmon reaps any Atomicallys that haven't
+    // converged in a while (see dbGarbageCollectAtomicallys).
     int64_t latestConvergedTime;
     int64_t timeout;
+
+    // Versions that haven't been freed yet. When this drops to 0,
+    // the Atomically can be unregistered and freed. Guarded by
+    // shard->mutex.
+    int liveVersionsCount;
+    int64_t idleSinceNs;
+
+    // Position in the db's reap heap; -1 if not scheduled, and
+    // ATOMICALLY_REAPING while the sysmon is reaping it. Written
+    // under atomicallysReapMutex. Only the sysmon sets it back to
+    // -1, while also holding shard->mutex, and it reschedules the key
+    // if it still has versions; so whoever sees it scheduled can skip
+    // taking the reap lock.
+    int _Atomic heapIdx;
+    int64_t reapAtNs;
+
+    // Stats (see dbAtomicallyStats).
+    int64_t _Atomic versionsCreated;
+    int64_t _Atomic versionsConverged;
+    int64_t _Atomic versionsReapedUnconverged;
+    int64_t _Atomic timeoutsHit;
+    int _Atomic maxInflightCount;
+    // Time from version creation to first convergence. Versions can
+    // converge on any thread, so this is behind a lock.
+    pthread_mutex_t convergenceLatencyMutex;
+    Histogram convergenceLatency;
 } Atomically;
 
 typedef struct Db {
     // Memory pool used to allocate statements.
     Statement statementPool[65536]; // slot 0 is reserved.
     _Atomic uint16_t statementPoolNextIdx;
+    // Total statements ever created (for benchmarks).
+    _Atomic int64_t statementsCreatedCount;
 
     // Memory pool used to allocate matches.
     Match matchPool[65536]; // slot 0 is reserved.
@@ -335,20 +441,39 @@ typedef struct Db {
 
     // Primary trie (index) used for queries.
     const Trie* _Atomic clauseToStatementRef;
+    // Just the `subscribe` statements, also keyed by their clause,
+    // so that Notify doesn't have to search the primary trie (see
+    // dbQuerySubscriptions). Subscriptions come and go rarely, so
+    // writers take subscribeIndexMutex; readers only need an epoch.
+    const Trie* _Atomic subscribeIndex;
+    Mutex subscribeIndexMutex;
+
+    // Direct-mapped cache from clause hash to (the StatementRef of)
+    // a statement with that clause, so that reinserting a clause
+    // that's already in the db can usually find it without
+    // allocating a statement or copying trie paths. Entries can be
+    // stale; they're checked on use.
+    _Atomic uint64_t clauseHashCache[16384];
+    // Reinserts and re-Holds of an identical clause that were
+    // short-circuited (see dbReinsertsSuppressedCount).
+    _Atomic int64_t reinsertsSuppressedCount;
 
     // One for each Hold key, which always stores the highest-version
     // held statement for that key. We keep this map so that we can
     // overwrite out-of-date Holds for a key as soon as a newer one
     // comes in, without having to actually emit and react to the
     // statement.
-    Hold* holds; // stb_ds string hash map (keyed by Hold.key)
-    Mutex holdsMutex;
-
-    // One for each `atomically` key.
-    Atomically atomicallys[256];
-    // This Mutex guards the list but not the individual Atomically
-    // structs.
-    Mutex atomicallysMutex;
+    HoldShard holdShards[HOLD_SHARDS];
+
+    AtomicallyShard atomicallyShards[ATOMICALLY_SHARDS];
+    int _Atomic nextAtomicallyId;
+    // Min-heap of Atomicallys by reapAtNs (stb_ds array), so the
+    // sysmon only looks at keys that are due.
+    Atomically** atomicallysReapHeap;
+    // Guards the heap (and each Atomically's place in it). Take it
+    // after any shard mutex and before any Atomically's
+    // versionsMutex.
+    Mutex atomicallysReapMutex;
 } Db;
 
 ////////////////////////////////////////////////////////////
@@ -439,10 +564,10 @@ Statement* statementUnsafeGet(Db* db, StatementRef ref) {
     return &db->statementPool[ref.idx];
 }
 
-static void statementDestroy(Statement* stmt);
+static void statementDestroy(Db* db, Statement* stmt);
 void statementRelease(Db* db, Statement* stmt) {
     if (genRcRelease(&stmt->genRc)) {
-        statementDestroy(stmt);
+        statementDestroy(db, stmt);
     }
 }
 
@@ -460,14 +585,49 @@ StatementRef statementRef(Db* db, Statement* stmt) {
     };
 }
 
+static void atomicallyNoteInflightCount(Atomically* atomically, int inflightCount) {
+    int max = atomic_load_explicit(&atomically->maxInflightCount, memory_order_relaxed);
+    while (inflightCount > max &&
+           !atomic_compare_exchange_weak(&atomically->maxInflightCount, &max, inflightCount));
+}
+
+static void atomicallyVersionAcquire(AtomicallyVersion* atomicallyVersion) {
+    atomic_fetch_add_explicit(&atomicallyVersion->rc, 1, memory_order_relaxed);
+}
+static void atomicallyReapHeapPushLocked(Db* db, Atomically* atomically, int64_t reapAtNs);
+static void atomicallyReapHeapSchedule(Db* db, Atomically* atomically, int64_t reapAtNs);
+static void atomicallyVersionRelease(Db* db, AtomicallyVersion* atomicallyVersion) {
+    if (atomic_fetch_sub_explicit(&atomicallyVersion->rc, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+    Atomically* atomically = atomicallyVersion->atomically;
+    AtomicallyShard* shard = atomically->shard;
+
+    mutexLock(&shard->mutex);
+    if (arrlen(shard->versionPool) < ATOMICALLY_VERSION_POOL_MAX) {
+        arrput(shard->versionPool, atomicallyVersion);
+    } else {
+        free(atomicallyVersion);
+    }
+    if (--atomically->liveVersionsCount == 0) {
+        // Let the sysmon unregister the key once it's been idle for
+        // a while.
+        atomically->idleSinceNs = timestamp_get(CLOCK_MONOTONIC);
+        atomicallyReapHeapSchedule(db, atomically,
+                                   atomically->idleSinceNs + ATOMICALLY_IDLE_NS);
+    }
+    mutexUnlock(&shard->mutex);
+}
+
 // Creates a new statement. Internal helper for the DB, not callable
 // from the outside (they need to insert into the DB as a complete
 // operation). Note: clause ownership transfers to the DB, which then
 // becomes responsible for freeing it. 
-static StatementRef statementNew(Db* db, Clause* clause,
+static StatementRef statementNew(Db* db, Clause* clause, uint64_t hash,
                                  long keepMs, AtomicallyVersion* atomicallyVersion,
                                  const char* sourceFileName,
-                                 int sourceLineNumber) {
+                                 int sourceLineNumber,
+                                 Match* parentMatch) {
     StatementRef ret;
     Statement* stmt = NULL;
 
@@ -491,15 +651,19 @@ static StatementRef statementNew(Db* db, Clause* clause,
 
     // We should now have exclusive access to stmt, as its rc
     // is 0 and we were the ones who made it alive.
+    atomic_fetch_add_explicit(&db->statementsCreatedCount, 1, memory_order_relaxed);
 
     atomic_store(&stmt->clause, clause);
+    stmt->clauseHash = hash;
     stmt->keepMs = keepMs;
 
     // inflightCount must start incremented so that this
     // atomicallyVersion never reports convergence (inflightCount = 0)
     // before the first reaction is dispatched.
     if (atomicallyVersion != NULL) {
-        atomicallyVersion->inflightCount++;
+        atomicallyNoteInflightCount(atomicallyVersion->atomically,
+                                    ++atomicallyVersion->inflightCount);
+        atomicallyVersionAcquire(atomicallyVersion);
         stmt->atomicallyVersion = atomicallyVersion;
     } else {
         stmt->atomicallyVersion = NULL;
@@ -520,11 +684,20 @@ static StatementRef statementNew(Db* db, Clause* clause,
     snprintf(stmt->sourceFileName, sizeof(stmt->sourceFileName),
              "%s", sourceFileName);
     stmt->sourceLineNumber = sourceLineNumber;
+    stmt->blockStatsId = -1;
+
+    if (parentMatch != NULL && parentMatch->causeNs != 0) {
+        stmt->causeNs = parentMatch->causeNs;
+        stmt->causeId = parentMatch->causeId;
+    } else {
+        stmt->causeNs = timestamp_get(CLOCK_MONOTONIC);
+        stmt->causeId = -1;
+    }
 
     return ret;
 }
 
-static void statementDestroy(Statement* stmt) {
+static void statementDestroy(Db* db, Statement* stmt) {
     stmt->parentCount = 0;
     // They should have removed the children first.
     assert(stmt->childMatches == NULL);
@@ -533,6 +706,11 @@ static void statementDestroy(Statement* stmt) {
     destructorSetReleaseAll(&stmt->destructorSet);
     pthread_mutex_unlock(&stmt->destructorSetMutex);
 
+    if (stmt->atomicallyVersion != NULL) {
+        atomicallyVersionRelease(db, stmt->atomicallyVersion);
+        stmt->atomicallyVersion = NULL;
+    }
+
     Clause* stmtClause = statementClause(stmt);
     // Marks this statement slot as being fully free and ready for
     // reuse.
@@ -557,6 +735,18 @@ char* statementSourceFileName(Statement* stmt) {
 int statementSourceLineNumber(Statement* stmt) {
     return stmt->sourceLineNumber;
 }
+int statementBlockStatsId(Statement* stmt) {
+    return stmt->blockStatsId;
+}
+void statementSetBlockStatsId(Statement* stmt, int id) {
+    stmt->blockStatsId = id;
+}
+int64_t statementCauseNs(Statement* stmt) {
+    return stmt->causeNs;
+}
+int statementCauseId(Statement* stmt) {
+    return stmt->causeId;
+}
 
 int statementIncompleteChildMatchesCount(Db* db, Statement* stmt) {
     int count = 0;
@@ -659,6 +849,85 @@ void statementDecrParentCountAndMaybeRemoveSelf(Db* db, Statement* stmt) {
     }
 }
 
+static bool clauseIsSubscribe(Clause* clause) {
+    return clause->nTerms > 0 && termEqString(clause->terms[0], "subscribe");
+}
+// Must hold subscribeIndexMutex and be in an epoch.
+static void subscribeIndexRemoveLocked(Db* db, Clause* clause) {
+    uint64_t results[10]; int resultsCount = 0;
+    const Trie* subscribeIndex = trieRemove(db->subscribeIndex, epochAlloc, epochFree,
+                                            clause, results,
+                                            sizeof(results)/sizeof(results[0]),
+                                            &resultsCount);
+    // trieRemove prunes the root too once nothing is left.
+    db->subscribeIndex = subscribeIndex != NULL ? subscribeIndex : trieNew();
+}
+static void subscribeIndexAdd(Db* db, Clause* clause, StatementRef ref) {
+    mutexLock(&db->subscribeIndexMutex);
+    epochBegin();
+    // A statement with this clause might have been removed from the
+    // primary trie but not yet from here; this one replaces it.
+    uint64_t results[10];
+    if (trieLookupLiteral(db->subscribeIndex, clause, results,
+                          sizeof(results)/sizeof(results[0])) > 0) {
+        subscribeIndexRemoveLocked(db, clause);
+    }
+    db->subscribeIndex = trieAdd(db->subscribeIndex, epochAlloc, epochFree,
+                                 clause, ref.val);
+    epochEnd();
+    mutexUnlock(&db->subscribeIndexMutex);
+}
+static void subscribeIndexRemove(Db* db, Clause* clause, StatementRef ref) {
+    mutexLock(&db->subscribeIndexMutex);
+    epochBegin();
+    // Only remove it if it's still this statement (and not a newer
+    // one with the same clause).
+    uint64_t results[10];
+    int resultsCount = trieLookupLiteral(db->subscribeIndex, clause, results,
+                                         sizeof(results)/sizeof(results[0]));
+    if (resultsCount == 1 && results[0] == ref.val) {
+        subscribeIndexRemoveLocked(db, clause);
+    }
+    epochEnd();
+    mutexUnlock(&db->subscribeIndexMutex);
+}
+// Puts the terms on the path to ref in path. Returns the path's
+// length, or -1 if ref isn't in trie.
+static int subscribeIndexFind(const Trie* trie, uint64_t ref,
+                              Term** path, int depth, int maxDepth) {
+    if (trie->hasValue && trie->value == ref) { return depth; }
+    if (depth == maxDepth) { return -1; }
+    for (int i = 0; i < trie->branchesCount; i++) {
+        path[depth] = trie->branches[i]->key;
+        int n = subscribeIndexFind(trie->branches[i], ref, path, depth + 1, maxDepth);
+        if (n >= 0) { return n; }
+    }
+    return -1;
+}
+void dbSubscribeIndexPurge(Db* db, StatementRef ref) {
+    // We don't have the statement's clause anymore, so we walk the
+    // index for it. (This is rare, and the index only has
+    // subscriptions in it.)
+    Term* path[256];
+    epochBegin();
+    int n = subscribeIndexFind(db->subscribeIndex, ref.val, path, 0,
+                               sizeof(path)/sizeof(path[0]));
+    Clause* clause = NULL;
+    if (n >= 0) {
+        // The terms belong to index nodes, which only stay alive
+        // while we're in the epoch.
+        clause = clauseNew(n);
+        for (int i = 0; i < n; i++) {
+            clause->terms[i] = termNew(termPtr(path[i]), termLen(path[i]));
+        }
+    }
+    epochEnd();
+    if (clause == NULL) { return; }
+
+    subscribeIndexRemove(db, clause, ref);
+    clauseFree(clause);
+}
+
 // Call statementRemoveSelf when ALL of the statement's parents
 // (matches or other) are removed (parentCount has hit 0).
 void statementRemoveSelf(Db* db, Statement* stmt, bool doDeindex) {
@@ -688,6 +957,10 @@ void statementRemoveSelf(Db* db, Statement* stmt, bool doDeindex) {
         epochEnd();
     }
 
+    if (clauseIsSubscribe(stmt->clause)) {
+        subscribeIndexRemove(db, stmt->clause, statementRef(db, stmt));
+    }
+
     /* printf("reactToRemovedStatement: s%d:%d (%s)\n", stmt - &db->statementPool[0], stmt->gen, */
     /*        clauseToString(stmt->clause)); */
     pthread_mutex_lock(&stmt->childMatchesMutex);
@@ -726,10 +999,10 @@ Match* matchAcquire(Db* db, MatchRef ref) {
         return NULL;
     }
 }
-static void matchDestroy(Match* match);
+static void matchDestroy(Db* db, Match* match);
 void matchRelease(Db* db, Match* match) {
     if (genRcRelease(&match->genRc)) {
-        matchDestroy(match);
+        matchDestroy(db, match);
     }
 }
 
@@ -783,9 +1056,12 @@ static MatchRef matchNew(Db* db,
     pthread_mutex_init(&match->childStatementsMutex, &mta);
     pthread_mutexattr_destroy(&mta);
 
+    if (atomicallyVersion != NULL) { atomicallyVersionAcquire(atomicallyVersion); }
     match->atomicallyVersion = atomicallyVersion;
     match->workerThreadIndex = workerThreadIndex;
     match->isCompleted = false;
+    match->causeNs = 0;
+    match->causeId = -1;
 
     destructorSetInit(&match->destructorSet);
     pthread_mutex_init(&match->destructorSetMutex, NULL);
@@ -793,7 +1069,7 @@ static MatchRef matchNew(Db* db,
     return ret;
 }
 
-static void matchDestroy(Match* match) {
+static void matchDestroy(Db* db, Match* match) {
     assert(atomic_load_explicit(&match->childStatements, memory_order_relaxed)
            == CHILD_STATEMENTS_REMOVING);
 
@@ -802,6 +1078,11 @@ static void matchDestroy(Match* match) {
     destructorSetReleaseAll(&match->destructorSet);
     pthread_mutex_unlock(&match->destructorSetMutex);
 
+    AtomicallyVersion* atomicallyVersion = atomic_exchange(&match->atomicallyVersion, NULL);
+    if (atomicallyVersion != NULL) {
+        atomicallyVersionRelease(db, atomicallyVersion);
+    }
+
     // Release store: synchronizes with matchNew's acquire load so that
     // all writes above are visible before the slot is reused.
     atomic_store_explicit(&match->childStatements, NULL, memory_order_release);
@@ -810,8 +1091,10 @@ static void matchDestroy(Match* match) {
 AtomicallyVersion* matchAtomicallyVersion(Match* m) {
     return m->atomicallyVersion;
 }
-void matchSetAtomicallyVersion(Match* m, AtomicallyVersion* a) {
-    m->atomicallyVersion = a;
+void matchSetAtomicallyVersion(Db* db, Match* m, AtomicallyVersion* a) {
+    if (a != NULL) { atomicallyVersionAcquire(a); }
+    AtomicallyVersion* old = atomic_exchange(&m->atomicallyVersion, a);
+    if (old != NULL) { atomicallyVersionRelease(db, old); }
 }
 
 static bool statementChecker(void* db, uint64_t ref) {
@@ -832,6 +1115,10 @@ void matchAddDestructor(Match* m, Destructor* d) {
 void matchCompleted(Match* match) {
     match->isCompleted = true;
 }
+void matchSetCause(Match* match, int64_t causeNs, int causeId) {
+    match->causeNs = causeNs;
+    match->causeId = causeId;
+}
 // Call matchRemoveSelf when ANY of the match's parent statements is
 // removed.
 //
@@ -843,9 +1130,8 @@ void matchRemoveSelf(Db* db, Match* match) {
     /* assert(match > &db->matchPool[0] && match < &db->matchPool[65536]); */
     if (match->atomicallyVersion != NULL &&
         match->atomicallyVersion->rootMatch == match &&
-        ((match->atomicallyVersion->atomically->latestConvergedVersion == NULL) ||
-         match->atomicallyVersion->number >=
-         match->atomicallyVersion->atomically->latestConvergedVersion->number)) {
+        match->atomicallyVersion->number >=
+        match->atomicallyVersion->atomically->latestConvergedNumber) {
         // Skip this removal; this is a root match owned by an
         // AtomicallyVersion; leave it to the atomically reaper.
         match->parentWasRemoved = true;
@@ -912,15 +1198,29 @@ Db* dbNew() {
     ret->matchPoolNextIdx = 1;
 
     ret->clauseToStatementRef = trieNew();
+    ret->subscribeIndex = trieNew();
+    mutexInit(&ret->subscribeIndexMutex);
 
-    sh_new_arena(ret->holds);
-    mutexInit(&ret->holdsMutex);
+    for (int i = 0; i < HOLD_SHARDS; i++) {
+        sh_new_arena(ret->holdShards[i].holds);
+        mutexInit(&ret->holdShards[i].mutex);
+    }
 
-    mutexInit(&ret->atomicallysMutex);
+    for (int i = 0; i < ATOMICALLY_SHARDS; i++) {
+        mutexInit(&ret->atomicallyShards[i].mutex);
+    }
+    mutexInit(&ret->atomicallysReapMutex);
 
     return ret;
 }
 
+int64_t dbStatementsCreatedCount(Db* db) {
+    return atomic_load_explicit(&db->statementsCreatedCount, memory_order_relaxed);
+}
+int64_t dbReinsertsSuppressedCount(Db* db) {
+    return atomic_load_explicit(&db->reinsertsSuppressedCount, memory_order_relaxed);
+}
+
 // Used by trie-graph.folk. Avoid if you can.
 void dbLockClauseToStatementRef(Db* db) {
     epochBegin();
@@ -934,6 +1234,10 @@ void dbUnlockClauseToStatementRef(Db* db) {
 
 // Query
 ResultSet* dbQuery(Db* db, Clause* pattern) {
+    bool profile = queryProfileShouldSample();
+    int64_t t0 = profile ? timestamp_get(CLOCK_MONOTONIC) : 0;
+    int nodesVisited = 0;
+
     ResultSet *resultSet;
     size_t maxResults = 500;
     do {
@@ -941,8 +1245,9 @@ ResultSet* dbQuery(Db* db, Clause* pattern) {
 
         epochBegin();
         resultSet->nResults =
-            trieLookup(db->clauseToStatementRef, pattern,
-                       (uint64_t*) resultSet->results, maxResults);
+            trieLookupWithStats(db->clauseToStatementRef, pattern,
+                                (uint64_t*) resultSet->results, maxResults,
+                                &nodesVisited);
         epochEnd();
 
         if (resultSet->nResults < maxResults) {
@@ -958,142 +1263,321 @@ ResultSet* dbQuery(Db* db, Clause* pattern) {
         free(resultSet);
     } while (true);
 
+    if (profile) {
+        queryProfileRecord(pattern, timestamp_get(CLOCK_MONOTONIC) - t0,
+                           nodesVisited, resultSet->nResults);
+    }
     return resultSet;
 }
 
-AtomicallyVersion* dbFreshAtomicallyVersionOnKey(Db* db, const char* key,
-                                                 MatchRef rootMatchRef) {
-    mutexLock(&db->atomicallysMutex);
+ResultSet* dbQuerySubscriptions(Db* db, Clause* pattern) {
+    ResultSet *resultSet;
+    size_t maxResults = 32;
+    do {
+        resultSet = malloc(SIZEOF_RESULTSET(maxResults));
 
-    Atomically* atomically = NULL;
-    for (unsigned long i = 0; i < sizeof(db->atomicallys)/sizeof(db->atomicallys[0]); i++) {
-        if (db->atomicallys[i].key != NULL &&
-            strcmp(db->atomicallys[i].key, key) == 0) {
+        epochBegin();
+        resultSet->nResults =
+            trieLookup(db->subscribeIndex, pattern,
+                       (uint64_t*) resultSet->results, maxResults);
+        epochEnd();
 
-            atomically = &db->atomicallys[i];
+        if (resultSet->nResults < maxResults) {
             break;
         }
+        maxResults *= 2;
+        free(resultSet);
+    } while (true);
+    return resultSet;
+}
+
+static void atomicallyReapHeapSwap(Db* db, int i, int j) {
+    Atomically** heap = db->atomicallysReapHeap;
+    Atomically* t = heap[i];
+    heap[i] = heap[j]; heap[i]->heapIdx = i;
+    heap[j] = t; heap[j]->heapIdx = j;
+}
+static void atomicallyReapHeapSiftUp(Db* db, int i) {
+    Atomically** heap = db->atomicallysReapHeap;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (heap[parent]->reapAtNs <= heap[i]->reapAtNs) { break; }
+        atomicallyReapHeapSwap(db, i, parent);
+        i = parent;
     }
-    if (atomically == NULL) {
-        for (unsigned long i = 0; i < sizeof(db->atomicallys)/sizeof(db->atomicallys[0]); i++) {
-            if (db->atomicallys[i].key == NULL) {
-                atomically = &db->atomicallys[i];
-                atomically->key = strdup(key);
-                atomically->nextNumber = 0;
-                atomically->allVersions = NULL;
-                atomically->timeout = 100000000; // 100ms
-                atomically->latestConvergedTime = 0;
-                break;
-            }
-        }
+}
+static void atomicallyReapHeapSiftDown(Db* db, int i) {
+    Atomically** heap = db->atomicallysReapHeap;
+    int n = arrlen(heap);
+    for (;;) {
+        int left = 2*i + 1, right = 2*i + 2, min = i;
+        if (left < n && heap[left]->reapAtNs < heap[min]->reapAtNs) { min = left; }
+        if (right < n && heap[right]->reapAtNs < heap[min]->reapAtNs) { min = right; }
+        if (min == i) { break; }
+        atomicallyReapHeapSwap(db, i, min);
+        i = min;
+    }
+}
+// Must hold atomicallysReapMutex, and atomically must not be on the
+// heap already.
+static void atomicallyReapHeapPushLocked(Db* db, Atomically* atomically, int64_t reapAtNs) {
+    atomically->reapAtNs = reapAtNs;
+    atomically->heapIdx = arrlen(db->atomicallysReapHeap);
+    arrput(db->atomicallysReapHeap, atomically);
+    atomicallyReapHeapSiftUp(db, atomically->heapIdx);
+}
+// Schedules atomically at reapAtNs, unless it's already scheduled (or
+// being reaped). Only takes the reap lock if it isn't.
+static void atomicallyReapHeapSchedule(Db* db, Atomically* atomically, int64_t reapAtNs) {
+    if (atomically->heapIdx != -1) { return; }
+    mutexLock(&db->atomicallysReapMutex);
+    if (atomically->heapIdx == -1) {
+        atomicallyReapHeapPushLocked(db, atomically, reapAtNs);
+    }
+    mutexUnlock(&db->atomicallysReapMutex);
+}
+// Must hold atomicallysReapMutex. Returns NULL if nothing is due yet.
+static Atomically* atomicallyReapHeapPopDueLocked(Db* db, int64_t now) {
+    if (arrlen(db->atomicallysReapHeap) == 0 ||
+        db->atomicallysReapHeap[0]->reapAtNs > now) {
+        return NULL;
     }
+    Atomically* top = db->atomicallysReapHeap[0];
+    Atomically* last = arrpop(db->atomicallysReapHeap);
+    if (arrlen(db->atomicallysReapHeap) > 0) {
+        db->atomicallysReapHeap[0] = last;
+        last->heapIdx = 0;
+        atomicallyReapHeapSiftDown(db, 0);
+    }
+    top->heapIdx = ATOMICALLY_REAPING;
+    return top;
+}
+
+AtomicallyVersion* dbFreshAtomicallyVersionOnKey(Db* db, const char* key,
+                                                 MatchRef rootMatchRef) {
+    AtomicallyShard* shard =
+        &db->atomicallyShards[fnv1a(FNV1A_INIT, key, strlen(key)) % ATOMICALLY_SHARDS];
+    mutexLock(&shard->mutex);
+
+    Atomically* atomically = shget(shard->byKey, key);
     if (atomically == NULL) {
-        fprintf(stderr, "dbGetOrCreateAtomicallyByKey: Ran out of Atomically slots\n");
-        exit(1);
+        atomically = calloc(1, sizeof(Atomically));
+        atomically->key = strdup(key);
+        atomically->shard = shard;
+        atomically->id = atomic_fetch_add(&db->nextAtomicallyId, 1);
+        atomically->latestConvergedNumber = -1;
+        atomically->timeout = 100000000; // 100ms
+        atomically->heapIdx = -1;
+        pthread_mutex_init(&atomically->versionsMutex, NULL);
+        pthread_mutex_init(&atomically->convergenceLatencyMutex, NULL);
+        shput(shard->byKey, atomically->key, atomically);
     }
-    mutexUnlock(&db->atomicallysMutex);
+    atomically->liveVersionsCount++;
 
-    AtomicallyVersion* atomicallyVersion = malloc(sizeof(AtomicallyVersion));
+    AtomicallyVersion* atomicallyVersion = arrlen(shard->versionPool) > 0 ?
+        arrpop(shard->versionPool) :
+        malloc(sizeof(AtomicallyVersion));
     atomicallyVersion->atomically = atomically;
+    // One reference for the version ring, one for the caller.
+    atomicallyVersion->rc = 2;
 
-    // FIXME: assert old values are bad, do something with refcount
-
-    atomicallyVersion->number = atomically->nextNumber++;
     // An AtomicallyVersion should start unconverged, assuming that it
     // always gets set into a currently running (incomplete) match
     // that can mark it as converged when done.
     atomicallyVersion->inflightCount = 1;
+    atomicallyNoteInflightCount(atomically, 1);
     atomicallyVersion->rootMatch = matchAcquire(db, rootMatchRef);
     assert(atomicallyVersion->rootMatch != NULL);
+    atomicallyVersion->createdNs = timestamp_get(CLOCK_MONOTONIC);
+    atomicallyVersion->hasConverged = false;
+    atomic_fetch_add_explicit(&atomically->versionsCreated, 1, memory_order_relaxed);
+
+    pthread_mutex_lock(&atomically->versionsMutex);
+    if (atomically->nextNumber - atomically->oldestNumber == atomically->versionsCap) {
+        // Ring is full; double it.
+        int cap = atomically->versionsCap == 0 ? 8 : atomically->versionsCap * 2;
+        AtomicallyVersion** versions = calloc(cap, sizeof(AtomicallyVersion*));
+        for (int n = atomically->oldestNumber; n < atomically->nextNumber; n++) {
+            versions[n & (cap - 1)] =
+                atomically->versions[n & (atomically->versionsCap - 1)];
+        }
+        free(atomically->versions);
+        atomically->versions = versions;
+        atomically->versionsCap = cap;
+    }
+    atomicallyVersion->number = atomically->nextNumber++;
+    atomically->versions[atomicallyVersion->number & (atomically->versionsCap - 1)] =
+        atomicallyVersion;
+    atomically->versionsCount++;
+    pthread_mutex_unlock(&atomically->versionsMutex);
 
-    // Add this version to atomically->allVersions list
-    AtomicallyVersionList* newNode = malloc(sizeof(AtomicallyVersionList));
-    newNode->version = atomicallyVersion;
-
-    AtomicallyVersionList* oldList;
-    do {
-        oldList = atomically->allVersions;
-        newNode->next = oldList;
-    } while (!atomic_compare_exchange_weak(&atomically->allVersions,
-                                           &oldList,
-                                           newNode));
+    // Check back on this key when the new version would time out.
+    atomicallyReapHeapSchedule(db, atomically,
+                               atomicallyVersion->createdNs + atomically->timeout);
+    mutexUnlock(&shard->mutex);
 
     return atomicallyVersion;
 }
-static void dbAtomicallyReapAllVersions(Db* db, Atomically* atomically,
-                                        AtomicallyVersion* newlyConvergedVersion,
-                                        bool onlyReapConvergedVersions) {
-    // Swap out the entire list atomically, then process it after the
-    // CAS loop.
-    AtomicallyVersionList* allVersions;
-    do {
-        allVersions = atomically->allVersions;
-    } while (!atomic_compare_exchange_weak(&atomically->allVersions,
-                                           &allVersions,
-                                           NULL));
-
-    // Now we have exclusive ownership of allVersions. Process it to
-    // separate old versions.
-    AtomicallyVersionList* newList = NULL;
-    AtomicallyVersionList* x = allVersions;
-    while (x != NULL) {
-        AtomicallyVersionList* next = x->next;
-        if (x->version != NULL &&
-            (newlyConvergedVersion == NULL ||
-             x->version->number < newlyConvergedVersion->number) &&
-            (!onlyReapConvergedVersions || x->version->inflightCount == 0)) {
-            // Old version - clear and free it
-            Match* rootMatch = x->version->rootMatch;
-            x->version->rootMatch = NULL;
-            if (rootMatch != NULL) {
-                if (rootMatch->parentWasRemoved) {
-                    matchRemoveSelf(db, rootMatch);
-                }
-                matchRelease(db, rootMatch);
+void dbAtomicallyVersionAcquire(AtomicallyVersion* atomicallyVersion) {
+    atomicallyVersionAcquire(atomicallyVersion);
+}
+void dbAtomicallyVersionRelease(Db* db, AtomicallyVersion* atomicallyVersion) {
+    atomicallyVersionRelease(db, atomicallyVersion);
+}
+// Reaps versions older than newlyConvergedVersion (or all versions,
+// if it's NULL), optionally only the ones that have converged.
+// Returns the number of versions reaped.
+//
+// Walks only the versions it reaps, plus any it has to skip because
+// they haven't converged.
+static int dbAtomicallyReapAllVersions(Db* db, Atomically* atomically,
+                                       AtomicallyVersion* newlyConvergedVersion,
+                                       bool onlyReapConvergedVersions) {
+    // Take the versions out of the ring under the lock, then
+    // invalidate and release them after, since that can end up
+    // removing statements.
+    AtomicallyVersion* reapedBuf[16];
+    AtomicallyVersion** reaped = reapedBuf;
+    int reapedCount = 0, reapedCap = sizeof(reapedBuf)/sizeof(reapedBuf[0]);
+
+    pthread_mutex_lock(&atomically->versionsMutex);
+    int mask = atomically->versionsCap - 1;
+    int end = newlyConvergedVersion == NULL ?
+        atomically->nextNumber : newlyConvergedVersion->number;
+    for (int n = atomically->oldestNumber; n < end; n++) {
+        AtomicallyVersion* version = atomically->versions[n & mask];
+        if (version == NULL ||
+            (onlyReapConvergedVersions && version->inflightCount != 0)) {
+            continue;
+        }
+        atomically->versions[n & mask] = NULL;
+        atomically->versionsCount--;
+
+        if (reapedCount == reapedCap) {
+            reapedCap *= 2;
+            if (reaped == reapedBuf) {
+                reaped = malloc(reapedCap * sizeof(AtomicallyVersion*));
+                memcpy(reaped, reapedBuf, sizeof(reapedBuf));
+            } else {
+                reaped = realloc(reaped, reapedCap * sizeof(AtomicallyVersion*));
             }
-            free(x);
-        } else {
-            // Keep this version - add to new list
-            x->next = newList;
-            newList = x;
         }
-        x = next;
+        reaped[reapedCount++] = version;
+    }
+    while (atomically->oldestNumber < atomically->nextNumber &&
+           atomically->versions[atomically->oldestNumber & mask] == NULL) {
+        atomically->oldestNumber++;
     }
+    pthread_mutex_unlock(&atomically->versionsMutex);
 
-    // Write back the filtered list. We need to handle
-    // concurrently-added versions. Find the tail of newList once,
-    // then use CAS loop to atomically append.
-    if (newList != NULL) {
-        // Find the end of newList (which was built in reverse order)
-        AtomicallyVersionList* tail = newList;
-        while (tail->next != NULL) {
-            tail = tail->next;
+    for (int i = 0; i < reapedCount; i++) {
+        AtomicallyVersion* version = reaped[i];
+        if (!version->hasConverged) {
+            atomic_fetch_add_explicit(&atomically->versionsReapedUnconverged, 1,
+                                      memory_order_relaxed);
         }
-
-        // CAS loop to atomically set tail->next and update allVersions
-        AtomicallyVersionList* expected;
-        do {
-            expected = atomically->allVersions;
-            tail->next = expected;  // Point tail to current head
-        } while (!atomic_compare_exchange_weak(&atomically->allVersions,
-                                               &expected,
-                                               newList));
+        Match* rootMatch = version->rootMatch;
+        version->rootMatch = NULL;
+        if (rootMatch != NULL) {
+            if (rootMatch->parentWasRemoved) {
+                matchRemoveSelf(db, rootMatch);
+            }
+            matchRelease(db, rootMatch);
+        }
+        atomicallyVersionRelease(db, version);
     }
-    // Note: If newList is NULL (all versions were reaped), we
-    // don't write anything back.  Concurrently-added versions
-    // remain in allVersions and will be handled on next
-    // convergence.
+    if (reaped != reapedBuf) { free(reaped); }
+    return reapedCount;
 }
+// Only looks at the Atomicallys whose deadline has passed: each key
+// is (re)scheduled when a version is created or converges, when its
+// last version is freed, and after each visit here if it still has
+// versions to time out.
 void dbGarbageCollectAtomicallys(Db* db, int64_t now) {
-    mutexLock(&db->atomicallysMutex);
-    for (int i = 0; i < sizeof(db->atomicallys)/sizeof(db->atomicallys[0]); i++) {
-        if (db->atomicallys[i].key != NULL &&
-            now - db->atomicallys[i].latestConvergedTime > db->atomicallys[i].timeout) {
-
-            dbAtomicallyReapAllVersions(db, &db->atomicallys[i], NULL, true);
+    mutexLock(&db->atomicallysReapMutex);
+    Atomically* atomically;
+    while ((atomically = atomicallyReapHeapPopDueLocked(db, now)) != NULL) {
+        // Reap outside the lock, since releasing versions can take
+        // it. Nobody else reschedules or frees the Atomically while
+        // it's marked ATOMICALLY_REAPING.
+        mutexUnlock(&db->atomicallysReapMutex);
+        if (now - atomically->latestConvergedTime > atomically->timeout) {
+            if (dbAtomicallyReapAllVersions(db, atomically, NULL, true) > 0) {
+                atomic_fetch_add_explicit(&atomically->timeoutsHit, 1,
+                                          memory_order_relaxed);
+            }
+        }
+        AtomicallyShard* shard = atomically->shard;
+        mutexLock(&shard->mutex);
+        mutexLock(&db->atomicallysReapMutex);
+
+        atomically->heapIdx = -1;
+        pthread_mutex_lock(&atomically->versionsMutex);
+        int versionsCount = atomically->versionsCount;
+        pthread_mutex_unlock(&atomically->versionsMutex);
+        if (versionsCount > 0) {
+            int64_t reapAtNs = atomically->latestConvergedTime + atomically->timeout;
+            if (reapAtNs <= now) { reapAtNs = now + atomically->timeout; }
+            atomicallyReapHeapPushLocked(db, atomically, reapAtNs);
+
+        } else if (atomically->liveVersionsCount == 0) {
+            if (now - atomically->idleSinceNs < ATOMICALLY_IDLE_NS) {
+                atomicallyReapHeapPushLocked(db, atomically,
+                                             atomically->idleSinceNs + ATOMICALLY_IDLE_NS);
+            } else {
+                shdel(shard->byKey, atomically->key);
+                free(atomically->versions);
+                pthread_mutex_destroy(&atomically->versionsMutex);
+                pthread_mutex_destroy(&atomically->convergenceLatencyMutex);
+                free((char*) atomically->key);
+                free(atomically);
+            }
         }
+        // Otherwise, nothing is left to time out, but statements
+        // still hold versions; freeing the last one (or making a new
+        // one) will reschedule the key.
+        mutexUnlock(&shard->mutex);
     }
-    mutexUnlock(&db->atomicallysMutex);
+    mutexUnlock(&db->atomicallysReapMutex);
+}
+
+AtomicallyStats* dbAtomicallyStats(Db* db, int* outCount) {
+    for (int s = 0; s < ATOMICALLY_SHARDS; s++) {
+        mutexLock(&db->atomicallyShards[s].mutex);
+    }
+    int n = 0;
+    for (int s = 0; s < ATOMICALLY_SHARDS; s++) {
+        n += shlen(db->atomicallyShards[s].byKey);
+    }
+    AtomicallyStats* out = calloc(n > 0 ? n : 1, sizeof(AtomicallyStats));
+    for (int s = 0, i = 0; s < ATOMICALLY_SHARDS; s++)
+    for (int j = 0; j < shlen(db->atomicallyShards[s].byKey); j++, i++) {
+        Atomically* atomically = db->atomicallyShards[s].byKey[j].value;
+
+        AtomicallyStats* st = &out[i];
+        *st = (AtomicallyStats) {
+            .id = atomically->id,
+            .key = strdup(atomically->key),
+            .timeoutNs = atomically->timeout,
+            .versionsCreated = atomically->versionsCreated,
+            .versionsConverged = atomically->versionsConverged,
+            .versionsReapedUnconverged = atomically->versionsReapedUnconverged,
+            .timeoutsHit = atomically->timeoutsHit,
+            .maxInflightCount = atomically->maxInflightCount,
+        };
+        Histogram h = {0};
+        pthread_mutex_lock(&atomically->convergenceLatencyMutex);
+        histogramMerge(&h, &atomically->convergenceLatency);
+        pthread_mutex_unlock(&atomically->convergenceLatencyMutex);
+        st->convergenceP50Ns = histogramPercentile(&h, 0.5);
+        st->convergenceP99Ns = histogramPercentile(&h, 0.99);
+        st->convergenceMaxNs = h.maxNs;
+    }
+    for (int s = 0; s < ATOMICALLY_SHARDS; s++) {
+        mutexUnlock(&db->atomicallyShards[s].mutex);
+    }
+    *outCount = n;
+    return out;
 }
 
 bool dbAtomicallyVersionHasConverged(AtomicallyVersion* atomicallyVersion) {
@@ -1111,7 +1595,8 @@ const char* dbAtomicallyVersionKey(AtomicallyVersion* atomicallyVersion) {
 }
 void dbInflightIncr(Statement* stmt) {
     if (stmt != NULL && stmt->atomicallyVersion != NULL) {
-        stmt->atomicallyVersion->inflightCount++;
+        atomicallyNoteInflightCount(stmt->atomicallyVersion->atomically,
+                                    ++stmt->atomicallyVersion->inflightCount);
         /* printf("dbInflightIncr (%s) %p -> %d\n", clauseToString(stmt->clause), */
         /*        stmt->atomicallyVersion, */
         /*        stmt->atomicallyVersion->inflightCount); */
@@ -1126,7 +1611,8 @@ void dbInflightDecr(Db* db, Statement* stmt) {
     }
 }
 void dbAtomicallyVersionInflightIncr(AtomicallyVersion* atomicallyVersion) {
-    atomicallyVersion->inflightCount++;
+    atomicallyNoteInflightCount(atomicallyVersion->atomically,
+                                ++atomicallyVersion->inflightCount);
     /* printf("dbAtomicallyVersionInflightIncr %p -> %d\n", */
     /*        atomicallyVersion, */
     /*        atomicallyVersion->inflightCount); */
@@ -1134,9 +1620,22 @@ void dbAtomicallyVersionInflightIncr(AtomicallyVersion* atomicallyVersion) {
 void dbAtomicallyVersionInflightDecr(Db* db, AtomicallyVersion* atomicallyVersion) {
     if (--atomicallyVersion->inflightCount == 0) {
         Atomically* atomically = atomicallyVersion->atomically;
-        atomically->latestConvergedVersion = atomicallyVersion;
+        atomically->latestConvergedNumber = atomicallyVersion->number;
         atomically->latestConvergedTime = timestamp_get(CLOCK_MONOTONIC);
+        if (!atomic_exchange(&atomicallyVersion->hasConverged, true)) {
+            atomic_fetch_add_explicit(&atomically->versionsConverged, 1, memory_order_relaxed);
+            pthread_mutex_lock(&atomically->convergenceLatencyMutex);
+            histogramRecord(&atomically->convergenceLatency,
+                            atomically->latestConvergedTime - atomicallyVersion->createdNs);
+            pthread_mutex_unlock(&atomically->convergenceLatencyMutex);
+        }
         dbAtomicallyReapAllVersions(db, atomically, atomicallyVersion, false);
+
+        // This version now needs reaping if nothing newer converges
+        // in time. (Usually the key is still scheduled from when the
+        // version was made, and this doesn't lock.)
+        atomicallyReapHeapSchedule(db, atomically,
+                                   atomically->latestConvergedTime + atomically->timeout);
     }
     /* printf("dbAtomicallyVersionInflightDecr %p -> %d\n", */
     /*        atomicallyVersion, */
@@ -1171,6 +1670,66 @@ static bool tryReuseStatement(Db* db, Statement* stmt, Match* parentMatch) {
     }
 }
 
+// Having reused `stmt` (acquired) for a new insert with
+// parentMatch: inherit the parent's destructors and let go of
+// everything.
+static void reuseStatementFinish(Db* db, Statement* stmt, Match* parentMatch) {
+    // TODO: Add the new destructor passed in?
+    if (parentMatch != NULL) {
+        pthread_mutex_lock(&parentMatch->destructorSetMutex);
+        pthread_mutex_lock(&stmt->destructorSetMutex);
+        destructorSetInherit(&stmt->destructorSet,
+                             &parentMatch->destructorSet);
+        pthread_mutex_unlock(&stmt->destructorSetMutex);
+        pthread_mutex_unlock(&parentMatch->destructorSetMutex);
+    }
+
+    statementRelease(db, stmt);
+
+    if (parentMatch != NULL) {
+        pthread_mutex_unlock(&parentMatch->childStatementsMutex);
+
+        matchRelease(db, parentMatch);
+    }
+}
+
+// Returns the statement (acquired) in the clause hash cache for
+// `clause`, if it's there, still alive, and still indexed in the
+// trie; else NULL.
+static Statement* clauseHashCacheLookup(Db* db, Clause* clause, uint64_t hash) {
+    size_t slotsCount = sizeof(db->clauseHashCache)/sizeof(db->clauseHashCache[0]);
+    StatementRef ref = {
+        .val = atomic_load_explicit(&db->clauseHashCache[hash % slotsCount],
+                                    memory_order_relaxed)
+    };
+    if (statementRefIsNull(ref)) { return NULL; }
+
+    Statement* stmt = statementAcquire(db, ref);
+    if (stmt == NULL) { return NULL; }
+    if (stmt->clauseHash != hash || !clauseIsEqual(clause, statementClause(stmt))) {
+        statementRelease(db, stmt);
+        return NULL;
+    }
+
+    // A Hold deindexes the statement it replaces before that
+    // statement dies, so check that it's still what the trie has.
+    epochBegin();
+    uint64_t results[2];
+    int resultsCount = trieLookupLiteral(db->clauseToStatementRef, clause,
+                                         results, 2);
+    epochEnd();
+    if (resultsCount != 1 || results[0] != ref.val) {
+        statementRelease(db, stmt);
+        return NULL;
+    }
+    return stmt;
+}
+static void clauseHashCachePut(Db* db, uint64_t hash, StatementRef ref) {
+    size_t slotsCount = sizeof(db->clauseHashCache)/sizeof(db->clauseHashCache[0]);
+    atomic_store_explicit(&db->clauseHashCache[hash % slotsCount], ref.val,
+                          memory_order_relaxed);
+}
+
 // Inserts a new statement with clause `clause` & returns a ref to
 // that newly created statement & sets outReusedStatementRef to a null
 // ref, UNLESS:
@@ -1232,12 +1791,31 @@ Statement* dbInsertOrReuseStatement(Db* db, Clause* clause,
         // to its childStatements list.
     }
 
+    // Fast path: if this clause is already in the db (an Assert or
+    // Say that's the same every frame), reuse the statement without
+    // making a provisional one.
+    uint64_t hash = clauseHash(clause);
+    Statement* cached = clauseHashCacheLookup(db, clause, hash);
+    if (cached != NULL) {
+        if (tryReuseStatement(db, cached, parentMatch)) {
+            StatementRef cachedRef = statementRef(db, cached);
+            reuseStatementFinish(db, cached, parentMatch);
+            clauseFree(clause);
+            atomic_fetch_add_explicit(&db->reinsertsSuppressedCount, 1,
+                                      memory_order_relaxed);
+            setReusedStatementRef(cachedRef);
+            return NULL;
+        }
+        statementRelease(db, cached);
+    }
+
     // We'll provisionally create a new statement to add.
     // 
     // Also transfers ownership of `clause` to the DB.
-    StatementRef ref = statementNew(db, clause,
+    StatementRef ref = statementNew(db, clause, hash,
                                     keepMs, atomicallyVersion,
-                                    sourceFileName, sourceLineNumber);
+                                    sourceFileName, sourceLineNumber,
+                                    parentMatch);
 
     // Now try to add to the trie: the trieAdd operation will
     // atomically detect if the clause is already present.
@@ -1269,18 +1847,6 @@ Statement* dbInsertOrReuseStatement(Db* db, Clause* clause,
                 // TODO: Warn if keepMs differs between existing and
                 // newly-proposed statement?
                 if (tryReuseStatement(db, stmt, parentMatch)) {
-                    // TODO: Add the new destructor passed in?
-                    if (parentMatch != NULL) {
-                        pthread_mutex_lock(&parentMatch->destructorSetMutex);
-                        pthread_mutex_lock(&stmt->destructorSetMutex);
-                        destructorSetInherit(&stmt->destructorSet,
-                                             &parentMatch->destructorSet);
-                        pthread_mutex_unlock(&stmt->destructorSetMutex);
-                        pthread_mutex_unlock(&parentMatch->destructorSetMutex);
-                    }
-
-                    statementRelease(db, stmt);
-
                     epochReset();
                     epochEnd();
 
@@ -1291,11 +1857,8 @@ Statement* dbInsertOrReuseStatement(Db* db, Clause* clause,
                     statementRemoveSelf(db, newStmt, false);
                     statementRelease(db, newStmt);
 
-                    if (parentMatch != NULL) { 
-                        pthread_mutex_unlock(&parentMatch->childStatementsMutex);
-
-                        matchRelease(db, parentMatch);
-                    }
+                    clauseHashCachePut(db, hash, existingRefs[0]);
+                    reuseStatementFinish(db, stmt, parentMatch);
 
                     setReusedStatementRef(existingRefs[0]);
                     return NULL;
@@ -1329,6 +1892,10 @@ Statement* dbInsertOrReuseStatement(Db* db, Clause* clause,
 
     Statement* newStmt = statementAcquire(db, ref);
     assert(newStmt != NULL);
+    clauseHashCachePut(db, hash, ref);
+    if (clauseIsSubscribe(clause)) {
+        subscribeIndexAdd(db, clause, ref);
+    }
 
     // OK, we've made a new statement. trieAdd added the statement to
     // the db and we committed the new db.
@@ -1436,6 +2003,30 @@ void dbRetractStatements(Db* db, Clause* pattern) {
     }
 }
 
+static HoldShard* holdShardLock(Db* db, const char* key) {
+    uint64_t hash = fnv1a(FNV1A_INIT, key, strlen(key));
+    HoldShard* shard = &db->holdShards[hash % HOLD_SHARDS];
+
+    atomic_fetch_add_explicit(&shard->lockCount, 1, memory_order_relaxed);
+    if (!mutexTryLock(&shard->mutex)) {
+        atomic_fetch_add_explicit(&shard->contendedCount, 1, memory_order_relaxed);
+        mutexLock(&shard->mutex);
+    }
+    return shard;
+}
+
+void dbHoldStats(Db* db, HoldStats* out) {
+    *out = (HoldStats) { .shardsCount = HOLD_SHARDS };
+    for (int i = 0; i < HOLD_SHARDS; i++) {
+        HoldShard* shard = &db->holdShards[i];
+        mutexLock(&shard->mutex);
+        out->holdsCount += shlen(shard->holds);
+        mutexUnlock(&shard->mutex);
+        out->lockCount += atomic_load_explicit(&shard->lockCount, memory_order_relaxed);
+        out->contendedCount += atomic_load_explicit(&shard->contendedCount, memory_order_relaxed);
+    }
+}
+
 // Takes ownership of `clause` and `destructorSet`.
 Statement* dbHoldStatement(Db* db,
                            const char* key, double version,
@@ -1444,13 +2035,14 @@ Statement* dbHoldStatement(Db* db,
                            StatementRef* outOldStatement) {
     if (outOldStatement) { *outOldStatement = STATEMENT_REF_NULL; }
 
-    mutexLock(&db->holdsMutex);
+    uint64_t hash = clauseHash(clause);
+    HoldShard* shard = holdShardLock(db, key);
 
-    Hold* hold = shgetp_null(db->holds, key);
+    Hold* hold = shgetp_null(shard->holds, key);
     if (hold == NULL) {
         Hold newHold = { .key = (char*)key, .version = -1, .statement = STATEMENT_REF_NULL };
-        shputs(db->holds, newHold);
-        hold = shgetp_null(db->holds, key);
+        shputs(shard->holds, newHold);
+        hold = shgetp_null(shard->holds, key);
     }
 
     if (version < 0) {
@@ -1461,16 +2053,23 @@ Statement* dbHoldStatement(Db* db,
         // TODO: Should we accept a StatementRef and enforce that
         // is what gets removed?
         Statement* oldStmtPtr = statementAcquire(db, oldStmt);
-        if (oldStmtPtr && clauseIsEqual(clause, statementClause(oldStmtPtr))) {
+        // Re-Holding the same clause is a no-op. Comparing hashes
+        // first means a changed clause almost never gets compared
+        // term by term.
+        if (oldStmtPtr && hold->clauseHash == hash &&
+            clauseIsEqual(clause, statementClause(oldStmtPtr))) {
             statementRelease(db, oldStmtPtr);
-            mutexUnlock(&db->holdsMutex);
+            mutexUnlock(&shard->mutex);
             clauseFree(clause);
+            atomic_fetch_add_explicit(&db->reinsertsSuppressedCount, 1,
+                                      memory_order_relaxed);
             return NULL;
         }
 
         Statement* newStmt = NULL;
         if (clause->nTerms > 0) {
             hold->version = version;
+            hold->clauseHash = hash;
 
             StatementRef reusedStatementRef;
             newStmt = dbInsertOrReuseStatement(db, clause, keepMs, NULL,
@@ -1487,7 +2086,7 @@ Statement* dbHoldStatement(Db* db,
             }
         } else {
             clauseFree(clause);
-            shdel(db->holds, key);
+            shdel(shard->holds, key);
             hold = NULL;
         }
 
@@ -1531,13 +2130,13 @@ Statement* dbHoldStatement(Db* db,
 
         if (outOldStatement) { *outOldStatement = oldStmt; }
 
-        mutexUnlock(&db->holdsMutex);
+        mutexUnlock(&shard->mutex);
         return newStmt;
     } else {
         // The new version is older than the version already in the
         // hold, so we just shouldn't do anything / we shouldn't
         // install the new statement.
-        mutexUnlock(&db->holdsMutex);
+        mutexUnlock(&shard->mutex);
         clauseFree(clause);
         return NULL;
     }
@@ -56,6 +56,10 @@ Clause* statementClause(Statement* stmt);
 AtomicallyVersion* statementAtomicallyVersion(Statement* stmt);
 char* statementSourceFileName(Statement* stmt);
 int statementSourceLineNumber(Statement* stmt);
+int statementBlockStatsId(Statement* stmt);
+void statementSetBlockStatsId(Statement* stmt, int id);
+int64_t statementCauseNs(Statement* stmt);
+int statementCauseId(Statement* stmt);
 
 int statementIncompleteChildMatchesCount(Db* db, Statement* stmt);
 
@@ -79,11 +83,14 @@ void matchRelease(Db* db, Match* m);
 bool matchCheck(Db* db, MatchRef ref);
 
 AtomicallyVersion* matchAtomicallyVersion(Match* m);
-void matchSetAtomicallyVersion(Match* m, AtomicallyVersion* a);
+void matchSetAtomicallyVersion(Db* db, Match* m, AtomicallyVersion* a);
 
 void matchAddDestructor(Match* m, Destructor* d);
 
 void matchCompleted(Match* m);
+// Sets the causal root that statements Said under this match will
+// inherit.
+void matchSetCause(Match* m, int64_t causeNs, int causeId);
 void matchRemoveSelf(Db* db, Match* m);
 
 MatchRef matchRef(Db* db, Match* m);
@@ -94,7 +101,16 @@ MatchRef matchRef(Db* db, Match* m);
 typedef struct Clause Clause;
 
 Db* dbNew();
+// How many statements have ever been created in the db.
+int64_t dbStatementsCreatedCount(Db* db);
+// Total inserts and Holds that turned out to be of a clause already
+// in the db, and were short-circuited by clause hash.
+int64_t dbReinsertsSuppressedCount(Db* db);
+// Only read the trie from dbGetClauseToStatementRef between
+// dbLockClauseToStatementRef and dbUnlockClauseToStatementRef.
+void dbLockClauseToStatementRef(Db* db);
 const Trie* dbGetClauseToStatementRef(Db* db);
+void dbUnlockClauseToStatementRef(Db* db);
 
 typedef struct ResultSet {
     size_t nResults;
@@ -107,22 +123,59 @@ typedef struct ResultSet {
 //
 // Caller must free the returned ResultSet*.
 ResultSet* dbQuery(Db* db, Clause* pattern);
+// Like dbQuery, but only searches `subscribe` statements, which are
+// kept in their own index.
+ResultSet* dbQuerySubscriptions(Db* db, Clause* pattern);
+// Drops ref from the subscribe index if it's still there. For when
+// dbQuerySubscriptions returns a ref that can't be acquired: a
+// subscribe statement removed while it was being added can be left
+// behind in the index.
+void dbSubscribeIndexPurge(Db* db, StatementRef ref);
 
 // Creates and returns a new version (convergence-tracking subgraph)
 // on `key`.
 //
 // Copies `key` if needed (so the caller may safely free it
 // afterward). The returned pointer can be passed to Match and
-// Statement insertion to attach them to that version. The
-// AtomicallyVersion is guaranteed not to ever be freed.
+// Statement insertion to attach them to that version, which then
+// keep it alive. It comes with one reference for the caller, who
+// must drop it with dbAtomicallyVersionRelease when done.
 AtomicallyVersion* dbFreshAtomicallyVersionOnKey(Db* db, const char* key,
                                                  MatchRef rootMatchRef);
+void dbAtomicallyVersionAcquire(AtomicallyVersion* atomicallyVersion);
+void dbAtomicallyVersionRelease(Db* db, AtomicallyVersion* atomicallyVersion);
 
 bool dbAtomicallyVersionHasConverged(AtomicallyVersion* atomicallyVersion);
 int dbAtomicallyVersionInflightCount(AtomicallyVersion* atomicallyVersion);
 int dbAtomicallyVersionNumber(AtomicallyVersion* atomicallyVersion);
 const char* dbAtomicallyVersionKey(AtomicallyVersion* atomicallyVersion);
 
+// Lifetime stats for one Atomically key, for tuning keys and
+// timeouts.
+typedef struct AtomicallyStats {
+    // Stable for as long as the key is registered in the db.
+    int id;
+    char* key; // Caller must free.
+    int64_t timeoutNs;
+
+    int64_t versionsCreated;
+    int64_t versionsConverged;
+    // Superseded (or timed out) before they ever converged.
+    int64_t versionsReapedUnconverged;
+    // Times the sysmon reaped versions because nothing converged
+    // within the timeout.
+    int64_t timeoutsHit;
+    int maxInflightCount;
+
+    // Time from version creation to (first) convergence.
+    int64_t convergenceP50Ns;
+    int64_t convergenceP99Ns;
+    int64_t convergenceMaxNs;
+} AtomicallyStats;
+// Returns stats for every registered key (the caller must free the
+// array and each key) and sets *outCount to how many.
+AtomicallyStats* dbAtomicallyStats(Db* db, int* outCount);
+
 void dbInflightIncr(Statement* stmt);
 void dbInflightDecr(Db* db, Statement* stmt);
 void dbAtomicallyVersionInflightIncr(AtomicallyVersion* atomicallyVersion);
@@ -173,4 +226,14 @@ Statement* dbHoldStatement(Db* db,
                            const char* sourceFileName, int sourceLineNumber,
                            StatementRef* outOldStatement);
 
+typedef struct HoldStats {
+    int shardsCount;
+    int64_t holdsCount;
+    // Lifetime count of hold-table lock acquisitions, and how many of
+    // them had to wait for another thread.
+    int64_t lockCount;
+    int64_t contendedCount;
+} HoldStats;
+void dbHoldStats(Db* db, HoldStats* out);
+
 #endif
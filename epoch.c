@@ -201,3 +201,11 @@ void epochGlobalCollect() {
     }
     g->garbageNextIdx = 0;
 }
+
+int epochGarbageCount() {
+    int count = 0;
+    for (int i = 0; i < 3; i++) {
+        count += epochGlobalGarbage[i].garbageNextIdx;
+    }
+    return count;
+}
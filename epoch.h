@@ -14,6 +14,10 @@ void epochBegin();
 // thread.
 void epochGlobalCollect();
 
+// How many retired pointers are waiting to be freed by
+// epochGlobalCollect (approximate; for monitoring).
+int epochGarbageCount();
+
 // You should only do the below while in an epoch:
 
 // Reversible operations:
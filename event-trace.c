@@ -0,0 +1,305 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "vendor/stb_ds.h"
+
+#include <jim.h>
+
+#include "common.h"
+#include "block-stats.h"
+#include "event-trace.h"
+
+// Event trace (flight recorder). Each worker writes a fixed-size
+// ring of its most recent work items: op, source location, refs,
+// start/end time, and which queue it came from. Only the worker ever
+// writes its own ring, so recording is a few plain stores plus a
+// release store of the ring head; no locks.
+//
+// Readers (a dump) copy the ring without stopping the worker, then
+// re-read the head and throw away any entries that the worker might
+// have overwritten while they were copying.
+//
+// Source locations are block stats ids (see block-stats.c), so we
+// don't copy strings on the hot path.
+
+// Per worker. Must be a power of 2.
+#define EVENT_TRACE_RING_SIZE 16384
+// Default window for dumps.
+#define EVENT_TRACE_DEFAULT_SECONDS 10
+
+typedef struct EventTraceEvent {
+    int64_t startNs;
+    int64_t endNs;
+    // RUN_WHEN: when and stmt. RUN_WHEN_BATCH: when and statement
+    // count. RUN_SUBSCRIBE: subscribe ref.
+    uint64_t ref0;
+    uint64_t ref1;
+    // Block stats id, or -1 if unknown.
+    int32_t location;
+    uint8_t op;
+    uint8_t source;
+} EventTraceEvent;
+
+typedef struct EventTraceRing {
+    // Total number of events ever published to this ring.
+    uint64_t _Atomic head;
+    EventTraceEvent events[EVENT_TRACE_RING_SIZE];
+} EventTraceRing;
+
+// Indexed by worker index. Allocated the first time a worker runs
+// something, and never freed (a replacement worker in the same slot
+// reuses it).
+static EventTraceRing* _Atomic eventTraceRings[THREADS_MAX];
+static __thread EventTraceRing* eventTraceRing;
+static __thread EventTraceEvent* eventTraceCurrent;
+
+static int64_t eventTraceStartNs;
+static volatile sig_atomic_t eventTraceDumpRequested;
+
+static const char* eventTraceOpNames[] = {
+    [NONE] = "none", [ASSERT] = "assert", [RETRACT] = "retract",
+    [RUN_WHEN] = "when", [RUN_WHEN_BATCH] = "when batch",
+    [RUN_SUBSCRIBE] = "subscribe", [EVAL] = "eval"
+};
+static const char* eventTraceSourceNames[] = {
+    [EVENT_TRACE_LOCAL] = "local", [EVENT_TRACE_STOLEN] = "stolen",
+    [EVENT_TRACE_GLOBAL] = "global"
+};
+
+static void eventTraceSignalHandler(int sig) {
+    // Just set a flag; sysmon does the actual dump.
+    eventTraceDumpRequested = 1;
+}
+
+void eventTraceInit(void) {
+    eventTraceStartNs = timestamp_get(CLOCK_MONOTONIC);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = eventTraceSignalHandler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR2, &sa, NULL);
+}
+
+void eventTraceBegin(int worker, WorkQueueItem* item, EventTraceSource source) {
+    EventTraceRing* ring = eventTraceRing;
+    if (ring == NULL) {
+        ring = eventTraceRings[worker];
+        if (ring == NULL) {
+            ring = calloc(1, sizeof(EventTraceRing));
+            eventTraceRings[worker] = ring;
+        }
+        eventTraceRing = ring;
+    }
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    EventTraceEvent* ev = &ring->events[head & (EVENT_TRACE_RING_SIZE - 1)];
+    ev->startNs = timestamp_get(CLOCK_MONOTONIC);
+    ev->endNs = 0;
+    ev->op = item->op;
+    ev->source = source;
+    ev->location = -1;
+    ev->ref0 = 0; ev->ref1 = 0;
+    if (item->op == RUN_WHEN) {
+        ev->ref0 = item->runWhen.when.val;
+        ev->ref1 = item->runWhen.stmt.val;
+    } else if (item->op == RUN_WHEN_BATCH) {
+        ev->ref0 = item->runWhenBatch.batch->when.val;
+        ev->ref1 = item->runWhenBatch.end - item->runWhenBatch.start;
+    } else if (item->op == RUN_SUBSCRIBE) {
+        ev->ref0 = item->runSubscribe.subscribeRef.val;
+    } else if (item->op == ASSERT) {
+        // Blocks get their location from runBlock (where the id is
+        // already cached on the When statement); asserts carry theirs.
+        ev->location = item->assert.sourceLocationId;
+    }
+    eventTraceCurrent = ev;
+}
+
+void eventTraceSetLocation(int locationId) {
+    if (eventTraceCurrent != NULL) { eventTraceCurrent->location = locationId; }
+}
+
+void eventTraceEnd(void) {
+    EventTraceEvent* ev = eventTraceCurrent;
+    if (ev == NULL) { return; }
+    ev->endNs = timestamp_get(CLOCK_MONOTONIC);
+    eventTraceCurrent = NULL;
+
+    EventTraceRing* ring = eventTraceRing;
+    atomic_store_explicit(&ring->head,
+                          atomic_load_explicit(&ring->head, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+//////////////////////////////////////////////////////////
+// Dumping
+//////////////////////////////////////////////////////////
+
+// Appends to an stb_ds char array, keeping it NUL-terminated. (We
+// build output in memory since fprintf is overridden in
+// output-redirection.c.)
+static void bufAppendf(char** buf, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    if (arrlen(*buf) > 0) { arrpop(*buf); } // the NUL
+    char* dst = arraddnptr(*buf, len + 1);
+    va_start(args, fmt);
+    vsnprintf(dst, len + 1, fmt, args);
+    va_end(args);
+}
+static void bufAppendJsonString(char** buf, const char* s) {
+    bufAppendf(buf, "\"");
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') { bufAppendf(buf, "\\%c", c); }
+        else if (c < 0x20) { bufAppendf(buf, "\\u%04x", c); }
+        else { (*buf)[arrlen(*buf) - 1] = c; arrput(*buf, '\0'); }
+    }
+    bufAppendf(buf, "\"");
+}
+
+static void appendRef(char** out, const char* name, uint64_t val) {
+    StatementRef ref = { .val = val };
+    bufAppendf(out, ", \"%s\": \"%" PRIu32 ":%" PRId32 "\"", name, ref.idx, ref.gen);
+}
+
+// Copies out one worker's events that ended at or after sinceNs,
+// appending them to `events` (an stb_ds array).
+static void copyRing(EventTraceRing* ring, int64_t sinceNs, EventTraceEvent** events) {
+    static EventTraceEvent snapshot[EVENT_TRACE_RING_SIZE];
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t first = head > EVENT_TRACE_RING_SIZE ? head - EVENT_TRACE_RING_SIZE : 0;
+    for (uint64_t i = first; i < head; i++) {
+        snapshot[i - first] = ring->events[i & (EVENT_TRACE_RING_SIZE - 1)];
+    }
+    atomic_thread_fence(memory_order_acquire);
+    // The worker may have overwritten entries up to (and including,
+    // if it's mid-item) index newHead - RING_SIZE while we copied.
+    uint64_t newHead = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint64_t firstValid = newHead >= EVENT_TRACE_RING_SIZE ?
+        newHead - EVENT_TRACE_RING_SIZE + 1 : 0;
+
+    for (uint64_t i = first < firstValid ? firstValid : first; i < head; i++) {
+        EventTraceEvent* ev = &snapshot[i - first];
+        if (ev->endNs < sinceNs) { continue; }
+        arrput(*events, *ev);
+    }
+}
+
+// Builds a Chrome trace JSON of every worker's events from the last
+// `seconds` seconds.
+static void buildTrace(char** out, double seconds) {
+    static pthread_mutex_t dumpMutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_lock(&dumpMutex);
+
+    int64_t nowNs = timestamp_get(CLOCK_MONOTONIC);
+    int64_t sinceNs = nowNs - (int64_t)(seconds * 1e9);
+
+    bufAppendf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    bufAppendf(out, "{\"ph\": \"M\", \"pid\": 1, \"name\": \"process_name\", "
+               "\"args\": {\"name\": \"folk\"}}");
+
+    EventTraceEvent* events = NULL;
+    for (int worker = 0; worker < THREADS_MAX; worker++) {
+        EventTraceRing* ring = eventTraceRings[worker];
+        if (ring == NULL) { continue; }
+
+        bufAppendf(out, ",\n{\"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"name\": \"thread_name\", "
+                   "\"args\": {\"name\": \"worker %d\"}}", worker, worker);
+
+        arrsetlen(events, 0);
+        copyRing(ring, sinceNs, &events);
+        for (int i = 0; i < arrlen(events); i++) {
+            EventTraceEvent* ev = &events[i];
+            const char* location = ev->location >= 0 ? blockStatsLocation(ev->location) : NULL;
+            char name[1100];
+            snprintf(name, sizeof(name), "%s%s%s", eventTraceOpNames[ev->op],
+                     location ? " " : "", location ? location : "");
+
+            bufAppendf(out, ",\n{\"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, "
+                       "\"ph\": \"X\", \"cat\": \"%s\", \"name\": ",
+                       worker, (ev->startNs - eventTraceStartNs) / 1000.0,
+                       (ev->endNs - ev->startNs) / 1000.0,
+                       eventTraceOpNames[ev->op]);
+            bufAppendJsonString(out, name);
+            bufAppendf(out, ", \"args\": {\"queue\": \"%s\"",
+                       eventTraceSourceNames[ev->source]);
+            if (location) {
+                bufAppendf(out, ", \"location\": ");
+                bufAppendJsonString(out, location);
+            }
+            if (ev->op == RUN_WHEN) {
+                appendRef(out, "when", ev->ref0);
+                appendRef(out, "stmt", ev->ref1);
+            } else if (ev->op == RUN_WHEN_BATCH) {
+                appendRef(out, "when", ev->ref0);
+                bufAppendf(out, ", \"stmts\": %" PRIu64, ev->ref1);
+            } else if (ev->op == RUN_SUBSCRIBE) {
+                appendRef(out, "subscribe", ev->ref0);
+            }
+            bufAppendf(out, "}}");
+        }
+    }
+    arrfree(events);
+    bufAppendf(out, "\n]}\n");
+
+    pthread_mutex_unlock(&dumpMutex);
+}
+
+void eventTraceTick(void) {
+    if (!eventTraceDumpRequested) { return; }
+    eventTraceDumpRequested = 0;
+
+    const char* secondsEnv = getenv("FOLK_EVENT_TRACE_SECONDS");
+    double seconds = secondsEnv ? atof(secondsEnv) : EVENT_TRACE_DEFAULT_SECONDS;
+
+    char* trace = NULL;
+    buildTrace(&trace, seconds);
+
+    char path[256];
+    snprintf(path, sizeof(path), "/var/tmp/folk-%d/event-trace.json", getpid());
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "eventTrace: Couldn't open %s\n", path);
+    } else {
+        fwrite(trace, 1, strlen(trace), fp);
+        fclose(fp);
+        fprintf(stderr, "eventTrace: Wrote last %.1fs of events to %s\n", seconds, path);
+    }
+    arrfree(trace);
+}
+
+// __eventTraceJson ?seconds?: returns a Chrome trace JSON of the
+// last `seconds` (default 10) seconds of work items.
+int __eventTraceJsonFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    if (argc > 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "?seconds?");
+        return JIM_ERR;
+    }
+    double seconds = EVENT_TRACE_DEFAULT_SECONDS;
+    if (argc == 2 && Jim_GetDouble(interp, argv[1], &seconds) != JIM_OK) {
+        return JIM_ERR;
+    }
+
+    char* trace = NULL;
+    buildTrace(&trace, seconds);
+    Jim_SetResult(interp, Jim_NewStringObj(interp, trace, -1));
+    arrfree(trace);
+    return JIM_OK;
+}
@@ -0,0 +1,34 @@
+#ifndef EVENT_TRACE_H
+#define EVENT_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <jim.h>
+
+#include "workqueue.h"
+
+// Always-on flight recorder of work items: each worker keeps a ring
+// of its most recent items, which can be dumped as a Chrome trace
+// (send folk SIGUSR2, or GET /event-trace.json from the web server)
+// after something janky happens.
+
+// Where a worker got a work item from.
+typedef enum EventTraceSource {
+    EVENT_TRACE_LOCAL, EVENT_TRACE_STOLEN, EVENT_TRACE_GLOBAL
+} EventTraceSource;
+
+void eventTraceInit(void);
+
+// Called by the worker around each work item it runs.
+void eventTraceBegin(int worker, WorkQueueItem* item, EventTraceSource source);
+// Sets the source location of the current item (a block stats id),
+// once we know it.
+void eventTraceSetLocation(int locationId);
+void eventTraceEnd(void);
+
+// Called from sysmon; writes a dump if we got SIGUSR2.
+void eventTraceTick(void);
+
+int __eventTraceJsonFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv);
+
+#endif
@@ -10,7 +10,9 @@
 #include <signal.h>
 #include <setjmp.h>
 #include <sys/syscall.h>
+#include <sys/resource.h>
 #include <fcntl.h>
+#include <dlfcn.h>
 
 #if __has_include ("tracy/TracyC.h")
 #include "tracy/TracyC.h"
@@ -32,6 +34,12 @@
 #define FATAL(...) do { dprintf(realStderr, __VA_ARGS__); exit(1); } while(0)
 
 #include "block-stats.h"
+#include "query-profile.h"
+#include "event-trace.h"
+#include "reaction-latency.h"
+#include "compile-pool.h"
+#include "boot-trace.h"
+#include "record-replay.h"
 
 ThreadControlBlock threads[THREADS_MAX];
 int _Atomic threadCount;
@@ -73,7 +81,79 @@ WorkQueueItem globalWorkQueueTake() {
     return ret;
 }
 
+// Worker affinity (off by default; set FOLK_WORKER_AFFINITY=1 at
+// startup, or call __setWorkerAffinity): each When and Subscribe
+// gets a home worker, picked by hashing its source location, and
+// its runs get sent to that worker's inbox. The same body then keeps
+// running on the same interpreter, which has already parsed it,
+// loaded its C modules and so on. Other workers only take from an
+// inbox when its worker is backed up or stuck.
+bool _Atomic workerAffinityEnabled;
+// Homed items that ran on their home worker vs. somewhere else.
+int64_t _Atomic workerAffinityHitsCount;
+int64_t _Atomic workerAffinityMissesCount;
+
+#define AFFINITY_INBOX_CAPACITY 4096
+// Past this many waiting items, an inbox stops taking new items and
+// other workers can steal from it.
+#define AFFINITY_INBOX_OVERLOADED 8
+// Other workers can also steal from an inbox once its worker has
+// been on its current item this long.
+#define AFFINITY_STUCK_NS 2000000
+
+// Returns the home worker for a block (by its block stats id), or -1
+// if affinity is off. Never the main thread (worker 0), which can be
+// off doing main-thread-only things (like boot or GLFW) for a while.
+static int workerAffinityHome(int blockStatsId) {
+    int n = threadCount;
+    if (!workerAffinityEnabled || blockStatsId < 0 || n < 2) { return -1; }
+    uint32_t h = (uint32_t) blockStatsId * 2654435761u;
+    return 1 + h % (n - 1);
+}
+static bool workerAffinityPush(WorkQueueItem item) {
+    if (self != NULL && item.home == self->index) { return false; }
+
+    ThreadControlBlock* home = &threads[item.home];
+    struct mpmc_queue* inbox = home->affinityInbox;
+    if (inbox == NULL || home->tid == 0 || home->isDeactivated ||
+        home->affinityInboxSize > AFFINITY_INBOX_OVERLOADED) {
+        return false;
+    }
+    WorkQueueItem* pushee = malloc(sizeof(item));
+    *pushee = item;
+    if (!mpmc_queue_push(inbox, pushee)) {
+        free(pushee);
+        return false;
+    }
+    home->affinityInboxSize++;
+    return true;
+}
+static WorkQueueItem workerAffinityInboxTake(ThreadControlBlock* thread) {
+    WorkQueueItem ret = { .op = NONE };
+    struct mpmc_queue* inbox = thread->affinityInbox;
+    if (inbox != NULL && thread->affinityInboxSize > 0) {
+        WorkQueueItem* pullee;
+        if (mpmc_queue_pull(inbox, (void **)&pullee)) {
+            thread->affinityInboxSize--;
+            ret = *pullee;
+            free(pullee);
+        }
+    }
+    return ret;
+}
+static bool workerAffinityInboxIsStealable(ThreadControlBlock* thread) {
+    if (thread->affinityInboxSize <= 0) { return false; }
+    if (thread->tid == 0 || thread->isDeactivated ||
+        thread->affinityInboxSize > AFFINITY_INBOX_OVERLOADED) {
+        return true;
+    }
+    int64_t startTimestamp = thread->currentItemStartTimestamp;
+    return startTimestamp != 0 &&
+        timestamp_get(thread->clockid) - startTimestamp > AFFINITY_STUCK_NS;
+}
+
 void appropriateWorkQueuePush(WorkQueueItem item) {
+    if (item.hasHome && workerAffinityPush(item)) { return; }
     if (self) {
         workQueuePush(self->workQueue, item);
         return;
@@ -124,6 +204,42 @@ static Jim_Obj* termsToJimObj(Jim_Interp* interp, int nTerms, Term* terms[]) {
     return Jim_NewListObj(interp, termObjs, nTerms);
 }
 
+// Per-thread cache of Jim list objects (one element per term) for
+// statement clauses, so that queries and When bodies that keep
+// hitting the same statements get shared, already-shimmered term
+// objects instead of fresh copies every time. The cache is
+// direct-mapped on statement idx. An entry is only valid if its ref
+// (including gen) matches, since a statement's clause is immutable
+// for as long as its gen stays the same.
+#define CLAUSE_OBJ_CACHE_SIZE 4096
+typedef struct ClauseObjCacheEntry {
+    StatementRef ref;
+    Jim_Obj* obj;
+} ClauseObjCacheEntry;
+static __thread ClauseObjCacheEntry* clauseObjCache;
+
+// `stmt` must be acquired by the caller and must be what `ref`
+// points to. Returns a borrowed reference to the list object, which
+// stays alive at least until the next call on this thread.
+static Jim_Obj* statementClauseToJimObj(Jim_Interp* interp,
+                                        StatementRef ref, Statement* stmt) {
+    ClauseObjCacheEntry* entry = &clauseObjCache[ref.idx % CLAUSE_OBJ_CACHE_SIZE];
+    if (entry->obj != NULL && entry->ref.val == ref.val) {
+        self->_clauseObjCacheHits++;
+        return entry->obj;
+    }
+    self->_clauseObjCacheMisses++;
+
+    Clause* clause = statementClause(stmt);
+    Jim_Obj* obj = termsToJimObj(interp, clause->nTerms, clause->terms);
+    Jim_IncrRefCount(obj);
+    // Evict whatever was in this slot before.
+    if (entry->obj != NULL) { Jim_DecrRefCount(interp, entry->obj); }
+    entry->ref = ref;
+    entry->obj = obj;
+    return obj;
+}
+
 static void destructorHelper(void* arg) {
     // This dispatches an evaluation task to the global queue, so that
     // this function can be invoked from sysmon (which doesn't have
@@ -146,11 +262,34 @@ typedef struct Environment {
     EnvironmentBinding bindings[];
 } Environment;
 
-// This function lives in folk.c and not trie.c (where most
-// Clause/matching logic lives) because it operates at the Tcl level,
-// building up a mapping of strings to Tcl objects. Caller must free
-// the returned Environment*.
-Environment* clauseUnify(Jim_Interp* interp, Clause* a, Clause* b) {
+// Returns term i of a clause as a Jim object: shared out of
+// `clauseObj` if the caller has a cached list object for the clause,
+// or freshly created otherwise.
+static Jim_Obj* clauseTermToJimObj(Jim_Interp* interp, Clause* clause,
+                                   Jim_Obj* clauseObj, int i) {
+    if (clauseObj != NULL) {
+        return Jim_ListGetIndex(interp, clauseObj, i);
+    }
+    return termToJimObj(interp, clause->terms[i]);
+}
+static Jim_Obj* clauseRestToJimObj(Jim_Interp* interp, Clause* clause,
+                                   Jim_Obj* clauseObj, int i) {
+    if (clauseObj != NULL) {
+        Jim_Obj* termObjs[clause->nTerms - i];
+        for (int j = i; j < clause->nTerms; j++) {
+            termObjs[j - i] = Jim_ListGetIndex(interp, clauseObj, j);
+        }
+        return Jim_NewListObj(interp, termObjs, clause->nTerms - i);
+    }
+    return termsToJimObj(interp, clause->nTerms - i, &clause->terms[i]);
+}
+
+// aObj and bObj are optional list objects for a and b (for instance,
+// from the statement clause cache); if present, bound values are
+// shared out of them instead of being freshly created.
+static Environment* clauseUnifyImpl(Jim_Interp* interp,
+                                    Clause* a, Jim_Obj* aObj,
+                                    Clause* b, Jim_Obj* bObj) {
     Environment* env = malloc(sizeof(Environment) + sizeof(EnvironmentBinding)*a->nTerms);
     env->nBindings = 0;
 
@@ -160,21 +299,21 @@ Environment* clauseUnify(Jim_Interp* interp, Clause* a, Clause* b) {
             if (aVarName[0] == '.' && aVarName[1] == '.' && aVarName[2] == '.') {
                 EnvironmentBinding* binding = &env->bindings[env->nBindings++];
                 memcpy(binding->name, aVarName + 3, sizeof(binding->name) - 3);
-                binding->value = termsToJimObj(interp, b->nTerms - i, &b->terms[i]);
+                binding->value = clauseRestToJimObj(interp, b, bObj, i);
             } else if (!trieVariableNameIsNonCapturing(aVarName)) {
                 EnvironmentBinding* binding = &env->bindings[env->nBindings++];
                 memcpy(binding->name, aVarName, sizeof(binding->name));
-                binding->value = termToJimObj(interp, b->terms[i]);
+                binding->value = clauseTermToJimObj(interp, b, bObj, i);
             }
         } else if (trieScanVariable(b->terms[i], bVarName, sizeof(bVarName))) {
             if (bVarName[0] == '.' && bVarName[1] == '.' && bVarName[2] == '.') {
                 EnvironmentBinding* binding = &env->bindings[env->nBindings++];
                 memcpy(binding->name, bVarName + 3, sizeof(binding->name) - 3);
-                binding->value = termsToJimObj(interp, a->nTerms - i, &a->terms[i]);
+                binding->value = clauseRestToJimObj(interp, a, aObj, i);
             } else if (!trieVariableNameIsNonCapturing(bVarName)) {
                 EnvironmentBinding* binding = &env->bindings[env->nBindings++];
                 memcpy(binding->name, bVarName, sizeof(binding->name));
-                binding->value = termToJimObj(interp, a->terms[i]);
+                binding->value = clauseTermToJimObj(interp, a, aObj, i);
             }
         } else if (!termEq(a->terms[i], b->terms[i])) {
             free(env);
@@ -186,19 +325,44 @@ Environment* clauseUnify(Jim_Interp* interp, Clause* a, Clause* b) {
     return env;
 }
 
+// This function lives in folk.c and not trie.c (where most
+// Clause/matching logic lives) because it operates at the Tcl level,
+// building up a mapping of strings to Tcl objects. Caller must free
+// the returned Environment*.
+Environment* clauseUnify(Jim_Interp* interp, Clause* a, Clause* b) {
+    return clauseUnifyImpl(interp, a, NULL, b, NULL);
+}
+// Like clauseUnify, but unifies `pattern` against the clause of the
+// (acquired) statement `stmt` at `ref`, and shares bound values out
+// of this thread's statement clause cache.
+Environment* clauseUnifyStatement(Jim_Interp* interp, Clause* pattern,
+                                  StatementRef ref, Statement* stmt) {
+    return clauseUnifyImpl(interp, pattern, NULL,
+                           statementClause(stmt),
+                           statementClauseToJimObj(interp, ref, stmt));
+}
+
 // Assert! the time is 3
+// Where the currently-running script came from.
+static void currentSourceLocation(Jim_Interp *interp,
+                                  const char** sourceFileName, int* sourceLineNumber) {
+    Jim_Obj* scriptObj = interp->evalFrame->scriptObj;
+    if (Jim_ScriptGetSourceFileName(interp, scriptObj, sourceFileName) != JIM_OK) {
+        *sourceFileName = "<unknown>";
+    }
+    if (Jim_ScriptGetSourceLineNumber(interp, scriptObj, sourceLineNumber) != JIM_OK) {
+        *sourceLineNumber = -1;
+    }
+}
+
 static int AssertFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
     Clause* clause = jimObjsToClause(argc - 1, argv + 1);
 
-    Jim_Obj* scriptObj = interp->evalFrame->scriptObj;
     const char* sourceFileName;
     int sourceLineNumber;
-    if (Jim_ScriptGetSourceFileName(interp, scriptObj, &sourceFileName) != JIM_OK) {
-        sourceFileName = "<unknown>";
-    }
-    if (Jim_ScriptGetSourceLineNumber(interp, scriptObj, &sourceLineNumber) != JIM_OK) {
-        sourceLineNumber = -1;
-    }
+    currentSourceLocation(interp, &sourceFileName, &sourceLineNumber);
+
+    recordAssert(clause, sourceFileName, sourceLineNumber);
 
     appropriateWorkQueuePush((WorkQueueItem) {
        .op = ASSERT,
@@ -206,6 +370,7 @@ static int AssertFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
            .clause = clause,
            .sourceFileName = strdup(sourceFileName),
            .sourceLineNumber = sourceLineNumber,
+           .sourceLocationId = blockStatsInternCached(sourceFileName, sourceLineNumber),
        }
     });
 
@@ -215,6 +380,13 @@ static int AssertFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
 static int RetractFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
     Clause* pattern = jimObjsToClause(argc - 1, argv + 1);
 
+    if (recording) {
+        const char* sourceFileName;
+        int sourceLineNumber;
+        currentSourceLocation(interp, &sourceFileName, &sourceLineNumber);
+        recordRetract(pattern, sourceFileName, sourceLineNumber);
+    }
+
     appropriateWorkQueuePush((WorkQueueItem) {
        .op = RETRACT,
        .retract = { .pattern = pattern }
@@ -303,6 +475,9 @@ static int HoldStatementGloballyFunc(Jim_Interp *interp, int argc, Jim_Obj *cons
         destructorCode = NULL;
     }
 
+    recordHold(key, version, clause, keepMs, destructorCode,
+               sourceFileName, sourceLineNumber);
+
     HoldStatementGlobally(key, version,
                           clause, keepMs, destructorCode,
                           sourceFileName, sourceLineNumber);
@@ -417,16 +592,51 @@ static int DestructorFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
     return JIM_OK;
 }
 
-static void Notify(Clause* toNotify);
+static void NotifyBatch(int toNotifyCount, Clause** toNotify);
 static int NotifyFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
     assert(argc >= 2);
 
     Clause* toNotify = jimObjsToClause(argc - 1, argv + 1);
-    Notify(toNotify);
+    if (recording) {
+        const char* sourceFileName;
+        int sourceLineNumber;
+        currentSourceLocation(interp, &sourceFileName, &sourceLineNumber);
+        recordNotify(toNotify, sourceFileName, sourceLineNumber);
+    }
+    NotifyBatch(1, &toNotify);
 
     clauseFree(toNotify);
     return JIM_OK;
 }
+// NotifyBatchImpl {clause1 clause2 ...}: notifies each clause, in
+// order, but runs each subscriber once for the whole batch.
+static int NotifyBatchFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    if (argc != 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "clauses");
+        return JIM_ERR;
+    }
+    int toNotifyCount = Jim_ListLength(interp, argv[1]);
+    // (stb_ds array, since the batch can be arbitrarily big.)
+    Clause** toNotify = NULL;
+    arrsetcap(toNotify, toNotifyCount);
+    const char* sourceFileName;
+    int sourceLineNumber;
+    if (recording) {
+        currentSourceLocation(interp, &sourceFileName, &sourceLineNumber);
+    }
+    for (int i = 0; i < toNotifyCount; i++) {
+        Clause* clause = jimObjToClause(interp, Jim_ListGetIndex(interp, argv[1], i));
+        arrput(toNotify, clause);
+        if (recording) {
+            recordNotify(clause, sourceFileName, sourceLineNumber);
+        }
+    }
+    NotifyBatch(toNotifyCount, toNotify);
+
+    for (int i = 0; i < toNotifyCount; i++) { clauseFree(toNotify[i]); }
+    arrfree(toNotify);
+    return JIM_OK;
+}
 
 extern int statementParentCount(Statement* stmt);
 Jim_Obj* QuerySimple(bool isAtomically, Clause* pattern) {
@@ -450,7 +660,8 @@ Jim_Obj* QuerySimple(bool isAtomically, Clause* pattern) {
             continue;
         }
 
-        Environment* env = clauseUnify(interp, pattern, statementClause(result));
+        Environment* env = clauseUnifyStatement(interp, pattern,
+                                                rs->results[i], result);
         if (env == NULL) {
             statementRelease(db, result);
             continue;
@@ -574,6 +785,271 @@ static int __startsWithDollarSignFunc(Jim_Interp *interp, int argc, Jim_Obj *con
     Jim_SetResultBool(interp, Jim_String(argv[1])[0] == '$');
     return JIM_OK;
 }
+// Parsed form of a When or Query! pattern. Everything in here only
+// depends on the raw pattern terms, so it can be memoized; the
+// $-terms still have to be substituted in the caller's frame on every
+// call.
+typedef struct PatternParse {
+    // Terms before the first &, with /nobody/ and /nothing/ rewritten
+    // to /any/. $-terms are left unsubstituted.
+    Jim_Obj* pattern;
+    // Indices of $-terms in pattern (stb_ds array).
+    int* dollarTermIdxs;
+    // Terms after the first &, with variables bound by pattern
+    // rewritten from /x/ to $x. NULL if there is no join.
+    Jim_Obj* remainingPattern;
+    // Names of variables that pattern will bind.
+    Jim_Obj* boundVarNames;
+    bool isNegated;
+    // Only set for Query! patterns (-atomically flag).
+    bool isAtomically;
+} PatternParse;
+
+typedef struct PatternParseMemoEntry {
+    char* key;
+    PatternParse* value;
+} PatternParseMemoEntry;
+
+// Per-interp (so per-thread) memo tables from raw pattern string to
+// parse. Patterns embed substituted values like program names, so
+// the tables get flushed once they grow past this size.
+#define PATTERN_PARSE_MEMO_MAX 2048
+static __thread PatternParseMemoEntry* whenPatternParseMemo;
+static __thread PatternParseMemoEntry* queryPatternParseMemo;
+static __thread int patternParseSubstDepth;
+
+static PatternParse* patternParseNew(Jim_Interp* interp, Jim_Obj* patternObj,
+                                     bool isQuery) {
+    PatternParse* parse = calloc(1, sizeof(PatternParse));
+    parse->pattern = Jim_NewListObj(interp, NULL, 0);
+    parse->boundVarNames = Jim_NewListObj(interp, NULL, 0);
+
+    int n = Jim_ListLength(interp, patternObj);
+    for (int i = 0; i < n; i++) {
+        Jim_Obj* termObj = Jim_ListGetIndex(interp, patternObj, i);
+        int len; const char* s = Jim_GetString(termObj, &len);
+
+        if (len == 1 && s[0] == '&') {
+            // Desugar this join: rewrite subsequent instances of
+            // variables bound by this clause from /x/ to $x.
+            parse->remainingPattern = Jim_NewListObj(interp, NULL, 0);
+            for (int j = i + 1; j < n; j++) {
+                Jim_Obj* remainingTermObj = Jim_ListGetIndex(interp, patternObj, j);
+                int rlen; const char* r = Jim_GetString(remainingTermObj, &rlen);
+                if (rlen > 2 && r[0] == '/' && r[rlen - 1] == '/' &&
+                    memchr(r + 1, '/', rlen - 2) == NULL &&
+                    memchr(r + 1, ' ', rlen - 2) == NULL) {
+
+                    Jim_Obj* varNameObj = Jim_NewStringObj(interp, r + 1, rlen - 2);
+                    int nBound = Jim_ListLength(interp, parse->boundVarNames);
+                    for (int k = 0; k < nBound; k++) {
+                        if (Jim_StringEqObj(varNameObj,
+                                            Jim_ListGetIndex(interp, parse->boundVarNames, k))) {
+                            remainingTermObj = Jim_NewStringObj(interp, "$", 1);
+                            Jim_AppendObj(interp, remainingTermObj, varNameObj);
+                            break;
+                        }
+                    }
+                    Jim_FreeNewObj(interp, varNameObj);
+                }
+                Jim_ListAppendElement(interp, parse->remainingPattern, remainingTermObj);
+            }
+            break;
+        }
+
+        if (isQuery && strcmp(s, "-atomically") == 0) {
+            parse->isAtomically = true;
+            continue;
+        }
+
+        char varName[100];
+        Term* potentialVarTerm = termNew(s, len);
+        bool isVariable = trieScanVariable(potentialVarTerm, varName, 100);
+        free(potentialVarTerm);
+
+        if (isVariable) {
+            if (trieVariableNameIsNonCapturing(varName)) {
+            } else if (strcmp(varName, "nobody") == 0 ||
+                       strcmp(varName, "nothing") == 0) {
+                // Rewrite this entire clause to be negated.
+                parse->isNegated = true;
+                termObj = Jim_NewStringObj(interp, "/any/", -1);
+            } else {
+                const char* name = varName;
+                if (strncmp(name, "...", 3) == 0) { name += 3; }
+                Jim_ListAppendElement(interp, parse->boundVarNames,
+                                      Jim_NewStringObj(interp, name, -1));
+            }
+        } else if (s[0] == '$') {
+            arrput(parse->dollarTermIdxs, Jim_ListLength(interp, parse->pattern));
+        }
+        Jim_ListAppendElement(interp, parse->pattern, termObj);
+    }
+
+    Jim_IncrRefCount(parse->pattern);
+    Jim_IncrRefCount(parse->boundVarNames);
+    if (parse->remainingPattern != NULL) {
+        Jim_IncrRefCount(parse->remainingPattern);
+    }
+    return parse;
+}
+static void patternParseFree(Jim_Interp* interp, PatternParse* parse) {
+    Jim_DecrRefCount(interp, parse->pattern);
+    Jim_DecrRefCount(interp, parse->boundVarNames);
+    if (parse->remainingPattern != NULL) {
+        Jim_DecrRefCount(interp, parse->remainingPattern);
+    }
+    arrfree(parse->dollarTermIdxs);
+    free(parse);
+}
+static PatternParse* patternParseMemoized(Jim_Interp* interp,
+                                          PatternParseMemoEntry** memo,
+                                          Jim_Obj* patternObj, bool isQuery) {
+    if (*memo == NULL) { sh_new_strdup(*memo); }
+
+    const char* key = Jim_String(patternObj);
+    PatternParseMemoEntry* entry = shgetp_null(*memo, key);
+    if (entry != NULL) { return entry->value; }
+
+    if (shlen(*memo) >= PATTERN_PARSE_MEMO_MAX && patternParseSubstDepth == 0) {
+        for (int i = 0; i < shlen(*memo); i++) {
+            patternParseFree(interp, (*memo)[i].value);
+        }
+        shfree(*memo);
+        sh_new_strdup(*memo);
+    }
+
+    PatternParse* parse = patternParseNew(interp, patternObj, isQuery);
+    shput(*memo, key, parse);
+    return parse;
+}
+// Returns parse->pattern with its $-terms substituted in the frame
+// that called the proc that called us (i.e., the caller of When or
+// Query!). The returned pattern has a reference held on it.
+static int patternParseSubstPattern(Jim_Interp* interp, PatternParse* parse,
+                                    Jim_Obj** outPattern) {
+    int nDollarTerms = arrlen(parse->dollarTermIdxs);
+    if (nDollarTerms == 0) {
+        Jim_IncrRefCount(parse->pattern);
+        *outPattern = parse->pattern;
+        return JIM_OK;
+    }
+
+    int n = Jim_ListLength(interp, parse->pattern);
+    Jim_Obj* termObjs[n];
+    for (int i = 0; i < n; i++) {
+        termObjs[i] = Jim_ListGetIndex(interp, parse->pattern, i);
+        Jim_IncrRefCount(termObjs[i]);
+    }
+    int dollarTermIdxs[nDollarTerms];
+    memcpy(dollarTermIdxs, parse->dollarTermIdxs, sizeof(dollarTermIdxs));
+
+    // The subst can run arbitrary code (including another When),
+    // so don't let the memo get flushed out from under us.
+    patternParseSubstDepth++;
+    int error = JIM_OK;
+    for (int i = 0; i < nDollarTerms && error == JIM_OK; i++) {
+        int idx = dollarTermIdxs[i];
+        Jim_Obj* substObjv[] = {
+            Jim_NewStringObj(interp, "subst", -1),
+            termObjs[idx]
+        };
+        Jim_Obj* objv[] = {
+            Jim_NewStringObj(interp, "uplevel", -1),
+            Jim_NewIntObj(interp, 1),
+            Jim_NewListObj(interp, substObjv, 2)
+        };
+        error = Jim_EvalObjVector(interp, 3, objv);
+        if (error == JIM_OK) {
+            Jim_Obj* substTermObj = Jim_GetResult(interp);
+            Jim_IncrRefCount(substTermObj);
+            Jim_DecrRefCount(interp, termObjs[idx]);
+            termObjs[idx] = substTermObj;
+        }
+    }
+    patternParseSubstDepth--;
+
+    if (error == JIM_OK) {
+        *outPattern = Jim_NewListObj(interp, termObjs, n);
+        Jim_IncrRefCount(*outPattern);
+    }
+    for (int i = 0; i < n; i++) {
+        Jim_DecrRefCount(interp, termObjs[i]);
+    }
+    return error;
+}
+
+// __desugarWhen pattern body: returns the statement to Say (minus the
+// envStack), as well as all bound variable names.
+static int __desugarWhenFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    assert(argc == 3);
+    PatternParse* parse = patternParseMemoized(interp, &whenPatternParseMemo,
+                                               argv[1], false);
+    Jim_Obj* pattern;
+    if (patternParseSubstPattern(interp, parse, &pattern) != JIM_OK) {
+        return JIM_ERR;
+    }
+
+    Jim_Obj* body = argv[2];
+    if (parse->remainingPattern != NULL) {
+        // Desugar the join into nested Whens.
+        body = Jim_NewListObj(interp, NULL, 0);
+        Jim_ListAppendElement(interp, body, Jim_NewStringObj(interp, "When", -1));
+        Jim_ListAppendList(interp, body, parse->remainingPattern);
+        Jim_ListAppendElement(interp, body, argv[2]);
+    }
+
+    Jim_Obj* statement = Jim_NewListObj(interp, NULL, 0);
+    Jim_ListAppendElement(interp, statement, Jim_NewStringObj(interp, "when", -1));
+    if (parse->isNegated) {
+        Jim_Obj* negateBodyObjv[] = {
+            Jim_NewStringObj(interp, "if", -1),
+            Jim_NewStringObj(interp, "[llength $__results] == 0", -1),
+            body
+        };
+        const char* prefix[] = {"the", "collected", "results", "for"};
+        for (int i = 0; i < 4; i++) {
+            Jim_ListAppendElement(interp, statement, Jim_NewStringObj(interp, prefix[i], -1));
+        }
+        Jim_ListAppendElement(interp, statement, pattern);
+        Jim_ListAppendElement(interp, statement, Jim_NewStringObj(interp, "are", -1));
+        Jim_ListAppendElement(interp, statement, Jim_NewStringObj(interp, "/__results/", -1));
+        Jim_ListAppendElement(interp, statement, Jim_NewListObj(interp, negateBodyObjv, 3));
+    } else {
+        Jim_ListAppendList(interp, statement, pattern);
+        Jim_ListAppendElement(interp, statement, body);
+    }
+    Jim_ListAppendElement(interp, statement, Jim_NewStringObj(interp, "with", -1));
+    Jim_ListAppendElement(interp, statement, Jim_NewStringObj(interp, "environment", -1));
+
+    Jim_Obj* result[] = { statement, parse->boundVarNames };
+    Jim_SetResult(interp, Jim_NewListObj(interp, result, 2));
+    Jim_DecrRefCount(interp, pattern);
+    return JIM_OK;
+}
+// __parseQuery args: returns [list isAtomically isNegated pattern
+// remainingPattern] for the arguments to Query!. remainingPattern is
+// empty if there is no join.
+static int __parseQueryFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    assert(argc == 2);
+    PatternParse* parse = patternParseMemoized(interp, &queryPatternParseMemo,
+                                               argv[1], true);
+    Jim_Obj* pattern;
+    if (patternParseSubstPattern(interp, parse, &pattern) != JIM_OK) {
+        return JIM_ERR;
+    }
+
+    Jim_Obj* result[] = {
+        Jim_NewIntObj(interp, parse->isAtomically),
+        Jim_NewIntObj(interp, parse->isNegated),
+        pattern,
+        parse->remainingPattern != NULL ? parse->remainingPattern :
+            Jim_NewListObj(interp, NULL, 0)
+    };
+    Jim_SetResult(interp, Jim_NewListObj(interp, result, 4));
+    Jim_DecrRefCount(interp, pattern);
+    return JIM_OK;
+}
 static int __currentMatchRefFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
     assert(argc == 1);
     if (self->currentMatch == NULL) {
@@ -586,6 +1062,25 @@ static int __currentMatchRefFunc(Jim_Interp *interp, int argc, Jim_Obj *const *a
     Jim_SetResultString(interp, ret, strlen(ret));
     return JIM_OK;
 }
+// Returns the ref of the statement that the current When matched
+// (as "s<idx>:<gen>"), or empty outside a When.
+static int __currentMatchStatementRefFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    assert(argc == 1);
+    StatementRef stmtRef = STATEMENT_REF_NULL;
+    mutexLock(&self->currentItemMutex);
+    if (self->currentItem.op == RUN_WHEN) {
+        stmtRef = self->currentItem.runWhen.stmt;
+    }
+    mutexUnlock(&self->currentItemMutex);
+
+    if (statementRefIsNull(stmtRef)) {
+        Jim_SetEmptyResult(interp);
+        return JIM_OK;
+    }
+    char ret[100]; snprintf(ret, 100, "s%d:%d", stmtRef.idx, stmtRef.gen);
+    Jim_SetResultString(interp, ret, strlen(ret));
+    return JIM_OK;
+}
 static int __statementIncompleteChildMatchesCountFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
     assert(argc == 2);
     StatementRef ref;
@@ -634,6 +1129,52 @@ static int __isTracyEnabledFunc(Jim_Interp *interp, int argc, Jim_Obj *const *ar
 #endif
     return JIM_OK;
 }
+// __hashString s: 64-bit FNV-1a hash of s as 16 hex digits. Used to
+// content-address compiled C modules (see lib/c.tcl).
+static int __hashStringFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    assert(argc == 2);
+    int len; const char* s = Jim_GetString(argv[1], &len);
+    uint64_t hash = fnv1a(FNV1A_INIT, s, len);
+    char ret[17]; snprintf(ret, sizeof(ret), "%016" PRIx64, hash);
+    Jim_SetResultString(interp, ret, 16);
+    return JIM_OK;
+}
+// __nextSerialForKey key: returns 0 the first time it's called with
+// key in this process (from any thread), then 1, 2, ...
+static pthread_mutex_t serialsMutex = PTHREAD_MUTEX_INITIALIZER;
+static struct { char* key; int value; }* serials;
+static int __nextSerialForKeyFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    assert(argc == 2);
+    const char* key = Jim_String(argv[1]);
+    pthread_mutex_lock(&serialsMutex);
+    if (serials == NULL) { sh_new_strdup(serials); }
+    int serial = shget(serials, key);
+    shput(serials, key, serial + 1);
+    pthread_mutex_unlock(&serialsMutex);
+    Jim_SetResultInt(interp, serial);
+    return JIM_OK;
+}
+// __loadCModule path cid: loads a module compiled by lib/c.tcl into
+// this thread's interpreter, registering its commands as <C:cid> ...
+static int __loadCModuleFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    assert(argc == 3);
+    const char* path = Jim_String(argv[1]);
+    void* handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        Jim_SetResultFormatted(interp, "error loading C module \"%s\": %s",
+                               path, dlerror());
+        return JIM_ERR;
+    }
+    int (*init)(Jim_Interp*, const char*) = dlsym(handle, "__folkCModuleInit");
+    if (init == NULL) {
+        Jim_SetResultFormatted(interp, "No __folkCModuleInit symbol found in %s", path);
+        dlclose(handle);
+        return JIM_ERR;
+    }
+    // We never dlclose a successfully loaded module, since its
+    // commands may be live in other threads.
+    return init(interp, Jim_String(argv[2]));
+}
 static int __dbFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
     char ret[100]; snprintf(ret, 100, "(Db*) %p", db);
     Jim_SetResultString(interp, ret, strlen(ret));
@@ -643,14 +1184,56 @@ static int __threadIdFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
     Jim_SetResultInt(interp, self->index);
     return JIM_OK;
 }
+// Process-wide counters for benchmarks (see bench/harness.tcl):
+// statements ever created, CPU time (user + system) and peak RSS.
+static int __evaluatorStatsFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    int64_t cpuNs =
+        ((int64_t)usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000 +
+        ((int64_t)usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000;
+#ifdef __APPLE__
+    int64_t peakRssKb = usage.ru_maxrss / 1024; // bytes on macOS
+#else
+    int64_t peakRssKb = usage.ru_maxrss;
+#endif
+
+    Jim_Obj *result = Jim_NewDictObj(interp, NULL, 0);
+    Jim_DictAddElement(interp, result, Jim_NewStringObj(interp, "statementsCreated", -1),
+                       Jim_NewIntObj(interp, dbStatementsCreatedCount(db)));
+    Jim_DictAddElement(interp, result, Jim_NewStringObj(interp, "cpuNs", -1),
+                       Jim_NewIntObj(interp, cpuNs));
+    Jim_DictAddElement(interp, result, Jim_NewStringObj(interp, "peakRssKb", -1),
+                       Jim_NewIntObj(interp, peakRssKb));
+    Jim_SetResult(interp, result);
+    return JIM_OK;
+}
+
+// __setWorkerAffinity bool: turns worker affinity on or off.
+static int __setWorkerAffinityFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    if (argc != 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "enabled");
+        return JIM_ERR;
+    }
+    int enabled;
+    if (Jim_GetBoolean(interp, argv[1], &enabled) != JIM_OK) { return JIM_ERR; }
+    workerAffinityEnabled = enabled;
+    return JIM_OK;
+}
 
 static int __setFreshAtomicallyVersionOnKeyFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
     assert(argc == 2);
     const char* key = Jim_String(argv[1]);
+    // The fresh version comes with a reference for this thread, so
+    // drop the one we had on the version we were running in.
+    AtomicallyVersion* oldAtomicallyVersion = self->currentAtomicallyVersion;
     self->currentAtomicallyVersion =
         dbFreshAtomicallyVersionOnKey(db, key,
                                       matchRef(db, self->currentMatch));
-    matchSetAtomicallyVersion(self->currentMatch, self->currentAtomicallyVersion);
+    if (oldAtomicallyVersion != NULL) {
+        dbAtomicallyVersionRelease(db, oldAtomicallyVersion);
+    }
+    matchSetAtomicallyVersion(db, self->currentMatch, self->currentAtomicallyVersion);
     return JIM_OK;
 }
 static int __currentAtomicallyVersionFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
@@ -684,6 +1267,9 @@ static int exitFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
     // Ignore SIGTRAP so pthread_cancel doesn't cause EXC_BREAKPOINT.
     fflush(stdout);
     fflush(stderr);
+    // _exit won't run the atexit handlers that flush these.
+    outputRedirectionFlush();
+    recordTick();
     close(STDOUT_FILENO);
     close(STDERR_FILENO);
     signal(SIGTRAP, SIG_IGN);
@@ -692,8 +1278,32 @@ static int exitFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
     return JIM_OK;
 }
 
+// Frees this thread's interpreter and everything cached against it
+// (for a worker that's retiring).
+static void interpTeardown() {
+    for (int i = 0; i < CLAUSE_OBJ_CACHE_SIZE; i++) {
+        if (clauseObjCache[i].obj != NULL) {
+            Jim_DecrRefCount(interp, clauseObjCache[i].obj);
+        }
+    }
+    free(clauseObjCache);
+    clauseObjCache = NULL;
+
+    PatternParseMemoEntry** memos[] = { &whenPatternParseMemo, &queryPatternParseMemo };
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < shlen(*memos[i]); j++) {
+            patternParseFree(interp, (*memos[i])[j].value);
+        }
+        shfree(*memos[i]);
+    }
+
+    Jim_FreeInterp(interp);
+    interp = NULL;
+}
+
 static void interpBoot() {
     interp = Jim_CreateInterp();
+    clauseObjCache = calloc(CLAUSE_OBJ_CACHE_SIZE, sizeof(ClauseObjCacheEntry));
     Jim_RegisterCoreCommands(interp);
     Jim_InitStaticExtensions(interp);
 
@@ -704,6 +1314,7 @@ static void interpBoot() {
     Jim_CreateCommand(interp, "HoldStatementGlobally!", HoldStatementGloballyFunc, NULL, NULL);
 
     Jim_CreateCommand(interp, "NotifyImpl", NotifyFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "NotifyBatchImpl", NotifyBatchFunc, NULL, NULL);
 
     Jim_CreateCommand(interp, "SayWithSource", SayWithSourceFunc, NULL, NULL);
     Jim_CreateCommand(interp, "Destructor", DestructorFunc, NULL, NULL);
@@ -717,13 +1328,40 @@ static void interpBoot() {
     Jim_CreateCommand(interp, "__scanVariable", __scanVariableFunc, NULL, NULL);
     Jim_CreateCommand(interp, "__variableNameIsNonCapturing", __variableNameIsNonCapturingFunc, NULL, NULL);
     Jim_CreateCommand(interp, "__startsWithDollarSign", __startsWithDollarSignFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "__desugarWhen", __desugarWhenFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "__parseQuery", __parseQueryFunc, NULL, NULL);
     Jim_CreateCommand(interp, "__currentMatchRef", __currentMatchRefFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "__currentMatchStatementRef", __currentMatchStatementRefFunc, NULL, NULL);
     Jim_CreateCommand(interp, "__statementIncompleteChildMatchesCount", __statementIncompleteChildMatchesCountFunc, NULL, NULL);
     Jim_CreateCommand(interp, "__whenOfCurrentMatchIncompleteChildMatchesCount", __whenOfCurrentMatchIncompleteChildMatchesCountFunc, NULL, NULL);
     Jim_CreateCommand(interp, "__isInSubscription", __isInSubscriptionFunc, NULL, NULL);
 
     Jim_CreateCommand(interp, "__isTracyEnabled", __isTracyEnabledFunc, NULL, NULL);
     Jim_CreateCommand(interp, "__blockRuntimeStats", __blockRuntimeStatsFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "__queryProfileStats", __queryProfileStatsFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "__queryProfileSetSampling", __queryProfileSetSamplingFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "__queryProfileReset", __queryProfileResetFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "__eventTraceJson", __eventTraceJsonFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "__reactionLatencyStats", __reactionLatencyStatsFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "__reactionLatencyTotal", __reactionLatencyTotalFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "__evaluatorStats", __evaluatorStatsFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "__setWorkerAffinity", __setWorkerAffinityFunc, NULL, NULL);
+
+    Jim_CreateCommand(interp, "__hashString", __hashStringFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "__nextSerialForKey", __nextSerialForKeyFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "__loadCModule", __loadCModuleFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "__compile", __compileFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "__compilePoolStats", __compilePoolStatsFunc, NULL, NULL);
+
+    Jim_CreateCommand(interp, "__bootTraceEnabled", __bootTraceEnabledFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "__bootTraceHeld", __bootTraceHeldFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "__bootTraceSpan", __bootTraceSpanFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "__bootTraceFinish", __bootTraceFinishFunc, NULL, NULL);
+
+    Jim_CreateCommand(interp, "__recordStart", __recordStartFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "__recordStop", __recordStopFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "__replayStart", __replayStartFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "__replayDump", __replayDumpFunc, NULL, NULL);
 
     Jim_CreateCommand(interp, "__db", __dbFunc, NULL, NULL);
     Jim_CreateCommand(interp, "__threadId", __threadIdFunc, NULL, NULL);
@@ -757,9 +1395,27 @@ void eval(const char* code) {
 
 void workerExit();
 
-static int runBlock(Clause* bodyPattern, Clause* toUnifyWith, const Term* body,
+// Block stats ids are interned lazily, the first time a given When
+// (or subscribe) statement runs, and then kept on the statement.
+static int statementBlockStatsIdOrIntern(Statement* stmt) {
+    int id = statementBlockStatsId(stmt);
+    if (id < 0) {
+        id = blockStatsIntern(statementSourceFileName(stmt),
+                              statementSourceLineNumber(stmt));
+        statementSetBlockStatsId(stmt, id);
+    }
+    return id;
+}
+
+// toUnifyWithObj is an optional (borrowed) list object for
+// toUnifyWith.
+static int runBlock(Clause* bodyPattern, Clause* toUnifyWith, Jim_Obj* toUnifyWithObj,
+                    const Term* body,
                     const char *sourceFileName, int sourceLineNumber,
+                    int blockStatsId,
                     Jim_Obj *envStackObj) {
+    eventTraceSetLocation(blockStatsId);
+
     Jim_Obj *bodyObj = termToJimObj(interp, body);
     // Set the source info for the bodyObj:
     const char *ptr;
@@ -776,7 +1432,8 @@ static int runBlock(Clause* bodyPattern, Clause* toUnifyWith, const Term* body,
     {
         // Figure out all the bound match variables by unifying when &
         // stmt:
-        Environment* env = clauseUnify(interp, bodyPattern, toUnifyWith);
+        Environment* env = clauseUnifyImpl(interp, bodyPattern, NULL,
+                                           toUnifyWith, toUnifyWithObj);
         if (env == NULL) {
             // Unification failed.
             Jim_DecrRefCount(interp, bodyObj);
@@ -827,8 +1484,7 @@ static int runBlock(Clause* bodyPattern, Clause* toUnifyWith, const Term* body,
         };
         int64_t t0 = timestamp_get(CLOCK_MONOTONIC);
         error = Jim_EvalObjVector(interp, sizeof(objv)/sizeof(objv[0]), objv);
-        blockStatsUpdate(sourceFileName, sourceLineNumber,
-                         timestamp_get(CLOCK_MONOTONIC) - t0);
+        blockStatsUpdate(blockStatsId, timestamp_get(CLOCK_MONOTONIC) - t0);
 
 #ifdef TRACY_ENABLE
         ___tracy_emit_zone_end(ctx);
@@ -839,7 +1495,19 @@ static int runBlock(Clause* bodyPattern, Clause* toUnifyWith, const Term* body,
     return error;
 }
 
-static void runWhenBlock(StatementRef whenRef, Clause* whenPattern, StatementRef stmtRef) {
+// Reports an error that a block didn't catch. It's not fatal: the
+// worker goes on to its next item.
+static void reportUncaughtError(const Term* body) {
+    Jim_MakeErrorMessage(interp);
+    const char *errorMessage = Jim_GetString(Jim_GetResult(interp), NULL);
+    int bodyLen = termLen(body);
+    if (bodyLen > 100) bodyLen = 100;
+    fprintf(stderr, "Uncaught error running When (%.*s):\n  %s\n",
+            bodyLen, termPtr(body), errorMessage);
+}
+
+static void runWhenBlock(StatementRef whenRef, Clause* whenPattern, StatementRef stmtRef,
+                         int64_t pushedNs) {
     // Dereference refs. if any fail, then skip this work item.
     // Exception: stmtRef can be a null ref if and only if whenPattern
     // is {}.
@@ -892,6 +1560,9 @@ static void runWhenBlock(StatementRef whenRef, Clause* whenPattern, StatementRef
         self->currentAtomicallyVersion = statementAtomicallyVersion(when);
     }
     if (self->currentAtomicallyVersion != NULL) {
+        // Keep the version alive while we run in it, even if its
+        // statements go away.
+        dbAtomicallyVersionAcquire(self->currentAtomicallyVersion);
         dbAtomicallyVersionInflightIncr(self->currentAtomicallyVersion);
     }
     // We don't want to hang onto these inflight when running the
@@ -903,6 +1574,8 @@ static void runWhenBlock(StatementRef whenRef, Clause* whenPattern, StatementRef
     if (!self->currentMatch) {
         if (self->currentAtomicallyVersion != NULL) {
             dbAtomicallyVersionInflightDecr(db, self->currentAtomicallyVersion);
+            dbAtomicallyVersionRelease(db, self->currentAtomicallyVersion);
+            self->currentAtomicallyVersion = NULL;
         }
 
         statementRelease(db, when);
@@ -914,6 +1587,21 @@ static void runWhenBlock(StatementRef whenRef, Clause* whenPattern, StatementRef
     // make sure this is initialized
     self->inSubscription = false;
 
+    // Whatever this block Says is caused by the same root as
+    // whichever of the statement and the When is newer, since that's
+    // the one whose arrival fired this block (e.g., for a nested
+    // When from a join, the When carries the fresh cause and the
+    // statement it matched may be ancient). A When with no pattern,
+    // like a program's top-level code, is its own cause.
+    Statement* causeStmt = when;
+    if (stmt != NULL && statementCauseNs(stmt) >= statementCauseNs(when)) {
+        causeStmt = stmt;
+    }
+    int64_t causeNs = statementCauseNs(causeStmt);
+    int causeId = statementCauseId(causeStmt);
+    if (causeId < 0) { causeId = statementBlockStatsIdOrIntern(causeStmt); }
+    matchSetCause(self->currentMatch, causeNs, causeId);
+
     assert(whenClause->nTerms >= 5);
 
     // when the time is /t/ /body/ with environment /capturedEnvStack/
@@ -921,13 +1609,32 @@ static void runWhenBlock(StatementRef whenRef, Clause* whenPattern, StatementRef
     const Term* capturedEnvStack = whenClause->terms[whenClause->nTerms - 1];
     Jim_Obj *envStackObj = termToJimObj(interp, capturedEnvStack);
 
-    int error = runBlock(whenPattern, stmtClause, body,
+    Jim_Obj *stmtClauseObj = stmt == NULL ? NULL :
+        statementClauseToJimObj(interp, stmtRef, stmt);
+    BootTraceBlock bootTraceBlock;
+    if (bootTracing) {
+        bootTraceBlockBegin(&bootTraceBlock,
+                            statementSourceFileName(when),
+                            statementSourceLineNumber(when),
+                            stmt == NULL ? NULL : statementSourceFileName(stmt),
+                            stmt == NULL ? NULL : stmtClause);
+    } else {
+        bootTraceBlock.program = -1;
+    }
+    int64_t startNs = timestamp_get(CLOCK_MONOTONIC);
+    int error = runBlock(whenPattern, stmtClause, stmtClauseObj, body,
                          statementSourceFileName(when),
                          statementSourceLineNumber(when),
+                         statementBlockStatsIdOrIntern(when),
                          envStackObj);
+    int64_t endNs = timestamp_get(CLOCK_MONOTONIC);
+    bootTraceBlockEnd(&bootTraceBlock);
+    reactionLatencyRecord(causeId, startNs - pushedNs, endNs - startNs, endNs - causeNs);
 
     if (self->currentAtomicallyVersion != NULL) {
         dbAtomicallyVersionInflightDecr(db, self->currentAtomicallyVersion);
+        dbAtomicallyVersionRelease(db, self->currentAtomicallyVersion);
+        self->currentAtomicallyVersion = NULL;
     }
 
     statementRelease(db, when);
@@ -938,14 +1645,7 @@ static void runWhenBlock(StatementRef whenRef, Clause* whenPattern, StatementRef
     self->currentMatch = NULL;
 
     if (error == JIM_ERR) {
-        Jim_MakeErrorMessage(interp);
-        const char *errorMessage = Jim_GetString(Jim_GetResult(interp), NULL);
-        int bodyLen = termLen(body);
-        if (bodyLen > 100) bodyLen = 100;
-        fprintf(stderr, "Uncaught error running When (%.*s):\n  %s\n",
-                bodyLen, termPtr(body), errorMessage);
-        /* Jim_FreeInterp(interp); */
-        /* exit(EXIT_FAILURE); */
+        reportUncaughtError(body);
 
     } else if (error == JIM_SIGNAL) {
         // FIXME: I think this is the only signal handler path that
@@ -957,7 +1657,7 @@ static void runWhenBlock(StatementRef whenRef, Clause* whenPattern, StatementRef
 
 // Caller is responsible for freeing passed in clauses
 static void runSubscribeBlock(StatementRef subscribeRef, Clause* subscribePattern,
-                              Clause* notifyClause) {
+                              int notifyClausesCount, Clause** notifyClauses) {
     Statement* subscribeStmt = statementAcquire(db, subscribeRef);
     if (subscribeStmt == NULL) {  return; }
 
@@ -971,35 +1671,46 @@ static void runSubscribeBlock(StatementRef subscribeRef, Clause* subscribePatter
     // -> subscribe key x was pressed /lambda/ with environment /capturedEnvStack/
     const Term* body = subscribeClause->terms[subscribeClause->nTerms - 4];
     const Term* capturedEnvStack = subscribeClause->terms[subscribeClause->nTerms - 1];
-    Jim_Obj *envStackObj = termToJimObj(interp, capturedEnvStack);
+    // Parse the env stack once for the batch. runBlock appends the
+    // bound variables to it, so each run gets its own copy.
+    Jim_Obj *capturedEnvStackObj = termToJimObj(interp, capturedEnvStack);
+    Jim_IncrRefCount(capturedEnvStackObj);
+
+    int error = JIM_OK;
+    for (int i = 0; i < notifyClausesCount; i++) {
+        // If this worker gets killed partway through, workerExit
+        // hands the rest of the clauses off.
+        self->currentBatchRest = (WorkQueueItem) {
+            .op = RUN_SUBSCRIBE,
+            .runSubscribe = {
+                .subscribeRef = subscribeRef,
+                .subscribePattern = subscribePattern,
+                .notifyClausesCount = notifyClausesCount - (i + 1),
+                .notifyClauses = notifyClauses + i + 1
+            }
+        };
 
-    int error = runBlock(subscribePattern, notifyClause, body,
+        error = runBlock(subscribePattern, notifyClauses[i], NULL, body,
                          statementSourceFileName(subscribeStmt),
                          statementSourceLineNumber(subscribeStmt),
-                         envStackObj);
+                         statementBlockStatsIdOrIntern(subscribeStmt),
+                         Jim_DuplicateObj(interp, capturedEnvStackObj));
+        // An error in one run doesn't stop the rest of the batch.
+        if (error == JIM_ERR) { reportUncaughtError(body); }
+        else if (error == JIM_SIGNAL) { break; }
+    }
+    Jim_DecrRefCount(interp, capturedEnvStackObj);
 
     self->inSubscription = false;
     statementRelease(db, subscribeStmt);
 
-    // TODO: Remove duplication of this error handling with
-    // runWhenBlock.
-
-    if (error == JIM_ERR) {
-        Jim_MakeErrorMessage(interp);
-        const char *errorMessage = Jim_GetString(Jim_GetResult(interp), NULL);
-        int bodyLen = termLen(body);
-        if (bodyLen > 100) bodyLen = 100;
-        fprintf(stderr, "Fatal (uncaught) error running When (%.*s):\n  %s\n",
-                bodyLen, termPtr(body), errorMessage);
-        Jim_FreeInterp(interp);
-        exit(EXIT_FAILURE);
-
-    } else if (error == JIM_SIGNAL) {
+    if (error == JIM_SIGNAL) {
         // FIXME: I think this is the only signal handler path that
         // actually runs mostly.
         interp->sigmask = 0;
         workerExit();
     }
+    self->currentBatchRest = (WorkQueueItem) { .op = NONE };
 }
 
 // Copies the whenPattern Clause and all terms so it can be owned (and
@@ -1008,7 +1719,9 @@ static void pushRunWhenBlock(StatementRef whenRef, Clause* whenPattern, Statemen
     // TODO: Ideally we wouldn't re-acquire.
     Statement* stmt = statementAcquire(db, whenRef);
     Statement* when = statementAcquire(db, stmtRef);
+    int home = -1;
     if (stmt != NULL) {
+        home = workerAffinityHome(statementBlockStatsIdOrIntern(stmt));
         dbInflightIncr(stmt);
         statementRelease(db, stmt);
     }
@@ -1019,24 +1732,127 @@ static void pushRunWhenBlock(StatementRef whenRef, Clause* whenPattern, Statemen
     
     appropriateWorkQueuePush((WorkQueueItem) {
        .op = RUN_WHEN,
+       .hasHome = home >= 0, .home = home,
        .runWhen = {
            .when = whenRef,
            .whenPattern = clauseDup(whenPattern),
-           .stmt = stmtRef
+           .stmt = stmtRef,
+           .pushedNs = timestamp_get(CLOCK_MONOTONIC)
        }
     });
 }
 
-// Copies the clauses and all their terms so it can be owned (and
-// freed) by the eventual handler of the block.
+// Statements per RUN_WHEN_BATCH work item that a worker will run
+// itself instead of splitting further.
+#define RUN_WHEN_BATCH_GRAIN 8
+
+// Pushes the When with respect to each of stmts as a single
+// RUN_WHEN_BATCH work item, which workers split up as they run it,
+// so a When that matches lots of existing statements doesn't cost a
+// work item and a pattern copy per statement. Copies whenPattern.
+static void pushRunWhenBlocks(StatementRef whenRef, Clause* whenPattern,
+                              int stmtsCount, StatementRef* stmts) {
+    if (stmtsCount == 0) { return; }
+    if (stmtsCount == 1) {
+        pushRunWhenBlock(whenRef, whenPattern, stmts[0]);
+        return;
+    }
+
+    // runWhenBlock decrements both of these once per statement.
+    Statement* when = statementAcquire(db, whenRef);
+    int home = when != NULL ?
+        workerAffinityHome(statementBlockStatsIdOrIntern(when)) : -1;
+    for (int i = 0; i < stmtsCount; i++) {
+        dbInflightIncr(when);
+        Statement* stmt = statementAcquire(db, stmts[i]);
+        if (stmt != NULL) {
+            dbInflightIncr(stmt);
+            statementRelease(db, stmt);
+        }
+    }
+    if (when != NULL) { statementRelease(db, when); }
+
+    RunWhenBatch* batch = malloc(sizeof(RunWhenBatch) +
+                                 stmtsCount*sizeof(StatementRef));
+    batch->rc = 1;
+    batch->when = whenRef;
+    batch->whenPattern = clauseDup(whenPattern);
+    batch->pushedNs = timestamp_get(CLOCK_MONOTONIC);
+    batch->home = home;
+    batch->stmtsCount = stmtsCount;
+    memcpy(batch->stmts, stmts, stmtsCount*sizeof(StatementRef));
+
+    appropriateWorkQueuePush((WorkQueueItem) {
+       .op = RUN_WHEN_BATCH,
+       .hasHome = home >= 0, .home = home,
+       .runWhenBatch = { .batch = batch, .start = 0, .end = stmtsCount }
+    });
+}
+static void runWhenBatchRelease(RunWhenBatch* batch) {
+    if (atomic_fetch_sub(&batch->rc, 1) == 1) {
+        clauseFree(batch->whenPattern);
+        free(batch);
+    }
+}
+static void runWhenBatch(RunWhenBatch* batch, int start, int end) {
+    // Split the back half off onto our own workqueue (where idle
+    // workers can steal it) until what's left is small enough to
+    // just run here.
+    while (end - start > RUN_WHEN_BATCH_GRAIN) {
+        int mid = start + (end - start) / 2;
+        atomic_fetch_add(&batch->rc, 1);
+        appropriateWorkQueuePush((WorkQueueItem) {
+           .op = RUN_WHEN_BATCH,
+           .hasHome = batch->home >= 0, .home = batch->home,
+           .runWhenBatch = { .batch = batch, .start = mid, .end = end }
+        });
+        end = mid;
+    }
+
+    for (int i = start; i < end; i++) {
+        // If this worker gets killed partway through, workerExit
+        // hands the rest of the batch off.
+        self->currentBatchRest = (WorkQueueItem) {
+            .op = RUN_WHEN_BATCH,
+            .hasHome = batch->home >= 0, .home = batch->home,
+            .runWhenBatch = { .batch = batch, .start = i + 1, .end = end }
+        };
+
+        // Each statement looks like its own RUN_WHEN to the block
+        // (and to sysmon's timing).
+        self->currentItemStartTimestamp = timestamp_get(self->clockid);
+        mutexLock(&self->currentItemMutex);
+        self->currentItem = (WorkQueueItem) {
+            .op = RUN_WHEN,
+            .runWhen = {
+                .when = batch->when,
+                .whenPattern = batch->whenPattern,
+                .stmt = batch->stmts[i],
+                .pushedNs = batch->pushedNs
+            }
+        };
+        mutexUnlock(&self->currentItemMutex);
+
+        runWhenBlock(batch->when, batch->whenPattern, batch->stmts[i],
+                     batch->pushedNs);
+    }
+    self->currentBatchRest = (WorkQueueItem) { .op = NONE };
+    runWhenBatchRelease(batch);
+}
+
+// Takes ownership of notifyClauses (an stb_ds array of clauses that
+// the eventual handler of the block frees). Copies subscribePattern.
+// home is the subscribe block's home worker, or -1.
 static void pushRunSubscriptionBlock(StatementRef subscribeRef, Clause* subscribePattern,
-                              Clause* notifyClause) {
+                                     Clause** notifyClauses, int home) {
     appropriateWorkQueuePush((WorkQueueItem) {
        .op = RUN_SUBSCRIBE,
+       .hasHome = home >= 0, .home = home,
        .runSubscribe = {
             .subscribeRef = subscribeRef,
             .subscribePattern = clauseDup(subscribePattern),
-            .notifyClause = clauseDup(notifyClause)
+            .notifyClausesCount = arrlen(notifyClauses),
+            .notifyClauses = notifyClauses
         }
     });
 }
@@ -1153,19 +1969,17 @@ static void reactToNewStatement(StatementRef ref) {
             // Scan the existing statement set for any
             // already-existing matching statements.
             ResultSet* existingMatchingStatements = dbQuery(db, pattern);
-            for (int i = 0; i < existingMatchingStatements->nResults; i++) {
-                pushRunWhenBlock(ref, pattern,
-                                 existingMatchingStatements->results[i]);
-            }
+            pushRunWhenBlocks(ref, pattern,
+                              existingMatchingStatements->nResults,
+                              existingMatchingStatements->results);
             free(existingMatchingStatements);
 
             Clause* claimizedPattern = claimizeClause(pattern);
             if (claimizedPattern) {
                 existingMatchingStatements = dbQuery(db, claimizedPattern);
-                for (int i = 0; i < existingMatchingStatements->nResults; i++) {
-                    pushRunWhenBlock(ref, claimizedPattern,
-                                     existingMatchingStatements->results[i]);
-                }
+                pushRunWhenBlocks(ref, claimizedPattern,
+                                  existingMatchingStatements->nResults,
+                                  existingMatchingStatements->results);
                 free(existingMatchingStatements);
             }
 
@@ -1255,29 +2069,76 @@ static void reactToNewStatement(StatementRef ref) {
     statementRelease(db, stmt);
 }
 
-static void Notify(Clause* toNotify) {
-    // key x was pressed
-    // -> subscribe key x was pressed /lambda/ with environment /__env/
-    Clause* query = subscriptionizeClause(toNotify);
-    ResultSet* rs = dbQuery(db, query);
-
-    for (size_t i = 0; i < rs->nResults; i++) {
-        Statement* subscription = statementAcquire(db, rs->results[i]);
-        if (subscription == NULL) { continue; }
+// Notify stats, published by sysmon: events notified, (event,
+// subscriber) deliveries, and RUN_SUBSCRIBE items pushed for them.
+int64_t _Atomic notifyEventsCount;
+int64_t _Atomic notifyDeliveriesCount;
+int64_t _Atomic notifySubscribeItemsCount;
+
+static void NotifyBatch(int toNotifyCount, Clause** toNotify) {
+    // Subscribe statement ref -> the events it matched, in order
+    // (stb_ds hash map, which also keeps subscribers in the order we
+    // first saw them).
+    struct { uint64_t key; Clause** value; }* batches = NULL;
+    int64_t deliveriesCount = 0;
+    for (int i = 0; i < toNotifyCount; i++) {
+        // key x was pressed
+        // -> subscribe key x was pressed /lambda/ with environment /__env/
+        Clause* query = subscriptionizeClause(toNotify[i]);
+        ResultSet* rs = dbQuerySubscriptions(db, query);
+        for (size_t j = 0; j < rs->nResults; j++) {
+            ptrdiff_t k = hmgeti(batches, rs->results[j].val);
+            if (k < 0) {
+                hmput(batches, rs->results[j].val, NULL);
+                k = hmgeti(batches, rs->results[j].val);
+            }
+            arrput(batches[k].value, clauseDup(toNotify[i]));
+            deliveriesCount++;
+        }
+        free(rs);
+        free(query);
+    }
+
+    int subscribeItemsCount = 0;
+    for (int i = 0; i < hmlen(batches); i++) {
+        StatementRef subscriptionRef = { .val = batches[i].key };
+        Statement* subscription = statementAcquire(db, subscriptionRef);
+        if (subscription == NULL) {
+            // Make sure it's not a dead ref stuck in the index.
+            dbSubscribeIndexPurge(db, subscriptionRef);
+            for (int j = 0; j < arrlen(batches[i].value); j++) {
+                clauseFree(batches[i].value[j]);
+            }
+            arrfree(batches[i].value);
+            continue;
+        }
 
         Clause* subscriptionPattern = unsubscriptionizeClause(statementClause(subscription));
-
-        pushRunSubscriptionBlock(rs->results[i], subscriptionPattern, toNotify);
+        pushRunSubscriptionBlock(subscriptionRef, subscriptionPattern, batches[i].value,
+                                 workerAffinityHome(statementBlockStatsIdOrIntern(subscription)));
         free(subscriptionPattern); // doesn't own any terms.
+        subscribeItemsCount++;
 
         statementRelease(db, subscription);
     }
+    hmfree(batches);
 
-    free(rs);
-    free(query);
+    atomic_fetch_add_explicit(&notifyEventsCount, toNotifyCount, memory_order_relaxed);
+    atomic_fetch_add_explicit(&notifyDeliveriesCount, deliveriesCount, memory_order_relaxed);
+    atomic_fetch_add_explicit(&notifySubscribeItemsCount, subscribeItemsCount, memory_order_relaxed);
+}
+// For replay (record-replay.c), which runs outside any worker.
+void NotifyGlobally(Clause* toNotify) { NotifyBatch(1, &toNotify); }
+
+// Called on a worker that sysmon has marked as surplus, once it's
+// idle: gives back its interpreter's memory and its thread slot.
+static void workerRetire() {
+    self->shouldRetire = false;
+    interpTeardown();
+    workerExit();
 }
 
-void workerRun(WorkQueueItem item) {
+void workerRun(WorkQueueItem item, EventTraceSource source) {
 #ifdef TRACY_ENABLE
     TracyCZoneCtx zone;
     if (item.op == ASSERT) {
@@ -1286,6 +2147,8 @@ void workerRun(WorkQueueItem item) {
         TracyCZoneN(ctx, "RETRACT", 1); zone = ctx;
     } else if (item.op == RUN_WHEN) {
         TracyCZoneN(ctx, "RUN_WHEN", 1); zone = ctx;
+    } else if (item.op == RUN_WHEN_BATCH) {
+        TracyCZoneN(ctx, "RUN_WHEN_BATCH", 1); zone = ctx;
     } else if (item.op == RUN_SUBSCRIBE) {
         TracyCZoneN(ctx, "RUN_SUBSCRIBE", 1); zone = ctx;
     } else if (item.op == EVAL) {
@@ -1295,6 +2158,15 @@ void workerRun(WorkQueueItem item) {
     }
 #endif
 
+    if (item.hasHome) {
+        if (item.home == self->index) {
+            atomic_fetch_add_explicit(&workerAffinityHitsCount, 1, memory_order_relaxed);
+        } else {
+            atomic_fetch_add_explicit(&workerAffinityMissesCount, 1, memory_order_relaxed);
+        }
+    }
+
+    eventTraceBegin(self->index, &item, source);
     self->currentItemStartTimestamp = timestamp_get(self->clockid);
 
     mutexLock(&self->currentItemMutex);
@@ -1312,6 +2184,9 @@ void workerRun(WorkQueueItem item) {
                                         MATCH_REF_NULL, NULL);
         if (stmt != NULL) {
             StatementRef ref = statementRef(db, stmt);
+            if (statementBlockStatsId(stmt) < 0) {
+                statementSetBlockStatsId(stmt, item.assert.sourceLocationId);
+            }
 
             reactToNewStatement(ref);
 
@@ -1329,14 +2204,23 @@ void workerRun(WorkQueueItem item) {
     } else if (item.op == RUN_WHEN) {
         /* printf("  when: %d:%d; stmt: %d:%d\n", item.run.when.idx, item.run.when.gen, */
         /*        item.run.stmt.idx, item.run.stmt.gen); */
-        runWhenBlock(item.runWhen.when, item.runWhen.whenPattern, item.runWhen.stmt);
+        runWhenBlock(item.runWhen.when, item.runWhen.whenPattern, item.runWhen.stmt,
+                     item.runWhen.pushedNs);
         clauseFree(item.runWhen.whenPattern);
 
+    } else if (item.op == RUN_WHEN_BATCH) {
+        runWhenBatch(item.runWhenBatch.batch,
+                     item.runWhenBatch.start, item.runWhenBatch.end);
+
     } else if (item.op == RUN_SUBSCRIBE) {
         runSubscribeBlock(item.runSubscribe.subscribeRef, item.runSubscribe.subscribePattern,
-                          item.runSubscribe.notifyClause);
+                          item.runSubscribe.notifyClausesCount,
+                          item.runSubscribe.notifyClauses);
         clauseFree(item.runSubscribe.subscribePattern);
-        clauseFree(item.runSubscribe.notifyClause);
+        for (int i = 0; i < item.runSubscribe.notifyClausesCount; i++) {
+            clauseFree(item.runSubscribe.notifyClauses[i]);
+        }
+        arrfree(item.runSubscribe.notifyClauses);
 
     } else if (item.op == EVAL) {
         // Used for destructors.
@@ -1354,9 +2238,11 @@ void workerRun(WorkQueueItem item) {
     }
 
     self->currentItemStartTimestamp = 0;
+    self->lastItemEndNs = timestamp_get(CLOCK_MONOTONIC);
     mutexLock(&self->currentItemMutex);
     self->currentItem = (WorkQueueItem) { .op = NONE };
     mutexUnlock(&self->currentItemMutex);
+    eventTraceEnd();
 
 #ifdef TRACY_ENABLE
     TracyCZoneEnd(zone);
@@ -1369,16 +2255,31 @@ void workerRun(WorkQueueItem item) {
     // preempting each other and introduce latency).
     if (self->wasObservedAsBlocked) {
         self->wasObservedAsBlocked = false;
-        // Donate our entire workqueue before we deactivate.
+        // Donate our entire workqueue (and inbox) before we
+        // deactivate.
         while (true) {
             WorkQueueItem item = workQueueTake(self->workQueue);
             if (item.op == NONE) { break; }
             globalWorkQueuePush(item);
         }
+        while (true) {
+            WorkQueueItem item = workerAffinityInboxTake(self);
+            if (item.op == NONE) { break; }
+            globalWorkQueuePush(item);
+        }
 
+        // sysmon may have picked this worker to retire while it was
+        // busy; it only wakes workers it sees as deactivated, so
+        // check after saying we are (see manageWorkerPool).
         self->isDeactivated = true;
+        if (self->shouldRetire) {
+            self->isDeactivated = false;
+            workerRetire();
+        }
         sem_wait(&self->reactivate);
         self->isDeactivated = false;
+        // sysmon might have woken us up just to retire us.
+        if (self->shouldRetire) { workerRetire(); }
     }
 }
 
@@ -1400,12 +2301,22 @@ void traceItem(char* buf, size_t bufsz, WorkQueueItem item) {
                  stmt != NULL ? clauseToString(statementClause(stmt)) : "NULL");
         if (when) statementRelease(db, when);
         if (stmt) statementRelease(db, stmt);
+    } else if (item.op == RUN_WHEN_BATCH) {
+        RunWhenBatch* batch = item.runWhenBatch.batch;
+        Statement* when = statementAcquire(db, batch->when);
+        snprintf(buf, bufsz, "Run when(%.100s) pattern(%.100s) stmts %d to %d (of %d)",
+                 when != NULL ? clauseToString(statementClause(when)) : "NULL",
+                 clauseToString(batch->whenPattern),
+                 item.runWhenBatch.start, item.runWhenBatch.end,
+                 batch->stmtsCount);
+        if (when) statementRelease(db, when);
     } else if (item.op == RUN_SUBSCRIBE) {
         Statement* subscribe = statementAcquire(db, item.runSubscribe.subscribeRef);
-        snprintf(buf, bufsz, "Run subscribe(%.100s) pattern(%.100s) stmt(%.100s)",
+        snprintf(buf, bufsz, "Run subscribe(%.100s) pattern(%.100s) stmt(%.100s) (of %d)",
                  subscribe != NULL ? clauseToString(statementClause(subscribe)) : "NULL",
                  clauseToString(item.runSubscribe.subscribePattern),
-                 clauseToString(item.runSubscribe.notifyClause));
+                 clauseToString(item.runSubscribe.notifyClauses[0]),
+                 item.runSubscribe.notifyClausesCount);
         if (subscribe) statementRelease(db, subscribe);
     } else if (item.op == EVAL) {
         snprintf(buf, bufsz, "Eval");
@@ -1427,11 +2338,14 @@ WorkQueueItem workerSteal() {
         }
     } while (stealee == self->index);
 
-    if (threads[stealee].tid == 0 || threads[stealee].workQueue == NULL) {
-        return (WorkQueueItem) { .op = NONE };
+    WorkQueueItem item = { .op = NONE };
+    if (threads[stealee].tid != 0 && threads[stealee].workQueue != NULL) {
+        item = workQueueSteal(threads[stealee].workQueue);
     }
-
-    return workQueueSteal(threads[stealee].workQueue);
+    if (item.op == NONE && workerAffinityInboxIsStealable(&threads[stealee])) {
+        item = workerAffinityInboxTake(&threads[stealee]);
+    }
+    return item;
 }
 void workerLoop() {
     int64_t schedtick = 0;
@@ -1444,23 +2358,32 @@ void workerLoop() {
         }
 
         WorkQueueItem item = { .op = NONE };
+        EventTraceSource source = EVENT_TRACE_GLOBAL;
         if (schedtick % 61 == 0) {
             item = globalWorkQueueTake();
         }
+        if (item.op == NONE) {
+            item = workerAffinityInboxTake(self);
+            source = EVENT_TRACE_LOCAL;
+        }
         if (item.op == NONE) {
             item = workQueueTake(self->workQueue);
+            source = EVENT_TRACE_LOCAL;
         }
         if (item.op == NONE) {
             item = workerSteal();
+            source = EVENT_TRACE_STOLEN;
         }
         if (item.op == NONE) {
             item = globalWorkQueueTake();
+            source = EVENT_TRACE_GLOBAL;
         }
         if (item.op == NONE) {
+            if (self->shouldRetire) { workerRetire(); }
             continue;
         }
 
-        workerRun(item);
+        workerRun(item, source);
     }
  die:
     // Note that our workqueue should be empty at this point.
@@ -1477,10 +2400,22 @@ void workerInit(int index) {
         self->workQueue = workQueueNew();
         self->currentItem = (WorkQueueItem) { .op = NONE };
         mutexInit(&self->currentItemMutex);
+        self->currentBatchRest = (WorkQueueItem) { .op = NONE };
+
+        struct mpmc_queue* inbox = malloc(sizeof(struct mpmc_queue));
+        mpmc_queue_init(inbox, AFFINITY_INBOX_CAPACITY, &memtype_heap);
+        self->affinityInboxSize = 0;
+        self->affinityInbox = inbox;
 
         self->isDeactivated = false;
         sem_init(&self->reactivate, 0, 0);
+    } else {
+        // The slot's last worker may have retired with a wakeup
+        // still posted.
+        while (sem_trywait(&self->reactivate) == 0) {}
     }
+    self->shouldRetire = false;
+    self->lastItemEndNs = timestamp_get(CLOCK_MONOTONIC);
 
     epochThreadInit();
 
@@ -1497,6 +2432,9 @@ void workerInit(int index) {
 
     self->_allocs = 0;
     self->_frees = 0;
+    self->_allocCount = 0;
+    self->_clauseObjCacheHits = 0;
+    self->_clauseObjCacheMisses = 0;
 
 #ifdef TRACY_ENABLE
     char threadName[100]; snprintf(threadName, 100, "folk-worker-%d", index);
@@ -1515,6 +2453,32 @@ void workerExit() {
     // When body whose Hold!/Say replaces its own match's parent —
     // reactToNewStatement pushes the follow-up RUN_WHEN onto the
     // local queue right before SIGUSR1 tears the worker down.
+    if (self->currentBatchRest.op == RUN_WHEN_BATCH) {
+        if (self->currentBatchRest.runWhenBatch.start <
+            self->currentBatchRest.runWhenBatch.end) {
+            globalWorkQueuePush(self->currentBatchRest);
+        } else {
+            runWhenBatchRelease(self->currentBatchRest.runWhenBatch.batch);
+        }
+        self->currentBatchRest = (WorkQueueItem) { .op = NONE };
+    } else if (self->currentBatchRest.op == RUN_SUBSCRIBE) {
+        // The rest points into the dying item's clauses, which never
+        // get freed now that we won't return to workerRun, so the
+        // requeued item can just take them over.
+        WorkQueueItem rest = self->currentBatchRest;
+        if (rest.runSubscribe.notifyClausesCount > 0) {
+            Clause** notifyClauses = NULL;
+            arrsetcap(notifyClauses, rest.runSubscribe.notifyClausesCount);
+            for (int i = 0; i < rest.runSubscribe.notifyClausesCount; i++) {
+                arrput(notifyClauses, rest.runSubscribe.notifyClauses[i]);
+            }
+            rest.runSubscribe.notifyClauses = notifyClauses;
+            globalWorkQueuePush(rest);
+        } else {
+            clauseFree(rest.runSubscribe.subscribePattern);
+        }
+        self->currentBatchRest = (WorkQueueItem) { .op = NONE };
+    }
     if (self->workQueue != NULL) {
         while (true) {
             WorkQueueItem item = workQueueTake(self->workQueue);
@@ -1522,6 +2486,11 @@ void workerExit() {
             globalWorkQueuePush(item);
         }
     }
+    while (true) {
+        WorkQueueItem item = workerAffinityInboxTake(self);
+        if (item.op == NONE) { break; }
+        globalWorkQueuePush(item);
+    }
 
     // TODO: Clear everything else out?
     self->tid = 0;
@@ -1559,6 +2528,7 @@ void* workerMain(void* arg) {
 void workerSpawn() {
     pthread_t th;
     pthread_create(&th, NULL, workerMain, NULL);
+    pthread_detach(th);
 }
 static void workerInfo(int threadIndex) {
     if (threadIndex >= threadCount || threads[threadIndex].tid == 0) {
@@ -1590,45 +2560,9 @@ static void workerInfo(int threadIndex) {
     printf("Elapsed time: %.3f us\n", elapsed);
 }
 
-void workerReactivateOrSpawn(int64_t msSinceBoot, int targetNotBlockedWorkersCount) {
-    int nLivingThreads = 0;
-    for (int i = 0; i < THREADS_MAX; i++) {
-        if (threads[i].tid != 0) {
-            nLivingThreads++;
-            if (threads[i].isDeactivated) {
-                sem_post(&threads[i].reactivate);
-                return;
-            }
-        }
-    }
-    // Arbitrarily picked: we don't want to have more than 15
-    // background threads hanging around.
-    if (nLivingThreads > targetNotBlockedWorkersCount + 15) {
-        if (msSinceBoot > 10000) {
-            // (Don't print a warning before 10 seconds have elapsed
-            // since boot, because we expect to have to do a lot of
-            // work at startup, and we don't want to spam stderr.)
-            /* fprintf(stderr, "folk: workerReactivateOrSpawn: " */
-            /*         "Not spawning new thread; too many already\n"); */
-        }
-
-        /* { */
-        /*     printf("SPAWN NEW WORKER\n" */
-        /*            "============================\n"); */
-        /*     for (int i = 0; i < THREADS_MAX; i++) { */
-        /*         printf("\nthread %d\n" */
-        /*                "------------------\n", i); */
-        /*         workerInfo(i); */
-        /*     } */
-        /* } */
-
-        return;
-    }
-    fprintf(stderr, "folk: workerReactivateOrSpawn: Worker spawn\n");
-    workerSpawn();
-}
-
 void *webDebugAllocator(void *ptr, size_t size) {
+    // Non-worker threads (sysmon, threads spawned by C modules) have
+    // no control block, so their allocations go uncounted.
     if (size == 0) {
         if (ptr == NULL) { return NULL; }
 
@@ -1639,16 +2573,16 @@ void *webDebugAllocator(void *ptr, size_t size) {
             return NULL;
         }
         size_t allocSize = *(size_t*)((char*)ptr - sizeof(size_t));
-        self->_frees += allocSize;
+        if (self) { self->_frees += allocSize; }
         free((char*)ptr - 4 - sizeof(size_t));
         return NULL;
     }
     else if (ptr) {
         size_t oldSize = *(size_t*)((char*)ptr - sizeof(size_t));
-        self->_frees += oldSize;
+        if (self) { self->_frees += oldSize; }
         void *newAlloc = realloc((char*)ptr - 4 - sizeof(size_t), size + 4 + sizeof(size_t)) + 4 + sizeof(size_t);
         *(size_t*)((char*)newAlloc - sizeof(size_t)) = size;
-        self->_allocs += size;
+        if (self) { self->_allocs += size; }
         return newAlloc;
     }
     else {
@@ -1656,7 +2590,10 @@ void *webDebugAllocator(void *ptr, size_t size) {
         if (allocation) {
             *(uint32_t*)allocation = 0xBABE;
             *(size_t*)((char*)allocation + 4) = size;
-            self->_allocs += size;
+            if (self) {
+                self->_allocs += size;
+                self->_allocCount++;
+            }
             return (char*)allocation + 4 + sizeof(size_t);
         }
         return NULL;
@@ -1683,10 +2620,46 @@ void *tracyDebugAllocator(void *ptr, size_t size) {
 }
 #endif
 
+#ifdef __linux__
+// Parses a CPU list like `2-5,7` (as in taskset -c) into cpus.
+static bool parseCpuList(const char* s, cpu_set_t* cpus) {
+    CPU_ZERO(cpus);
+    while (*s != '\0') {
+        char* end;
+        long first = strtol(s, &end, 10);
+        if (end == s || first < 0) { return false; }
+        long last = first;
+        s = end;
+        if (*s == '-') {
+            s++;
+            last = strtol(s, &end, 10);
+            if (end == s || last < first) { return false; }
+            s = end;
+        }
+        if (last >= CPU_SETSIZE) { return false; }
+        for (long cpu = first; cpu <= last; cpu++) { CPU_SET(cpu, cpus); }
+        if (*s == ',') { s++; }
+        else if (*s != '\0') { return false; }
+    }
+    return CPU_COUNT(cpus) > 0;
+}
+#endif
+
 int main(int argc, char** argv) {
     // Do all setup.
 
-    // Jim_Allocator = webDebugAllocator;
+    // Set FOLK_DEBUG_ALLOCATOR to count Jim allocations per worker
+    // (shown on the web threads page). This must happen before any
+    // Jim object is allocated.
+    if (getenv("FOLK_DEBUG_ALLOCATOR") != NULL) {
+        Jim_Allocator = webDebugAllocator;
+    }
+
+    // Set FOLK_WORKER_AFFINITY=1 to keep each When running on the
+    // same worker where possible (see workerAffinityHome).
+    if (getenv("FOLK_WORKER_AFFINITY") != NULL) {
+        workerAffinityEnabled = atoi(getenv("FOLK_WORKER_AFFINITY")) != 0;
+    }
 
     outputRedirectionInit();
 
@@ -1697,6 +2670,11 @@ int main(int argc, char** argv) {
 
     globalWorkQueueInit();
     blockStatsInit();
+    queryProfileInit();
+    eventTraceInit();
+    compilePoolInit();
+    bootTraceInit();
+    recordInit();
 
 #ifdef __linux__
     // Count CPUs so we can set up the thread pool to align with the
@@ -1707,7 +2685,26 @@ int main(int argc, char** argv) {
     // printf("main: CPU_COUNT = %d\n", cpuCount);
     assert(cpuCount >= 2);
 
-    int cpuUsableCount = cpuCount - 1; // will exclude CPU 0 later.
+    // Workers run on every CPU but CPU 0 (see below), or on the
+    // CPUs in FOLK_WORKER_CPUS (a list like `2-5,7`) if it's set, so
+    // you can keep cores free for things like camera and GPU
+    // threads. Either way, that's the CPU budget that sysmon sizes
+    // the worker pool for.
+    cpu_set_t workerCs = cs;
+    CPU_CLR(0, &workerCs);
+    const char* workerCpus = getenv("FOLK_WORKER_CPUS");
+    if (workerCpus != NULL) {
+        if (!parseCpuList(workerCpus, &workerCs)) {
+            fprintf(stderr, "folk: Invalid FOLK_WORKER_CPUS: %s\n", workerCpus);
+            exit(1);
+        }
+        CPU_AND(&workerCs, &workerCs, &cs);
+        if (CPU_COUNT(&workerCs) == 0) {
+            fprintf(stderr, "folk: FOLK_WORKER_CPUS (%s) has no usable CPUs\n", workerCpus);
+            exit(1);
+        }
+    }
+    int cpuUsableCount = CPU_COUNT(&workerCs);
 #else
     // HACK: for macOS.
     int cpuUsableCount = 8;
@@ -1719,17 +2716,17 @@ int main(int argc, char** argv) {
         // interpreter. It's just pure C. It's also guaranteed(?) to
         // not run more than every few milliseconds, so it's ok to let
         // it run on the free core.
-        sysmonInit(cpuUsableCount > 5 ? 5 : cpuUsableCount);
+        sysmonInit(cpuUsableCount > 5 ? 5 : cpuUsableCount, cpuUsableCount);
         pthread_t sysmonTh;
         pthread_create(&sysmonTh, NULL, sysmonMain, NULL);
     }
 
 #ifdef __linux__
-    // Disable CPU 0 entirely; we will leave it to Linux. Goal:
-    // exclude one CPU from Folk, so that Linux can still accept ssh
-    // connections and stuff like that if Folk goes off the rails.
-    CPU_CLR(0, &cs);
-    sched_setaffinity(0, sizeof(cs), &cs);
+    // By default, disable CPU 0 entirely; we will leave it to
+    // Linux. Goal: exclude one CPU from Folk, so that Linux can still
+    // accept ssh connections and stuff like that if Folk goes off the
+    // rails. Workers spawned from here on inherit this mask.
+    sched_setaffinity(0, sizeof(workerCs), &workerCs);
 #endif
 
     threadCount = 1; // i.e., this current thread.
@@ -1750,6 +2747,10 @@ int main(int argc, char** argv) {
 
     workerInit(0);
 
+    // If FOLK_REPLAY is set, start feeding in the recording. Its
+    // timestamps are relative to process start, like the recorder's.
+    replayInit();
+
     // We run the boot program in a fake context so that it can run
     // When/Claim/Wish right away _and_ is still running on the main
     // thread (so that on Apple platforms, it can set up the
@@ -0,0 +1,86 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+// Log-linear (HDR-style) latency histogram, for reporting tail
+// latency and not just averages. Everything under
+// 2^HISTOGRAM_MIN_EXP ns (~1µs) goes in bucket 0; then each power of
+// 2 up to 2^HISTOGRAM_MAX_EXP ns (~34s) is split into
+// HISTOGRAM_SUB_BUCKETS linear sub-buckets, so a bucket is at most
+// 1/8 wider than its lower bound.
+//
+// Meant to be written by one thread (histogramRecord uses plain
+// reads + relaxed atomic stores) and merged by others
+// (histogramMerge uses relaxed atomic loads), so it needs no locks.
+#define HISTOGRAM_MIN_EXP 10
+#define HISTOGRAM_MAX_EXP 35
+#define HISTOGRAM_SUB_BITS 3
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS \
+    (1 + (HISTOGRAM_MAX_EXP - HISTOGRAM_MIN_EXP + 1) * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct Histogram {
+    uint64_t count;
+    uint64_t totalNs;
+    uint64_t maxNs;
+    uint32_t buckets[HISTOGRAM_BUCKETS];
+} Histogram;
+
+static inline int histogramBucketOf(uint64_t ns) {
+    if (ns < (1ull << HISTOGRAM_MIN_EXP)) { return 0; }
+    int exp = 63 - __builtin_clzll(ns);
+    if (exp > HISTOGRAM_MAX_EXP) { return HISTOGRAM_BUCKETS - 1; }
+    int sub = (ns >> (exp - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return 1 + (exp - HISTOGRAM_MIN_EXP) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+// Upper bound (exclusive) of the values that land in bucket.
+static inline uint64_t histogramBucketUpperBound(int bucket) {
+    if (bucket == 0) { return 1ull << HISTOGRAM_MIN_EXP; }
+    int exp = (bucket - 1) / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_MIN_EXP;
+    int sub = (bucket - 1) % HISTOGRAM_SUB_BUCKETS;
+    return (uint64_t)(HISTOGRAM_SUB_BUCKETS + sub + 1) << (exp - HISTOGRAM_SUB_BITS);
+}
+
+static inline void histogramRecord(Histogram* h, int64_t ns) {
+    if (ns < 0) { ns = 0; }
+    int bucket = histogramBucketOf(ns);
+    __atomic_store_n(&h->buckets[bucket], h->buckets[bucket] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->totalNs, h->totalNs + ns, __ATOMIC_RELAXED);
+    if ((uint64_t)ns > h->maxNs) { __atomic_store_n(&h->maxNs, ns, __ATOMIC_RELAXED); }
+    __atomic_store_n(&h->count, h->count + 1, __ATOMIC_RELAXED);
+}
+
+// Adds `from` (which may be concurrently written) into `into` (which
+// is private to the caller). into->count is recomputed from the
+// buckets, so percentiles are consistent with it even if the writer
+// is mid-update.
+static inline void histogramMerge(Histogram* into, const Histogram* from) {
+    into->totalNs += __atomic_load_n(&from->totalNs, __ATOMIC_RELAXED);
+    uint64_t maxNs = __atomic_load_n(&from->maxNs, __ATOMIC_RELAXED);
+    if (maxNs > into->maxNs) { into->maxNs = maxNs; }
+    into->count = 0;
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        into->buckets[b] += __atomic_load_n(&from->buckets[b], __ATOMIC_RELAXED);
+        into->count += into->buckets[b];
+    }
+}
+
+// Returns the upper bound of the bucket containing the p-th
+// percentile (clamped to the max).
+static inline uint64_t histogramPercentile(const Histogram* h, double p) {
+    if (h->count == 0) { return 0; }
+    uint64_t rank = (uint64_t)(p * h->count);
+    if (rank >= h->count) { rank = h->count - 1; }
+    uint64_t seen = 0;
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen > rank) {
+            uint64_t upper = histogramBucketUpperBound(b);
+            return upper < h->maxNs ? upper : h->maxNs;
+        }
+    }
+    return h->maxNs;
+}
+
+#endif
@@ -619,6 +619,79 @@ C method proc {name arguments rtype body} {
 C method cflags {args} { lappend cflags {*}$args }
 C method endcflags {args} { lappend endcflags {*}$args }
 
+# Compiled modules are cached across runs in a persistent directory
+# ($FOLK_C_CACHE_DIR, default ~/.cache/folk/c; set it to empty to
+# disable the cache), keyed by a hash of the generated source,
+# compiler, and flags. Each entry also records the headers the source
+# included (from the compiler's -MD output), and is only reused if
+# none of them changed since.
+proc cCacheDir {} {
+    if {[info exists ::env(FOLK_C_CACHE_DIR)]} {
+        return $::env(FOLK_C_CACHE_DIR)
+    }
+    if {[info exists ::env(HOME)]} {
+        return "$::env(HOME)/.cache/folk/c"
+    }
+    return ""
+}
+set ::cCompilerVersions [dict create]
+proc cCompilerVersion {compiler} {
+    if {![dict exists $::cCompilerVersions $compiler]} {
+        dict set ::cCompilerVersions $compiler [exec $compiler --version]
+    }
+    dict get $::cCompilerVersions $compiler
+}
+# Returns the cached .so and the time it originally took to compile,
+# or an empty list on a miss.
+proc cCacheLookup {key} {
+    set dir [cCacheDir]
+    if {$dir eq "" || ![file exists $dir/$key.so] || ![file exists $dir/$key.meta]} {
+        return {}
+    }
+    try {
+        set fd [open $dir/$key.meta r]; set meta [read $fd]; close $fd
+        foreach {path mtime size} [dict get $meta deps] {
+            if {![file exists $path] ||
+                [file mtime $path] != $mtime || [file size $path] != $size} {
+                return {}
+            }
+        }
+        return [list $dir/$key.so [dict get $meta compileMs]]
+    } on error e {
+        return {}
+    }
+}
+proc cCacheStore {key so cfile depfile compileMs} {
+    set dir [cCacheDir]
+    if {$dir eq ""} { return }
+    try {
+        set fd [open $depfile r]; set depText [read $fd]; close $fd
+        # The depfile is Makefile syntax: `target.o: src.c dep.h \`.
+        set depText [string map [list "\\\n" " "] $depText]
+        set deps [list]
+        foreach path [lrange [string range $depText [string first ": " $depText] end] 1 end] {
+            if {$path eq $cfile} { continue }
+            lappend deps $path [file mtime $path] [file size $path]
+        }
+
+        file mkdir $dir
+        # Write to temporary files and rename them into place, so
+        # concurrent compiles (and other Folk processes) never see a
+        # partial entry.
+        set tmp $dir/$key.[pid].[__threadId].tmp
+        file copy -force $so $tmp.so
+        set fd [open $tmp.meta w]
+        puts $fd [dict create compileMs $compileMs deps $deps]
+        close $fd
+        file rename -force $tmp.so $dir/$key.so
+        file rename -force $tmp.meta $dir/$key.meta
+    } on error e {
+        puts stderr "C: failed to store $so in compile cache: $e"
+    }
+}
+# Per-thread totals, for logging.
+set ::cCacheStats [dict create hits 0 misses 0 savedMs 0]
+
 C method compile {args} {
     set noload false
     set cid {}
@@ -629,14 +702,116 @@ C method compile {args} {
             set cid $arg
         }
     }
-    set cfile [file tempfile /tmp/cfileXXXXXX].c
+
+    set sourcecode [$self sourcecode]
 
     # A universally unique id that can be used as a global proc name
-    # in every thread.
+    # in every thread. We name it after a hash of the source, so it's
+    # stable across runs; the serial keeps cids unique within this
+    # process, since each loaded module has its own C state.
     if {$cid eq {}} {
-        set cid [file rootname [file tail $cfile]]
+        set sourceHash [__hashString $sourcecode]
+        set cid c${sourceHash}_[__nextSerialForKey $sourceHash]
     }
 
+    set ignoreUnresolved {}; if {$::tcl_platform(os) eq "linux"} {
+        set ignoreUnresolved -Wl,--unresolved-symbols=ignore-all
+    } elseif {$::tcl_platform(os) eq "darwin"} {
+        set ignoreUnresolved -Wl,-undefined,dynamic_lookup
+    }
+    if {[__isTracyEnabled]} {
+        lappend cflags -DTRACY_ENABLE=1 -I./vendor/tracy/public
+    }
+    set asan_flags {}
+    if {[info exists ::env(ASAN_ENABLE)] && $::env(ASAN_ENABLE) != ""} {
+        set asan_flags "-fsanitize=address -fsanitize-recover=address"
+    }
+    set compileFlags [list {*}$asan_flags -Wall \
+                          {*}$($::tcl_platform(os) eq "linux" ? [list -Wno-alloc-size-larger-than] : [list]) \
+                          -U_FORTIFY_SOURCE -O2 -march=native -g \
+                          -fno-omit-frame-pointer -fPIC \
+                          {*}$cflags]
+    set linkFlags [list {*}$asan_flags -shared $ignoreUnresolved -O2]
+
+    set cacheKey [__hashString [list $compiler [cCompilerVersion $compiler] \
+                                    $compileFlags $linkFlags $endcflags \
+                                    $sourcecode]]
+    set cached [cCacheLookup $cacheKey]
+    if {[llength $cached] > 0} {
+        lassign $cached so compileMs
+
+        dict incr ::cCacheStats hits
+        dict incr ::cCacheStats savedMs $compileMs
+        puts stderr "C: cache hit for $cid, saved ${compileMs}ms\
+                     (this thread: [dict get $::cCacheStats hits] hits,\
+                     [dict get $::cCacheStats misses] misses,\
+                     [dict get $::cCacheStats savedMs]ms saved)"
+
+        # Copy (rather than link) so that each cid gets its own
+        # inode, or dlopen would hand back an already-loaded module.
+        file copy -force $so /tmp/$cid.so.[pid].tmp
+        file rename -force /tmp/$cid.so.[pid].tmp /tmp/$cid.so
+    } else {
+        set base [file tempfile /tmp/cfileXXXXXX]
+        set cfile $base.c
+        set cfd [open $cfile w]; puts $cfd $sourcecode; close $cfd
+        set o $base.o
+        set so $base.so
+
+        # Runs on the shared compiler pool, so the number of
+        # concurrent compilers is bounded, and if another thread is
+        # already compiling this exact module, we just wait for (and
+        # get a copy of) its .so. Each cid gets its own copy (and
+        # inode), or dlopen would hand back an already-loaded module.
+        lassign [__bootTraceSpan compile $cid {
+            __compile $cacheKey $so /tmp/$cid.so \
+                [list $compiler {*}$compileFlags \
+                     -MD -MF $base.d \
+                     $cfile -c -o $o] \
+                [list $compiler {*}$linkFlags \
+                     -o $so $o {*}$endcflags]
+        }] status out compileMs isShared
+        if {$status == 0 && !$isShared} {
+            cCacheStore $cacheKey /tmp/$cid.so $cfile $base.d $compileMs
+        }
+        # The compiler pool deletes the .so itself once everyone
+        # sharing it has a copy.
+        file delete $base $cfile $base.d $o
+        if {$status != 0} {
+            error "C compile failed (exit status $status):\n$out"
+        }
+        if {[string trim $out] ne ""} {
+            puts $out
+        }
+
+        if {$isShared} {
+            puts stderr "C: shared in-flight compile for $cid (${compileMs}ms)"
+        } else {
+            dict incr ::cCacheStats misses
+            puts stderr "C: cache miss for $cid, compiled in ${compileMs}ms"
+        }
+    }
+
+    if {$noload} {
+        # Return the name of the compiled file instead of loading it.
+        return /tmp/$cid.so
+    }
+
+    set cInfo [dict create]
+    foreach varName [$self vars] {
+        dict set cInfo $varName [$self get $varName]
+    }
+    
+    # Load the compiled module immediately so we can set its C info.
+    <C:$cid>
+    <C:$cid> __setCInfo $cInfo
+
+    return <C:$cid>
+}
+
+# Returns the full C source for this module. The source doesn't
+# depend on the module's cid, which is only passed in at load time.
+C method sourcecode {} {
     set init [subst {
         #include <string.h>
 
@@ -667,20 +842,26 @@ C method compile {args} {
             return JIM_OK;
         }
 
-        int Jim_${cid}Init(Jim_Interp* intp) {
+        // Called (by __loadCModule) with the module's cid, so that the
+        // compiled module doesn't depend on its cid and can be shared
+        // between identical compiles.
+        int __folkCModuleInit(Jim_Interp* intp, const char* cid) {
             interp = intp;
+            char name\[1000\];
+            char script\[1000\];
 
             [join [lmap srcid $extends {
-                subst {Jim_${srcid}Init(interp);}
+                subst {Jim_${srcid}Init(interp, "$srcid");}
             }] "\n"]
 
-            Jim_CreateCommand(interp, "<C:$cid> __setCInfo", __setCInfo_Cmd, NULL, NULL);
-            Jim_CreateCommand(interp, "<C:$cid> __getCInfo", __getCInfo_Cmd, NULL, NULL);
+            snprintf(name, sizeof(name), "<C:%s> __setCInfo", cid);
+            Jim_CreateCommand(interp, name, __setCInfo_Cmd, NULL, NULL);
+            snprintf(name, sizeof(name), "<C:%s> __getCInfo", cid);
+            Jim_CreateCommand(interp, name, __getCInfo_Cmd, NULL, NULL);
 
             [join [lmap varname [dict keys $vars] {
                 csubst {{
-                    char script[1000];
-                    snprintf(script, 1000, "dict set {::<C:$cid> __addrs} ${varname}_ptr %p", &${varname}_ptr);
+                    snprintf(script, sizeof(script), "dict set {::<C:%s> __addrs} ${varname}_ptr %p", cid, &${varname}_ptr);
                     Jim_Eval(interp, script);
                 }}
             }] "\n"]
@@ -690,22 +871,19 @@ C method compile {args} {
                 set tclname $name
                 # puts "Creating C command: $tclname"
                 csubst {{
-                    char script[1000];
-                    snprintf(script, 1000, "dict set {::<C:$cid> __addrs} $cname %p", $cname);
+                    snprintf(script, sizeof(script), "dict set {::<C:%s> __addrs} $cname %p", cid, $cname);
                     Jim_Eval(interp, script);
 
-                    Jim_CreateCommand(interp, "<C:$cid> $tclname", $[set cname]_Cmd, NULL, NULL);
+                    snprintf(name, sizeof(name), "<C:%s> %s", cid, "$tclname");
+                    Jim_CreateCommand(interp, name, $[set cname]_Cmd, NULL, NULL);
                 }}
             }] "\n"]
 
-            {
-                char script\[1000\];
-                snprintf(script, 1000, "dict set {::<C:$cid> __addrs} Jim_${cid}Init %p", Jim_${cid}Init);
-                Jim_Eval(interp, script);
-            }
+            snprintf(script, sizeof(script), "dict set {::<C:%s> __addrs} Jim_%sInit %p", cid, cid, __folkCModuleInit);
+            Jim_Eval(interp, script);
 
             [join [lmap type [dict keys $objtypes] { subst {
-                ${type}_init(interp, "$cid");
+                ${type}_init(interp, cid);
             } }] "\n"]
             return JIM_OK;
         }
@@ -720,79 +898,19 @@ extern "C" \{
 \}
 #endif
 }]
-    set sourcecode [join [list \
-                              $externC \
-                              $prelude \
-                              $unexternC \
-                              \
-                              {*}[lmap {snippet extend} $code {set snippet}] \
-                              \
-                              $externC \
-                              {*}[dict values $objtypes] \
-                              {*}[lmap p [dict values $procs] {dict get $p code}] \
-                              $init \
-                              $unexternC \
-                             ] "\n"]
-
-    # puts "=====================\n$sourcecode\n====================="
-
-    set cfd [open $cfile w]; puts $cfd $sourcecode; close $cfd
-    set ignoreUnresolved {}; if {$::tcl_platform(os) eq "linux"} {
-        set ignoreUnresolved -Wl,--unresolved-symbols=ignore-all
-    } elseif {$::tcl_platform(os) eq "darwin"} {
-        set ignoreUnresolved -Wl,-undefined,dynamic_lookup
-    }
-    if {[__isTracyEnabled]} {
-        lappend cflags -DTRACY_ENABLE=1 -I./vendor/tracy/public
-    }
-    set asan_flags {}
-    if {[info exists ::env(ASAN_ENABLE)] && $::env(ASAN_ENABLE) != ""} {
-        set asan_flags "-fsanitize=address -fsanitize-recover=address"
-    }
-    set out [exec $compiler {*}$asan_flags -Wall \
-                 {*}$($::tcl_platform(os) eq "linux" ? [list -Wno-alloc-size-larger-than] : [list]) \
-                 -U_FORTIFY_SOURCE -O2 -march=native -g \
-                 -fno-omit-frame-pointer -fPIC \
-                 {*}$cflags $cfile -c -o [file rootname $cfile].o]
-    if {[string trim $out] ne ""} {
-        puts $out
-    }
-
-    # HACK: Why do we need this / only when running in lldb?
-    set n 0
-    while {![file exists [file rootname $cfile].o]} {
-        sleep 0.01
-        incr n
-        if {$n > 1000} { error "Failed on $cfile! Timed out" }
-    }
-
-    exec $compiler {*}$asan_flags -shared $ignoreUnresolved \
-        -O2 -o /tmp/$cid.so [file rootname $cfile].o \
-        {*}$endcflags
-
-    # HACK: Why do we need this / only when running in lldb?
-    set n 0
-    while {![file exists /tmp/$cid.so]} {
-        sleep 0.01
-        incr n
-        if {$n > 200} { error "Failed on /tmp/$cid.so! Timed out" }
-    }
-
-    if {$noload} {
-        # Return the name of the compiled file instead of loading it.
-        return /tmp/$cid.so
-    }
-
-    set cInfo [dict create]
-    foreach varName [$self vars] {
-        dict set cInfo $varName [$self get $varName]
-    }
-    
-    # Load the compiled module immediately so we can set its C info.
-    <C:$cid>
-    <C:$cid> __setCInfo $cInfo
-
-    return <C:$cid>
+    join [list \
+              $externC \
+              $prelude \
+              $unexternC \
+              \
+              {*}[lmap {snippet extend} $code {set snippet}] \
+              \
+              $externC \
+              {*}[dict values $objtypes] \
+              {*}[lmap p [dict values $procs] {dict get $p code}] \
+              $init \
+              $unexternC \
+             ] "\n"
 }
 
 C method import {srclib srcname {_as {}} {destname {}}} {
@@ -850,8 +968,8 @@ C method extend {args} {
 
     regexp {<C:([^ ]+)>} $srclib -> srcid
     set addr [dict get $srcaddrs Jim_${srcid}Init]
-    $self code "int (*Jim_${srcid}Init)(Jim_Interp* intp) =
-                     (int (*)(Jim_Interp* intp)) $addr;"
+    $self code "int (*Jim_${srcid}Init)(Jim_Interp* intp, const char* cid) =
+                     (int (*)(Jim_Interp* intp, const char* cid)) $addr;"
 
     lappend extends $srcid
 }
@@ -6,8 +6,14 @@
 #include <stdarg.h>
 #include <assert.h>
 #include <pthread.h>
+#include <sched.h>
 #include <sys/syscall.h>
 #include <sys/stat.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
 
 #include "vendor/stb_ds.h"
 
@@ -76,6 +82,8 @@ static interpose_t write_interpose[] __attribute__((section("__DATA,__interpose"
 
 #include <jim.h>
 
+#include "common.h"
+
 int realStdout = -1;
 int realStderr = -1;
 
@@ -100,13 +108,344 @@ int folkGetFdOverride(int fd) {
     }
     return fd;
 }
+// Program output isn't buffered on macOS.
+void outputRedirectionFlush(void) {}
 #else
+// Buffered per-program logging (Linux only). Output from When bodies
+// to their program's stdout/stderr file doesn't do a write(2) on the
+// worker thread: it's appended to a lock-free ring owned by the
+// calling thread, and a background writer thread drains all the
+// rings every few milliseconds, coalescing each program file's
+// output into one write(2). Each record carries a global sequence
+// number, and the writer sorts each batch by it, so a program's
+// output stays in order even when its Whens run on different
+// workers. (A drain only takes records numbered below where logSeq
+// was when it started, and first waits out any ring that's still
+// copying in one of those, so a record can't be overtaken by a later
+// one that happened to be published first.) If a ring fills up, its thread drains the rings itself,
+// unless the writer is already mid-drain, in which case the write is
+// dropped and counted (see __logStats). A write too big for the
+// ring drains the rings and then goes out under the flush lock,
+// blocking if the writer is busy, so it stays in order too. Writes
+// that aren't to a program file -- notably
+// ::realStdout and ::realStderr, which fatal messages go to -- are
+// never buffered.
+//
+// Program files are also rotated: once one passes FOLK_LOG_MAX_MB
+// (default 64; 0 to disable), it's renamed to PROGRAM.stdout.1 and
+// a fresh file takes over the same fd.
+
+typedef struct LogRing {
+    struct LogRing* next;
+    uint8_t* buf;
+    uint64_t cap; // power of two
+    // Only the owning thread advances head; only the writer advances
+    // tail. Both count bytes since the ring was made.
+    _Atomic uint64_t head;
+    _Atomic uint64_t tail;
+    // While the owning thread is between taking a sequence number
+    // and publishing its record: 0 until it has the number, then the
+    // number. UINT64_MAX otherwise.
+    _Atomic uint64_t inflightSeq;
+} LogRing;
+
+// Each record in a ring is a header, then len bytes of output, then
+// padding up to a multiple of 8.
+typedef struct LogRecordHeader {
+    uint64_t seq;
+    int32_t fd;
+    uint32_t len;
+} LogRecordHeader;
+#define LOG_RECORD_SIZE(len) ((sizeof(LogRecordHeader) + (len) + 7) & ~(uint64_t)7)
+
+static bool logBuffered;
+static uint64_t logRingCap;
+static int64_t logMaxBytes;
+
+static LogRing* _Atomic logRings;
+static __thread LogRing* threadLogRing;
+// Rings are never freed (the writer walks them without a lock), so
+// each worker slot keeps its ring for whichever worker next takes
+// the slot.
+static LogRing* logRingsBySlot[THREADS_MAX];
+static _Atomic uint64_t logSeq;
+
+static _Atomic int64_t logWrittenBytes;
+static _Atomic int64_t logDroppedWrites;
+static _Atomic int64_t logDroppedBytes;
+static _Atomic int64_t logRotations;
+// Set when output went straight to a file without passing through
+// the rings, so the writer knows to recheck program file sizes.
+static _Atomic bool logDirectWritten;
+
+static void logRingCopyIn(LogRing* ring, uint64_t pos, const void* src, size_t n) {
+    uint64_t off = pos & (ring->cap - 1);
+    size_t first = n < ring->cap - off ? n : ring->cap - off;
+    memcpy(ring->buf + off, src, first);
+    memcpy(ring->buf, (const uint8_t*)src + first, n - first);
+}
+static void logRingCopyOut(LogRing* ring, uint64_t pos, void* dst, size_t n) {
+    uint64_t off = pos & (ring->cap - 1);
+    size_t first = n < ring->cap - off ? n : ring->cap - off;
+    memcpy(dst, ring->buf + off, first);
+    memcpy((uint8_t*)dst + first, ring->buf, n - first);
+}
+
+static void logRingInstall(void) {
+    if (!logBuffered || threadLogRing != NULL) { return; }
+    int slot = self != NULL ? self->index : -1;
+    LogRing* ring = slot >= 0 ? logRingsBySlot[slot] : NULL;
+    if (ring == NULL) {
+        ring = calloc(1, sizeof(LogRing));
+        ring->cap = logRingCap;
+        ring->buf = malloc(ring->cap);
+        ring->inflightSeq = UINT64_MAX;
+        ring->next = atomic_load(&logRings);
+        while (!atomic_compare_exchange_weak(&logRings, &ring->next, ring));
+        if (slot >= 0) { logRingsBySlot[slot] = ring; }
+    }
+    threadLogRing = ring;
+}
+
+static bool logTryFlush(void);
+static void logWriteBehindRings(int fd, const void *buf, size_t count);
+
+// Returns false if the caller should write(2) it directly.
+static bool logBufferedWrite(int fd, const void *buf, size_t count) {
+    LogRing* ring = threadLogRing;
+    if (ring == NULL) { return false; }
+    if (count > ring->cap / 4) {
+        logWriteBehindRings(fd, buf, count);
+        return true;
+    }
+    uint64_t size = LOG_RECORD_SIZE(count);
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (ring->cap - (head - tail) < size) {
+        // Full. Drain it ourselves if the writer isn't already busy
+        // doing that; otherwise, drop this write rather than block.
+        if (logTryFlush()) {
+            tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        }
+        if (ring->cap - (head - tail) < size) {
+            atomic_fetch_add_explicit(&logDroppedWrites, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&logDroppedBytes, count, memory_order_relaxed);
+            return true;
+        }
+    }
+    atomic_store(&ring->inflightSeq, 0);
+    LogRecordHeader hdr = { .seq = atomic_fetch_add(&logSeq, 1),
+                            .fd = fd, .len = count };
+    atomic_store_explicit(&ring->inflightSeq, hdr.seq, memory_order_relaxed);
+    logRingCopyIn(ring, head, &hdr, sizeof(hdr));
+    logRingCopyIn(ring, head + sizeof(hdr), buf, count);
+    atomic_store_explicit(&ring->head, head + size, memory_order_release);
+    atomic_store_explicit(&ring->inflightSeq, UINT64_MAX, memory_order_release);
+    return true;
+}
+
+// Output that skips the rings (nested) still counts in
+// __logStats and toward its file's rotation.
+static ssize_t logDirectWrite(int fd, const void *buf, size_t count) {
+    ssize_t n = (ssize_t)syscall(SYS_write, fd, buf, count);
+    if (n > 0 && logBuffered) {
+        atomic_fetch_add_explicit(&logWrittenBytes, n, memory_order_relaxed);
+        atomic_store_explicit(&logDirectWritten, true, memory_order_relaxed);
+    }
+    return n;
+}
+
 // On Linux, override write() as a strong symbol that takes priority over
 // libc's weak symbol.
 ssize_t write(int fd, const void *buf, size_t count) {
     if (fd == STDOUT_FILENO && threadLocalStdout != -1) fd = threadLocalStdout;
     else if (fd == STDERR_FILENO && threadLocalStderr != -1) fd = threadLocalStderr;
-    return (ssize_t)syscall(SYS_write, fd, buf, count);
+    else return (ssize_t)syscall(SYS_write, fd, buf, count);
+
+    // A signal handler that writes while this thread is in the
+    // middle of buffering would corrupt its ring, so nested writes go
+    // straight through.
+    static __thread bool inLogWrite;
+    if (!inLogWrite) {
+        inLogWrite = true;
+        bool buffered = logBufferedWrite(fd, buf, count);
+        inLogWrite = false;
+        if (buffered) { return count; }
+    }
+    return logDirectWrite(fd, buf, count);
+}
+
+// Everything below belongs to whoever holds logFlushMutex (usually
+// the writer thread).
+static pthread_mutex_t logFlushMutex = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct LogPending { uint64_t seq; int fd; size_t off; uint32_t len; } LogPending;
+static LogPending* logPending;
+static uint8_t* logPendingBytes;
+// fd -> output to write to it this batch.
+static struct { int key; uint8_t* value; }* logOut;
+// fd -> path and size of each program file, for rotation.
+typedef struct LogFile { char* path; int64_t size; } LogFile;
+static struct { int key; LogFile value; }* logFiles;
+static int64_t logReportedDroppedWrites;
+
+static void logFileRegister(int fd, const char* path) {
+    if (fd == -1) { return; }
+    struct stat st;
+    pthread_mutex_lock(&logFlushMutex);
+    LogFile f = { .path = strdup(path),
+                  .size = fstat(fd, &st) == 0 ? st.st_size : 0 };
+    hmput(logFiles, fd, f);
+    pthread_mutex_unlock(&logFlushMutex);
+}
+
+static void logFileRotateIfFull(int fd, LogFile* f) {
+    if (logMaxBytes <= 0 || f->size < logMaxBytes) { return; }
+
+    char oldPath[4096];
+    snprintf(oldPath, sizeof(oldPath), "%s.1", f->path);
+    rename(f->path, oldPath);
+    int newfd = open(f->path, O_WRONLY | O_CREAT | O_APPEND | O_TRUNC, 0644);
+    if (newfd == -1) { return; }
+    // Keep the fd number, since threads (and exec'd children) hold it.
+    dup2(newfd, fd);
+    close(newfd);
+    f->size = 0;
+    atomic_fetch_add_explicit(&logRotations, 1, memory_order_relaxed);
+}
+
+static void logWriteFd(int fd, const uint8_t* data, size_t len) {
+    size_t off = 0;
+    while (off < len) {
+        ssize_t n = syscall(SYS_write, fd, data + off, len - off);
+        if (n <= 0) { break; }
+        off += n;
+    }
+    atomic_fetch_add_explicit(&logWrittenBytes, off, memory_order_relaxed);
+
+    ptrdiff_t i = hmgeti(logFiles, fd);
+    if (i < 0) { return; }
+    logFiles[i].value.size += off;
+    logFileRotateIfFull(fd, &logFiles[i].value);
+}
+
+static int logPendingCompare(const void* a, const void* b) {
+    uint64_t sa = ((const LogPending*)a)->seq, sb = ((const LogPending*)b)->seq;
+    return sa < sb ? -1 : sa > sb;
+}
+
+static void logDrainLocked(void) {
+    arrsetlen(logPending, 0);
+    arrsetlen(logPendingBytes, 0);
+    // Every record numbered below this has been (or is being) copied
+    // into its ring. Later ones wait for the next drain.
+    uint64_t limit = atomic_load(&logSeq);
+    for (LogRing* ring = atomic_load(&logRings); ring != NULL; ring = ring->next) {
+        while (atomic_load_explicit(&ring->inflightSeq, memory_order_acquire) < limit) {
+            sched_yield();
+        }
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        while (tail < head) {
+            LogRecordHeader hdr;
+            logRingCopyOut(ring, tail, &hdr, sizeof(hdr));
+            if (hdr.seq >= limit) { break; }
+            LogPending p = { .seq = hdr.seq, .fd = hdr.fd,
+                             .off = arrlenu(logPendingBytes), .len = hdr.len };
+            logRingCopyOut(ring, tail + sizeof(hdr),
+                           arraddnptr(logPendingBytes, hdr.len), hdr.len);
+            arrput(logPending, p);
+            tail += LOG_RECORD_SIZE(hdr.len);
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+
+    if (arrlen(logPending) > 0) {
+        qsort(logPending, arrlen(logPending), sizeof(LogPending), logPendingCompare);
+        for (int i = 0; i < arrlen(logPending); i++) {
+            LogPending* p = &logPending[i];
+            ptrdiff_t j = hmgeti(logOut, p->fd);
+            if (j < 0) { hmput(logOut, p->fd, NULL); j = hmgeti(logOut, p->fd); }
+            memcpy(arraddnptr(logOut[j].value, p->len),
+                   logPendingBytes + p->off, p->len);
+        }
+        for (int j = 0; j < hmlen(logOut); j++) {
+            if (arrlen(logOut[j].value) == 0) { continue; }
+            logWriteFd(logOut[j].key, logOut[j].value, arrlenu(logOut[j].value));
+            arrsetlen(logOut[j].value, 0);
+        }
+    }
+
+    // Direct writes didn't go through logWriteFd, so catch the
+    // program files' sizes up with them.
+    if (atomic_exchange_explicit(&logDirectWritten, false, memory_order_relaxed)) {
+        for (int i = 0; i < hmlen(logFiles); i++) {
+            struct stat st;
+            if (fstat(logFiles[i].key, &st) == 0) { logFiles[i].value.size = st.st_size; }
+            logFileRotateIfFull(logFiles[i].key, &logFiles[i].value);
+        }
+    }
+
+    int64_t dropped = atomic_load_explicit(&logDroppedWrites, memory_order_relaxed);
+    if (dropped != logReportedDroppedWrites) {
+        // Goes to OTHER.stderr.
+        char msg[256];
+        int n = snprintf(msg, sizeof(msg),
+                         "output-redirection: log buffer full; %" PRId64 " writes (%" PRId64
+                         " bytes) dropped so far\n",
+                         dropped, (int64_t)atomic_load(&logDroppedBytes));
+        syscall(SYS_write, STDERR_FILENO, msg, n);
+        logReportedDroppedWrites = dropped;
+    }
+}
+
+void outputRedirectionFlush(void) {
+    if (!logBuffered) { return; }
+    pthread_mutex_lock(&logFlushMutex);
+    logDrainLocked();
+    pthread_mutex_unlock(&logFlushMutex);
+}
+
+static bool logTryFlush(void) {
+    if (pthread_mutex_trylock(&logFlushMutex) != 0) { return false; }
+    logDrainLocked();
+    pthread_mutex_unlock(&logFlushMutex);
+    return true;
+}
+
+// For writes too big for a ring: writes out everything ahead of it,
+// then it.
+static void logWriteBehindRings(int fd, const void *buf, size_t count) {
+    pthread_mutex_lock(&logFlushMutex);
+    logDrainLocked();
+    logWriteFd(fd, buf, count);
+    pthread_mutex_unlock(&logFlushMutex);
+}
+
+static void* logWriterMain(void* arg) {
+    for (;;) {
+        usleep(5000);
+        outputRedirectionFlush();
+    }
+    return NULL;
+}
+
+static void logInit(void) {
+    logBuffered = getenv("FOLK_LOG_UNBUFFERED") == NULL;
+    if (!logBuffered) { return; }
+
+    const char* bufferKb = getenv("FOLK_LOG_BUFFER_KB");
+    uint64_t want = (bufferKb ? atoll(bufferKb) : 256) * 1024;
+    logRingCap = 4096;
+    while (logRingCap < want) { logRingCap <<= 1; }
+
+    const char* maxMb = getenv("FOLK_LOG_MAX_MB");
+    logMaxBytes = (int64_t)(maxMb ? atoll(maxMb) : 64) * 1024 * 1024;
+
+    pthread_t th;
+    pthread_create(&th, NULL, logWriterMain, NULL);
+    pthread_detach(th);
+    atexit(outputRedirectionFlush);
 }
 #endif
 
@@ -170,11 +509,18 @@ void outputRedirectionInit(void) {
     dup2(otherStderr, STDERR_FILENO);
     close(otherStdout);
     close(otherStderr);
+
+#ifndef __APPLE__
+    logInit();
+#endif
 }
 
 void installLocalStdoutAndStderr(int stdoutfd, int stderrfd) {
     threadLocalStdout = stdoutfd;
     threadLocalStderr = stderrfd;
+#ifndef __APPLE__
+    logRingInstall();
+#endif
 }
 
 static void escapeProgramName(const char *in, char *out, size_t outlen) {
@@ -208,17 +554,21 @@ static int __installLocalStdoutAndStderrFunc(Jim_Interp *interp, int argc, Jim_O
         // Slow path: new program — open files and insert under wlock.
         char escaped[2048];
         escapeProgramName(this, escaped, sizeof(escaped));
-        char path[4096];
-        snprintf(path, sizeof(path), "%s/%s.stdout", outputDir, escaped);
-        stdoutfd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
-        snprintf(path, sizeof(path), "%s/%s.stderr", outputDir, escaped);
-        stderrfd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        char stdoutPath[4096], stderrPath[4096];
+        snprintf(stdoutPath, sizeof(stdoutPath), "%s/%s.stdout", outputDir, escaped);
+        stdoutfd = open(stdoutPath, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        snprintf(stderrPath, sizeof(stderrPath), "%s/%s.stderr", outputDir, escaped);
+        stderrfd = open(stderrPath, O_WRONLY | O_CREAT | O_APPEND, 0644);
 
         pthread_rwlock_wrlock(&programFdsLock);
         if (shgetp_null(programFdsTable, this) == NULL) {
             ProgramFds new_entry = { .key = (char *)this,
                                      .stdoutfd = stdoutfd, .stderrfd = stderrfd };
             shputs(programFdsTable, new_entry);
+#ifndef __APPLE__
+            logFileRegister(stdoutfd, stdoutPath);
+            logFileRegister(stderrfd, stderrPath);
+#endif
         } else {
             // Another thread inserted first; close our fds and use theirs.
             close(stdoutfd); close(stderrfd);
@@ -250,6 +600,29 @@ static int __installLocalStdoutAndStderrFunc(Jim_Interp *interp, int argc, Jim_O
     return JIM_OK;
 }
 
+// __logStats: counters for the buffered per-program log writer.
+static int __logStatsFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    Jim_Obj* ret = Jim_NewDictObj(interp, NULL, 0);
+#ifndef __APPLE__
+    int64_t bufferedBytes = 0;
+    for (LogRing* ring = atomic_load(&logRings); ring != NULL; ring = ring->next) {
+        bufferedBytes += atomic_load(&ring->head) - atomic_load(&ring->tail);
+    }
+#define LOG_STAT(name, value) \
+    Jim_DictAddElement(interp, ret, Jim_NewStringObj(interp, name, -1), \
+                       Jim_NewIntObj(interp, value))
+    LOG_STAT("buffered", logBuffered);
+    LOG_STAT("bufferedBytes", bufferedBytes);
+    LOG_STAT("writtenBytes", atomic_load(&logWrittenBytes));
+    LOG_STAT("droppedWrites", atomic_load(&logDroppedWrites));
+    LOG_STAT("droppedBytes", atomic_load(&logDroppedBytes));
+    LOG_STAT("rotations", atomic_load(&logRotations));
+#undef LOG_STAT
+#endif
+    Jim_SetResult(interp, ret);
+    return JIM_OK;
+}
+
 void outputRedirectionInterpSetup(Jim_Interp *interp) {
     assert(realStdout != -1 && realStderr != -1);
     Jim_AioMakeChannelFromFd(interp, realStdout, 1);
@@ -259,6 +632,7 @@ void outputRedirectionInterpSetup(Jim_Interp *interp) {
 
     Jim_CreateCommand(interp, "__installLocalStdoutAndStderr",
                       __installLocalStdoutAndStderrFunc, NULL, NULL);
+    Jim_CreateCommand(interp, "__logStats", __logStatsFunc, NULL, NULL);
 }
 
 #endif // FOLK_INTERPOSE_DYLIB
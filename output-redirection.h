@@ -9,3 +9,5 @@ extern int realStderr;
 void outputRedirectionInit(void);
 void installLocalStdoutAndStderr(int stdoutfd, int stderrfd);
 void outputRedirectionInterpSetup(Jim_Interp *interp);
+// Writes out everything in the per-program log buffers.
+void outputRedirectionFlush(void);
@@ -22,7 +22,7 @@ proc unknown {cmdName args} {
         if {[llength [info commands $cmdName]] == 0} {
             # HACK: somehow this keeps getting called repeatedly which
             # causes a leak??
-            load /tmp/$cid.so
+            __loadCModule /tmp/$cid.so $cid
         }
         proc <C:$cid> {procName args} {cid} { tailcall "<C:$cid> $procName" {*}$args }
         if {[llength $args] == 0} {
@@ -145,6 +145,9 @@ proc ::exec {args} {
             if {$i != -1} { set args [lreplace $args $i $i 2>@ $::_folk_localStderr] }
         }
     }
+    if {[__bootTraceEnabled]} {
+        return [__bootTraceSpan exec $args { __exec {*}$args }]
+    }
     tailcall __exec {*}$args
 }
 
@@ -436,57 +439,6 @@ proc Say {args} {
 }
 proc Claim {args} { upvar this this; tailcall Say [expr {[info exists this] ? $this : "<unknown>"}] claims {*}$args }
 proc Wish {args} { upvar this this; tailcall Say [expr {[info exists this] ? $this : "<unknown>"}] wishes {*}$args }
-# returns the statement to Say/Assert (minus the envStack), as well as all bound variable names
-proc desugarWhen {pattern body} {
-    set varNamesWillBeBound [list]
-    set isNegated false
-    for {set i 0} {$i < [llength $pattern]} {incr i} {
-        set term [lindex $pattern $i]
-        if {$term eq "&"} {
-            # Desugar this join into nested Whens.
-            set remainingPattern [lrange $pattern $i+1 end]
-            set pattern [lrange $pattern 0 $i-1]
-            for {set j 0} {$j < [llength $remainingPattern]} {incr j} {
-                set remainingTerm [lindex $remainingPattern $j]
-                if {[regexp {^/([^/ ]+)/$} $remainingTerm -> remainingVarName] &&
-                    $remainingVarName in $varNamesWillBeBound} {
-                    lset remainingPattern $j \$$remainingVarName
-                }
-            }
-            set body [list When {*}$remainingPattern $body]
-            break
-
-        } elseif {[set varName [__scanVariable $term]] != 0} {
-            if {[__variableNameIsNonCapturing $varName]} {
-            } elseif {$varName eq "nobody" || $varName eq "nothing"} {
-                # Rewrite this entire clause to be negated.
-                set isNegated true
-                lset pattern $i "/any/"
-            } else {
-                # Rewrite subsequent instances of this variable name /x/
-                # (in joined clauses) to be bound $x.
-                if {[string range $varName 0 2] eq "..."} {
-                    set varName [string range $varName 3 end]
-                }
-                lappend varNamesWillBeBound $varName
-            }
-        } elseif {[__startsWithDollarSign $term]} {
-            lset pattern $i [uplevel 2 [list subst $term]]
-        }
-    }
-
-    if {$isNegated} {
-        set negateBody [list if {[llength $__results] == 0} $body]
-        return [list \
-            [list when the collected results for $pattern are /__results/ \
-                $negateBody with environment] \
-            $varNamesWillBeBound]
-    } else {
-        return [list \
-            [list when {*}$pattern $body with environment] \
-            $varNamesWillBeBound]
-    }
-}
 proc When {args} {
     set body [lindex $args end]
     set sourceInfo [info source $body]
@@ -581,7 +533,10 @@ proc When {args} {
         set atomicallyVersion {}
     }
 
-    lassign [desugarWhen $pattern $body] statement boundVars
+    # __desugarWhen (in C, memoized on the pattern) returns the
+    # statement to Say/Assert (minus the envStack), as well as all
+    # bound variable names.
+    lassign [__desugarWhen $pattern $body] statement boundVars
     lappend statement $envStack
 
     tailcall SayWithSource {*}$sourceInfo \
@@ -600,7 +555,15 @@ proc Subscribe: {args} {
         subscribe {*}$pattern $body with environment $envStack
 }
 proc Notify: {args} {
-    NotifyImpl {*}$args
+    # tailcall, so the notification is attributed to the caller's
+    # source location (for the input recorder).
+    tailcall NotifyImpl {*}$args
+}
+# NotifyBatch: [list {key a was pressed} {key b was pressed} ...]
+# Like a Notify: of each clause in order, but each subscriber gets
+# the whole batch as one work item.
+proc NotifyBatch: {clauses} {
+    tailcall NotifyBatchImpl $clauses
 }
 proc On {event args} {
     if {$event eq "unmatch"} {
@@ -619,55 +582,10 @@ proc On {event args} {
 # it'll automatically also query the claimized pattern (the pattern
 # with `/someone/ claims` prepended).
 proc Query! {args} {
-    # HACK: this (parsing &s and filling resolved vars) is mostly
-    # copy-and-pasted from When.
-
-    set isAtomically false
-
-    # TODO: refactor common logic out? is it worth it?
-
-    set pattern [list]
-    set varNamesWillBeBound [list]
-    set isNegated false
-    for {set i 0} {$i < [llength $args]} {incr i} {
-        set term [lindex $args $i]
-        if {$term eq "&"} {
-            set remainingPattern [lrange $args $i+1 end]
-            # pattern is already built up correctly before the &
-            for {set j 0} {$j < [llength $remainingPattern]} {incr j} {
-                set remainingTerm [lindex $remainingPattern $j]
-                if {[regexp {^/([^/ ]+)/$} $remainingTerm -> remainingVarName] &&
-                    $remainingVarName in $varNamesWillBeBound} {
-                    lset remainingPattern $j \$$remainingVarName
-                }
-            }
-            break
-
-        } elseif {$term eq "-atomically"} {
-            set isAtomically true
-
-        } elseif {[set varName [__scanVariable $term]] != 0} {
-            if {[__variableNameIsNonCapturing $varName]} {
-            } elseif {$varName eq "nobody" || $varName eq "nothing"} {
-                set isNegated true
-                lset args $i "/any/"
-            } else {
-                # Rewrite subsequent instances of this variable name /x/
-                # (in joined clauses) to be bound $x.
-                if {[string range $varName 0 2] eq "..."} {
-                    set varName [string range $varName 3 end]
-                }
-                lappend varNamesWillBeBound $varName
-            }
-
-            lappend pattern $term
-
-        } elseif {[__startsWithDollarSign $term]} {
-            lappend pattern [uplevel subst $term]
-        } else {
-            lappend pattern $term
-        }
-    }
+    # __parseQuery (in C, memoized on args) splits off the first
+    # clause, fills in its $-terms, and rewrites variables it binds in
+    # the remaining clauses to be bound.
+    lassign [__parseQuery $args] isAtomically isNegated pattern remainingPattern
 
     if {[llength $pattern] >= 2 && ([lindex $pattern 1] eq "claims" ||
                                     [lindex $pattern 1] eq "wishes")} {
@@ -688,7 +606,7 @@ proc Query! {args} {
         }
     }
 
-    if {![info exists remainingPattern]} {
+    if {[llength $remainingPattern] == 0} {
         return $results0
     }
 
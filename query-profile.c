@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "vendor/stb_ds.h"
+
+#include <jim.h>
+
+#include "common.h"
+#include "query-profile.h"
+
+// Query profiler. When on (FOLK_QUERY_PROFILE=N at startup, or
+// __queryProfileSetSampling N), dbQuery records 1 in N queries: how
+// long it took, how many trie nodes it visited, and how many results
+// it returned, aggregated per pattern *shape* -- the pattern with
+// every variable replaced by /x/ (and every rest variable by /...x/),
+// so that `/someone/ claims /thing/ is cool` and `/p/ claims /t/ is
+// cool` count together.
+//
+// Each thread aggregates into its own shard, under its own mutex
+// (which is uncontended except while someone is reading the stats).
+
+int _Atomic queryProfileSampleEvery;
+static __thread int countdown;
+
+typedef struct QueryProfileStat {
+    int64_t samples;
+    // Estimated total calls (each sample stands for sampleEvery
+    // calls).
+    int64_t calls;
+    int64_t nodesVisited;
+    int64_t results;
+    int64_t totalNs;
+    int64_t maxNs;
+} QueryProfileStat;
+
+typedef struct QueryProfileShard {
+    pthread_mutex_t mutex;
+    struct { char* key; QueryProfileStat value; }* stats;
+    struct QueryProfileShard* next;
+} QueryProfileShard;
+static QueryProfileShard* _Atomic queryProfileShards;
+static __thread QueryProfileShard* queryProfileShard;
+// Reused by whichever worker next takes the slot (like block stats).
+static QueryProfileShard* queryProfileShardsBySlot[THREADS_MAX];
+
+void queryProfileInit(void) {
+    const char* every = getenv("FOLK_QUERY_PROFILE");
+    if (every != NULL) { queryProfileSampleEvery = atoi(every); }
+}
+
+bool queryProfileShouldSample(void) {
+    int every = queryProfileSampleEvery;
+    if (every <= 0) { return false; }
+    if (--countdown > 0) { return false; }
+    countdown = every;
+    return true;
+}
+
+// Long literal terms (code, images, ...) get cut short so shapes
+// stay readable and don't blow up the table.
+#define QUERY_PROFILE_TERM_MAX 40
+
+static void patternShape(Clause* pattern, char* buf, size_t bufsz) {
+    size_t n = 0;
+    buf[0] = '\0';
+    for (int i = 0; i < pattern->nTerms && n < bufsz; i++) {
+        const char* sep = i == 0 ? "" : " ";
+        char varName[100];
+        if (trieScanVariable(pattern->terms[i], varName, sizeof(varName))) {
+            bool isRest = strncmp(varName, "...", 3) == 0;
+            n += snprintf(buf + n, bufsz - n, "%s%s", sep, isRest ? "/...x/" : "/x/");
+        } else {
+            int len = termLen(pattern->terms[i]);
+            if (len > QUERY_PROFILE_TERM_MAX) {
+                n += snprintf(buf + n, bufsz - n, "%s%.*s...", sep,
+                              QUERY_PROFILE_TERM_MAX - 3, termPtr(pattern->terms[i]));
+            } else {
+                n += snprintf(buf + n, bufsz - n, "%s%.*s", sep,
+                              len, termPtr(pattern->terms[i]));
+            }
+        }
+    }
+}
+
+void queryProfileRecord(Clause* pattern, int64_t elapsedNs,
+                        int nodesVisited, int nResults) {
+    QueryProfileShard* shard = queryProfileShard;
+    if (shard == NULL) {
+        int slot = self != NULL ? self->index : -1;
+        if (slot >= 0) { shard = queryProfileShardsBySlot[slot]; }
+        if (shard == NULL) {
+            shard = calloc(1, sizeof(QueryProfileShard));
+            pthread_mutex_init(&shard->mutex, NULL);
+            sh_new_strdup(shard->stats);
+            shard->next = queryProfileShards;
+            while (!__atomic_compare_exchange_n(&queryProfileShards, &shard->next, shard,
+                                                true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {}
+            if (slot >= 0) { queryProfileShardsBySlot[slot] = shard; }
+        }
+        queryProfileShard = shard;
+    }
+
+    char shape[1024];
+    patternShape(pattern, shape, sizeof(shape));
+    int every = queryProfileSampleEvery;
+
+    pthread_mutex_lock(&shard->mutex);
+    ptrdiff_t i = shgeti(shard->stats, shape);
+    if (i < 0) {
+        QueryProfileStat zero = {0};
+        shput(shard->stats, shape, zero);
+        i = shgeti(shard->stats, shape);
+    }
+    QueryProfileStat* stat = &shard->stats[i].value;
+    stat->samples++;
+    stat->calls += every > 0 ? every : 1;
+    stat->nodesVisited += nodesVisited;
+    stat->results += nResults;
+    stat->totalNs += elapsedNs;
+    if (elapsedNs > stat->maxNs) { stat->maxNs = elapsedNs; }
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+// Returns a list of {shape calls samples nodesVisited results totalNs
+// maxNs}, where calls is estimated from the sampling rate, and
+// nodesVisited, results and totalNs are summed over the samples only.
+int __queryProfileStatsFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    struct { char* key; QueryProfileStat value; }* merged = NULL;
+    sh_new_strdup(merged);
+
+    QueryProfileShard* shards = __atomic_load_n(&queryProfileShards, __ATOMIC_ACQUIRE);
+    for (QueryProfileShard* shard = shards; shard != NULL; shard = shard->next) {
+        pthread_mutex_lock(&shard->mutex);
+        for (int i = 0; i < shlen(shard->stats); i++) {
+            QueryProfileStat* from = &shard->stats[i].value;
+            ptrdiff_t j = shgeti(merged, shard->stats[i].key);
+            if (j < 0) {
+                shput(merged, shard->stats[i].key, *from);
+                continue;
+            }
+            QueryProfileStat* to = &merged[j].value;
+            to->samples += from->samples;
+            to->calls += from->calls;
+            to->nodesVisited += from->nodesVisited;
+            to->results += from->results;
+            to->totalNs += from->totalNs;
+            if (from->maxNs > to->maxNs) { to->maxNs = from->maxNs; }
+        }
+        pthread_mutex_unlock(&shard->mutex);
+    }
+
+    Jim_Obj *result = Jim_NewListObj(interp, NULL, 0);
+    for (int i = 0; i < shlen(merged); i++) {
+        QueryProfileStat* stat = &merged[i].value;
+        Jim_Obj *entry[] = {
+            Jim_NewStringObj(interp, merged[i].key, -1),
+            Jim_NewIntObj(interp, stat->calls),
+            Jim_NewIntObj(interp, stat->samples),
+            Jim_NewIntObj(interp, stat->nodesVisited),
+            Jim_NewIntObj(interp, stat->results),
+            Jim_NewIntObj(interp, stat->totalNs),
+            Jim_NewIntObj(interp, stat->maxNs)
+        };
+        Jim_ListAppendElement(interp, result,
+                              Jim_NewListObj(interp, entry, sizeof(entry)/sizeof(entry[0])));
+    }
+    shfree(merged);
+
+    Jim_SetResult(interp, result);
+    return JIM_OK;
+}
+
+// __queryProfileSetSampling ?sampleEvery?: 0 turns profiling off, 1
+// records every query, N records 1 in N. Returns the (new) setting.
+int __queryProfileSetSamplingFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    if (argc > 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "?sampleEvery?");
+        return JIM_ERR;
+    }
+    if (argc == 2) {
+        long every;
+        if (Jim_GetLong(interp, argv[1], &every) != JIM_OK) { return JIM_ERR; }
+        queryProfileSampleEvery = every < 0 ? 0 : every;
+    }
+    Jim_SetResultInt(interp, queryProfileSampleEvery);
+    return JIM_OK;
+}
+
+int __queryProfileResetFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    QueryProfileShard* shards = __atomic_load_n(&queryProfileShards, __ATOMIC_ACQUIRE);
+    for (QueryProfileShard* shard = shards; shard != NULL; shard = shard->next) {
+        pthread_mutex_lock(&shard->mutex);
+        shfree(shard->stats);
+        sh_new_strdup(shard->stats);
+        pthread_mutex_unlock(&shard->mutex);
+    }
+    return JIM_OK;
+}
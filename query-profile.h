@@ -0,0 +1,27 @@
+#ifndef QUERY_PROFILE_H
+#define QUERY_PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <jim.h>
+
+#include "trie.h"
+
+// Optional profiling of dbQuery, aggregated per pattern shape.
+
+// 0 means off, 1 means record every query, N means record 1 in N.
+extern int _Atomic queryProfileSampleEvery;
+
+void queryProfileInit(void);
+
+// Call on every query (it's cheap when profiling is off); if it
+// returns true, time the query and then call queryProfileRecord.
+bool queryProfileShouldSample(void);
+void queryProfileRecord(Clause* pattern, int64_t elapsedNs,
+                        int nodesVisited, int nResults);
+
+int __queryProfileStatsFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv);
+int __queryProfileSetSamplingFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv);
+int __queryProfileResetFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv);
+
+#endif
@@ -0,0 +1,147 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jim.h>
+
+#include "common.h"
+#include "histogram.h"
+#include "block-stats.h"
+#include "reaction-latency.h"
+
+// Reaction latency stats, per causal root.
+//
+// Every statement carries the insertion time and source location
+// (block stats id) of its causal root: a statement made by a Hold!
+// or Assert! is its own root, and a statement Said inside a When body
+// inherits the root of the statement that fired that When (see
+// matchSetCause in db.c and runWhenBlock in folk.c). So, e.g., every
+// When that runs downstream of a camera frame, however many hops
+// away, is counted under the camera's Hold! location.
+//
+// Like block-stats.c, each thread writes into its own shard, indexed
+// by root id, and readers merge the shards.
+
+typedef struct ReactionLatencyStat {
+    // Push of the RUN_WHEN work item to start of the When body.
+    Histogram queued;
+    // Running the When body.
+    Histogram exec;
+    // Insertion of the causal root to end of the When body.
+    Histogram total;
+} ReactionLatencyStat;
+
+#define REACTION_LATENCY_CHUNK 16
+typedef struct ReactionLatencyShard {
+    ReactionLatencyStat* _Atomic chunks[BLOCK_STATS_IDS_MAX / REACTION_LATENCY_CHUNK];
+    struct ReactionLatencyShard* next;
+} ReactionLatencyShard;
+
+static ReactionLatencyShard* _Atomic reactionLatencyShards;
+static __thread ReactionLatencyShard* reactionLatencyShard;
+// Reused by whichever worker next takes the slot (like block stats).
+static ReactionLatencyShard* reactionLatencyShardsBySlot[THREADS_MAX];
+
+void reactionLatencyRecord(int rootId,
+                           int64_t queuedNs, int64_t execNs, int64_t totalNs) {
+    if (rootId < 0 || rootId >= BLOCK_STATS_IDS_MAX) { rootId = 0; }
+
+    ReactionLatencyShard* shard = reactionLatencyShard;
+    if (shard == NULL) {
+        int slot = self != NULL ? self->index : -1;
+        if (slot >= 0) { shard = reactionLatencyShardsBySlot[slot]; }
+        if (shard == NULL) {
+            shard = calloc(1, sizeof(ReactionLatencyShard));
+            shard->next = reactionLatencyShards;
+            while (!__atomic_compare_exchange_n(&reactionLatencyShards, &shard->next, shard,
+                                                true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {}
+            if (slot >= 0) { reactionLatencyShardsBySlot[slot] = shard; }
+        }
+        reactionLatencyShard = shard;
+    }
+    ReactionLatencyStat* chunk = shard->chunks[rootId / REACTION_LATENCY_CHUNK];
+    if (chunk == NULL) {
+        chunk = calloc(REACTION_LATENCY_CHUNK, sizeof(ReactionLatencyStat));
+        __atomic_store_n(&shard->chunks[rootId / REACTION_LATENCY_CHUNK], chunk,
+                         __ATOMIC_RELEASE);
+    }
+
+    ReactionLatencyStat* s = &chunk[rootId % REACTION_LATENCY_CHUNK];
+    histogramRecord(&s->queued, queuedNs);
+    histogramRecord(&s->exec, execNs);
+    histogramRecord(&s->total, totalNs);
+}
+
+// Returns a list of {root count queuedP50Ns queuedP99Ns execP50Ns
+// execP99Ns totalP50Ns totalP99Ns totalMaxNs}, one per root location
+// that has caused at least one When run.
+int __reactionLatencyStatsFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    Jim_Obj *result = Jim_NewListObj(interp, NULL, 0);
+    ReactionLatencyShard* shards = __atomic_load_n(&reactionLatencyShards, __ATOMIC_ACQUIRE);
+
+    ReactionLatencyStat merged;
+    for (int chunkIdx = 0; chunkIdx < BLOCK_STATS_IDS_MAX / REACTION_LATENCY_CHUNK; chunkIdx++) {
+        for (int i = 0; i < REACTION_LATENCY_CHUNK; i++) {
+            memset(&merged, 0, sizeof(merged));
+            bool any = false;
+            for (ReactionLatencyShard* shard = shards; shard != NULL; shard = shard->next) {
+                ReactionLatencyStat* chunk = __atomic_load_n(&shard->chunks[chunkIdx],
+                                                             __ATOMIC_ACQUIRE);
+                if (chunk == NULL) { continue; }
+                any = true;
+                histogramMerge(&merged.queued, &chunk[i].queued);
+                histogramMerge(&merged.exec, &chunk[i].exec);
+                histogramMerge(&merged.total, &chunk[i].total);
+            }
+            if (!any) { break; } // no shard has this chunk
+            if (merged.total.count == 0) { continue; }
+
+            int rootId = chunkIdx * REACTION_LATENCY_CHUNK + i;
+            Jim_Obj *entry[] = {
+                Jim_NewStringObj(interp, blockStatsLocation(rootId), -1),
+                Jim_NewIntObj(interp, (jim_wide)merged.total.count),
+                Jim_NewIntObj(interp, (jim_wide)histogramPercentile(&merged.queued, 0.5)),
+                Jim_NewIntObj(interp, (jim_wide)histogramPercentile(&merged.queued, 0.99)),
+                Jim_NewIntObj(interp, (jim_wide)histogramPercentile(&merged.exec, 0.5)),
+                Jim_NewIntObj(interp, (jim_wide)histogramPercentile(&merged.exec, 0.99)),
+                Jim_NewIntObj(interp, (jim_wide)histogramPercentile(&merged.total, 0.5)),
+                Jim_NewIntObj(interp, (jim_wide)histogramPercentile(&merged.total, 0.99)),
+                Jim_NewIntObj(interp, (jim_wide)merged.total.maxNs)
+            };
+            Jim_ListAppendElement(interp, result,
+                                  Jim_NewListObj(interp, entry, sizeof(entry)/sizeof(entry[0])));
+        }
+    }
+    Jim_SetResult(interp, result);
+    return JIM_OK;
+}
+
+// Returns {count p50Ns p99Ns maxNs} of total latency over all When
+// runs so far, whatever their root (e.g., for benchmarks).
+int __reactionLatencyTotalFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    ReactionLatencyShard* shards = __atomic_load_n(&reactionLatencyShards, __ATOMIC_ACQUIRE);
+
+    Histogram merged; memset(&merged, 0, sizeof(merged));
+    for (ReactionLatencyShard* shard = shards; shard != NULL; shard = shard->next) {
+        for (int chunkIdx = 0; chunkIdx < BLOCK_STATS_IDS_MAX / REACTION_LATENCY_CHUNK; chunkIdx++) {
+            ReactionLatencyStat* chunk = __atomic_load_n(&shard->chunks[chunkIdx],
+                                                         __ATOMIC_ACQUIRE);
+            if (chunk == NULL) { continue; }
+            for (int i = 0; i < REACTION_LATENCY_CHUNK; i++) {
+                histogramMerge(&merged, &chunk[i].total);
+            }
+        }
+    }
+
+    Jim_Obj *entry[] = {
+        Jim_NewIntObj(interp, (jim_wide)merged.count),
+        Jim_NewIntObj(interp, (jim_wide)histogramPercentile(&merged, 0.5)),
+        Jim_NewIntObj(interp, (jim_wide)histogramPercentile(&merged, 0.99)),
+        Jim_NewIntObj(interp, (jim_wide)merged.maxNs)
+    };
+    Jim_SetResult(interp, Jim_NewListObj(interp, entry, sizeof(entry)/sizeof(entry[0])));
+    return JIM_OK;
+}
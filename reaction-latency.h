@@ -0,0 +1,19 @@
+#ifndef REACTION_LATENCY_H
+#define REACTION_LATENCY_H
+
+#include <stdint.h>
+#include <jim.h>
+
+// End-to-end reaction latency: for every When run, how long it sat in
+// the queue, how long it ran, and how long it's been since the causal
+// root of the statement that triggered it was inserted. Aggregated
+// per root source location (a block stats id), e.g., the camera's
+// Hold! of `camera ... has jpeg frame`.
+
+void reactionLatencyRecord(int rootId,
+                           int64_t queuedNs, int64_t execNs, int64_t totalNs);
+
+int __reactionLatencyStatsFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv);
+int __reactionLatencyTotalFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv);
+
+#endif
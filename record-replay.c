@@ -0,0 +1,652 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "vendor/stb_ds.h"
+
+#include <jim.h>
+
+#include "common.h"
+#include "epoch.h"
+#include "block-stats.h"
+#include "workqueue.h"
+#include "record-replay.h"
+
+// Input recorder. Everything that comes into the database from
+// outside the When/Claim dataflow -- Assert!, Retract!,
+// HoldStatementGlobally! (which is what Hold! and the camera/tag/
+// keyboard pipelines bottom out in) and Notify! -- goes through one
+// of the record* hooks, which append it to a compact binary log with
+// a timestamp and the source location that made it. Replaying that
+// log later (at recorded speed, faster, or as fast as possible)
+// reproduces the input stream of a session without the hardware, so
+// a slow frame or a crash can be profiled offline. It doesn't
+// reproduce scheduling: workers may still interleave differently on
+// replay.
+//
+// The log is the magic "FOLKREC1" followed by events:
+//
+//   u8 op
+//   varint nanoseconds since the previous event
+//   string source file name (interned)
+//   zigzag varint source line number
+//   for holds only:
+//     string key (interned)
+//     8-byte double version (host byte order)
+//     zigzag varint keepMs
+//     varint destructor code length + 1 (0 if none), then the bytes
+//   varint number of terms, then each term as a string
+//
+// and a string is a varint tag: if the low bit is clear, tag >> 1
+// bytes follow inline. If it's set, tag >> 1 is an index into the
+// table of interned strings, and if that index is one past the end
+// of the table, it's a new entry whose varint length and bytes follow.
+// Short non-numeric terms (`tag`, `has`, `quad`...) get interned;
+// numbers and code don't, so the table doesn't grow without bound.
+
+#define RECORD_MAGIC "FOLKREC1"
+#define RECORD_MAGIC_LEN 8
+#define RECORD_INTERN_MAX_LEN 64
+#define RECORD_FLUSH_THRESHOLD (64 * 1024)
+
+typedef enum RecordOp {
+    RECORD_ASSERT = 1,
+    RECORD_RETRACT = 2,
+    RECORD_HOLD = 3,
+    RECORD_NOTIFY = 4
+} RecordOp;
+static const char* recordOpNames[] = {
+    NULL, "assert", "retract", "hold", "notify"
+};
+
+bool _Atomic recording;
+
+static pthread_mutex_t recordMutex = PTHREAD_MUTEX_INITIALIZER;
+static int recordFd = -1;
+static int64_t recordLastNs;
+// Encoded events that haven't been written yet (stb_ds array).
+static uint8_t* recordBuf;
+// Interned string -> index in the recording's string table.
+static struct { char* key; int value; }* recordStrings;
+static int recordStringsCount;
+
+static void recordFlushLocked() {
+    size_t off = 0;
+    while (off < arrlenu(recordBuf)) {
+        ssize_t n = write(recordFd, recordBuf + off, arrlenu(recordBuf) - off);
+        if (n < 0) {
+            perror("record: write");
+            break;
+        }
+        off += n;
+    }
+    arrsetlen(recordBuf, 0);
+}
+
+static void recordPutVarint(uint64_t x) {
+    while (x >= 0x80) {
+        arrput(recordBuf, (uint8_t)(x | 0x80));
+        x >>= 7;
+    }
+    arrput(recordBuf, (uint8_t)x);
+}
+static void recordPutZigzag(int64_t x) {
+    recordPutVarint(((uint64_t)x << 1) ^ (uint64_t)(x >> 63));
+}
+static void recordPutBytes(const void* s, size_t len) {
+    memcpy(arraddnptr(recordBuf, len), s, len);
+}
+static void recordPutString(const char* s, int len, bool intern) {
+    if (!intern || len > RECORD_INTERN_MAX_LEN) {
+        recordPutVarint((uint64_t)len << 1);
+        recordPutBytes(s, len);
+        return;
+    }
+    char key[RECORD_INTERN_MAX_LEN + 1];
+    memcpy(key, s, len); key[len] = '\0';
+    int idx = shget(recordStrings, key);
+    if (idx >= 0) {
+        recordPutVarint(((uint64_t)idx << 1) | 1);
+        return;
+    }
+    idx = recordStringsCount++;
+    shput(recordStrings, key, idx);
+    recordPutVarint(((uint64_t)idx << 1) | 1);
+    recordPutVarint(len);
+    recordPutBytes(s, len);
+}
+static bool recordShouldInternTerm(const char* s, int len) {
+    if (len == 0) { return true; }
+    return !(s[0] == '-' || s[0] == '.' || (s[0] >= '0' && s[0] <= '9'));
+}
+
+// Returns NULL on success or an error message.
+static const char* recordStart(const char* path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) { return "couldn't open recording"; }
+    pthread_mutex_lock(&recordMutex);
+    recordFd = fd;
+    recordLastNs = timestamp_get(CLOCK_MONOTONIC);
+    sh_new_strdup(recordStrings);
+    shdefault(recordStrings, -1);
+    recordStringsCount = 0;
+    recordPutBytes(RECORD_MAGIC, RECORD_MAGIC_LEN);
+    recordFlushLocked();
+    recording = true;
+    pthread_mutex_unlock(&recordMutex);
+    return NULL;
+}
+static void recordStop() {
+    pthread_mutex_lock(&recordMutex);
+    recording = false;
+    if (recordFd >= 0) {
+        recordFlushLocked();
+        close(recordFd);
+        recordFd = -1;
+        shfree(recordStrings);
+    }
+    pthread_mutex_unlock(&recordMutex);
+}
+static void recordAtExit() { recordStop(); }
+
+void recordInit() {
+    const char* path = getenv("FOLK_RECORD");
+    if (path == NULL || path[0] == '\0') { return; }
+    const char* err = recordStart(path);
+    if (err != NULL) {
+        fprintf(stderr, "record: %s: %s\n", path, err);
+        exit(1);
+    }
+    atexit(recordAtExit);
+}
+
+void recordTick() {
+    if (!recording) { return; }
+    pthread_mutex_lock(&recordMutex);
+    if (recordFd >= 0) { recordFlushLocked(); }
+    pthread_mutex_unlock(&recordMutex);
+}
+
+static void recordEvent(RecordOp op, Clause* clause,
+                        const char* sourceFileName, int sourceLineNumber,
+                        const char* key, double version, long keepMs,
+                        const char* destructorCode) {
+    pthread_mutex_lock(&recordMutex);
+    if (recordFd < 0) {
+        pthread_mutex_unlock(&recordMutex);
+        return;
+    }
+    int64_t nowNs = timestamp_get(CLOCK_MONOTONIC);
+    int64_t dtNs = nowNs - recordLastNs;
+    recordLastNs = nowNs;
+
+    arrput(recordBuf, (uint8_t)op);
+    recordPutVarint(dtNs > 0 ? dtNs : 0);
+    if (sourceFileName == NULL) { sourceFileName = "<unknown>"; }
+    recordPutString(sourceFileName, strlen(sourceFileName), true);
+    recordPutZigzag(sourceLineNumber);
+    if (op == RECORD_HOLD) {
+        recordPutString(key, strlen(key), true);
+        recordPutBytes(&version, sizeof(version));
+        recordPutZigzag(keepMs);
+        if (destructorCode == NULL) {
+            recordPutVarint(0);
+        } else {
+            size_t len = strlen(destructorCode);
+            recordPutVarint(len + 1);
+            recordPutBytes(destructorCode, len);
+        }
+    }
+    recordPutVarint(clause->nTerms);
+    for (int i = 0; i < clause->nTerms; i++) {
+        const char* s = termPtr(clause->terms[i]);
+        int len = termLen(clause->terms[i]);
+        recordPutString(s, len, recordShouldInternTerm(s, len));
+    }
+
+    if (arrlenu(recordBuf) >= RECORD_FLUSH_THRESHOLD) {
+        recordFlushLocked();
+    }
+    pthread_mutex_unlock(&recordMutex);
+}
+
+void recordAssert(Clause* clause, const char* sourceFileName, int sourceLineNumber) {
+    if (!recording) { return; }
+    recordEvent(RECORD_ASSERT, clause, sourceFileName, sourceLineNumber,
+                NULL, 0, 0, NULL);
+}
+void recordRetract(Clause* pattern, const char* sourceFileName, int sourceLineNumber) {
+    if (!recording) { return; }
+    recordEvent(RECORD_RETRACT, pattern, sourceFileName, sourceLineNumber,
+                NULL, 0, 0, NULL);
+}
+void recordHold(const char* key, double version,
+                Clause* clause, long keepMs, const char* destructorCode,
+                const char* sourceFileName, int sourceLineNumber) {
+    if (!recording) { return; }
+    recordEvent(RECORD_HOLD, clause, sourceFileName, sourceLineNumber,
+                key, version, keepMs, destructorCode);
+}
+void recordNotify(Clause* clause, const char* sourceFileName, int sourceLineNumber) {
+    if (!recording) { return; }
+    recordEvent(RECORD_NOTIFY, clause, sourceFileName, sourceLineNumber,
+                NULL, 0, 0, NULL);
+}
+
+////////////////////////////////////////////////////////////
+// Reading recordings back
+////////////////////////////////////////////////////////////
+
+typedef struct ReplayString { char* s; int len; } ReplayString;
+
+typedef struct ReplayReader {
+    uint8_t* data;
+    size_t len;
+    size_t pos;
+    int64_t tNs;
+    ReplayString* strings; // stb_ds array
+} ReplayReader;
+
+// One decoded event. The caller owns clause and destructorCode; the
+// strings belong to the reader.
+typedef struct ReplayEvent {
+    RecordOp op;
+    // Since the start of the recording.
+    int64_t tNs;
+    const char* sourceFileName;
+    int sourceLineNumber;
+
+    const char* key;
+    double version;
+    long keepMs;
+    char* destructorCode;
+
+    Clause* clause;
+} ReplayEvent;
+
+// Returns an error message, or NULL on success.
+static const char* replayReaderOpen(ReplayReader* r, const char* path) {
+    *r = (ReplayReader) {0};
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) { return "couldn't open recording"; }
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    r->data = malloc(len > 0 ? len : 1);
+    r->len = fread(r->data, 1, len, fp);
+    fclose(fp);
+    if (r->len < RECORD_MAGIC_LEN ||
+        memcmp(r->data, RECORD_MAGIC, RECORD_MAGIC_LEN) != 0) {
+        free(r->data); r->data = NULL;
+        return "not a Folk recording";
+    }
+    r->pos = RECORD_MAGIC_LEN;
+    return NULL;
+}
+static void replayReaderClose(ReplayReader* r) {
+    for (int i = 0; i < arrlen(r->strings); i++) { free(r->strings[i].s); }
+    arrfree(r->strings);
+    free(r->data);
+}
+
+static bool replayGetVarint(ReplayReader* r, uint64_t* out) {
+    uint64_t x = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (r->pos >= r->len) { return false; }
+        uint8_t b = r->data[r->pos++];
+        x |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) { *out = x; return true; }
+    }
+    return false;
+}
+static bool replayGetZigzag(ReplayReader* r, int64_t* out) {
+    uint64_t x;
+    if (!replayGetVarint(r, &x)) { return false; }
+    *out = (int64_t)(x >> 1) ^ -(int64_t)(x & 1);
+    return true;
+}
+static bool replayGetBytes(ReplayReader* r, size_t len, const uint8_t** out) {
+    if (len > r->len - r->pos) { return false; }
+    *out = r->data + r->pos;
+    r->pos += len;
+    return true;
+}
+// Inline strings point into the reader's buffer and aren't
+// NUL-terminated; interned ones are.
+static bool replayGetString(ReplayReader* r, const char** s, int* len) {
+    uint64_t tag;
+    if (!replayGetVarint(r, &tag)) { return false; }
+    if (!(tag & 1)) {
+        const uint8_t* bytes;
+        if (!replayGetBytes(r, tag >> 1, &bytes)) { return false; }
+        *s = (const char*)bytes; *len = tag >> 1;
+        return true;
+    }
+    uint64_t idx = tag >> 1;
+    if (idx == arrlenu(r->strings)) {
+        uint64_t n; const uint8_t* bytes;
+        if (!replayGetVarint(r, &n) || !replayGetBytes(r, n, &bytes)) {
+            return false;
+        }
+        ReplayString str = { .s = malloc(n + 1), .len = n };
+        memcpy(str.s, bytes, n); str.s[n] = '\0';
+        arrput(r->strings, str);
+    } else if (idx > arrlenu(r->strings)) {
+        return false;
+    }
+    *s = r->strings[idx].s; *len = r->strings[idx].len;
+    return true;
+}
+static bool replayGetInternedString(ReplayReader* r, const char** s) {
+    int len;
+    if (!replayGetString(r, s, &len)) { return false; }
+    // Only interned strings are NUL-terminated. The recorder always
+    // interns these, so anything else is a corrupt recording.
+    return *s >= (const char*)r->data + r->len || *s < (const char*)r->data;
+}
+
+// Returns false at the end of the recording (or at a truncated event,
+// if Folk died mid-write).
+static bool replayReadEvent(ReplayReader* r, ReplayEvent* ev) {
+    if (r->pos >= r->len) { return false; }
+    *ev = (ReplayEvent) { .op = r->data[r->pos++] };
+    if (ev->op < RECORD_ASSERT || ev->op > RECORD_NOTIFY) { return false; }
+
+    uint64_t dtNs; int64_t line;
+    if (!replayGetVarint(r, &dtNs) ||
+        !replayGetInternedString(r, &ev->sourceFileName) ||
+        !replayGetZigzag(r, &line)) {
+        return false;
+    }
+    r->tNs += dtNs;
+    ev->tNs = r->tNs;
+    ev->sourceLineNumber = line;
+
+    if (ev->op == RECORD_HOLD) {
+        const uint8_t* versionBytes; int64_t keepMs; uint64_t destructorLen;
+        if (!replayGetInternedString(r, &ev->key) ||
+            !replayGetBytes(r, sizeof(double), &versionBytes) ||
+            !replayGetZigzag(r, &keepMs) ||
+            !replayGetVarint(r, &destructorLen)) {
+            return false;
+        }
+        memcpy(&ev->version, versionBytes, sizeof(double));
+        ev->keepMs = keepMs;
+        if (destructorLen > 0) {
+            const uint8_t* bytes;
+            if (!replayGetBytes(r, destructorLen - 1, &bytes)) { return false; }
+            ev->destructorCode = strndup((const char*)bytes, destructorLen - 1);
+        }
+    }
+
+    uint64_t nTerms;
+    if (!replayGetVarint(r, &nTerms) || nTerms > r->len - r->pos) {
+        free(ev->destructorCode);
+        return false;
+    }
+    ev->clause = clauseNew(nTerms);
+    for (uint64_t i = 0; i < nTerms; i++) {
+        const char* s; int len;
+        if (!replayGetString(r, &s, &len)) {
+            ev->clause->nTerms = i;
+            clauseFree(ev->clause);
+            free(ev->destructorCode);
+            return false;
+        }
+        ev->clause->terms[i] = termNew(s, len);
+    }
+    return true;
+}
+
+////////////////////////////////////////////////////////////
+// Replay
+////////////////////////////////////////////////////////////
+
+// From folk.c.
+extern void HoldStatementGlobally(const char *key, double version,
+                                  Clause *clause, long keepMs, const char *destructorCode,
+                                  const char *sourceFileName, int sourceLineNumber);
+extern void NotifyGlobally(Clause* toNotify);
+extern void appropriateWorkQueuePush(WorkQueueItem item);
+
+typedef struct ReplayOptions {
+    char* path;
+    // Multiplier on the recorded pace; 0 replays as fast as possible.
+    double speed;
+    // Comma-separated substrings of source file names to replay
+    // events from (NULL to replay everything).
+    char* sources;
+    ReplayReader reader;
+} ReplayOptions;
+
+static bool replaySourceSelected(ReplayOptions* opts, const char* sourceFileName) {
+    if (opts->sources == NULL) { return true; }
+    const char* p = opts->sources;
+    while (*p) {
+        const char* end = strchr(p, ',');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if (len > 0 && memmem(sourceFileName, strlen(sourceFileName), p, len) != NULL) {
+            return true;
+        }
+        if (end == NULL) { break; }
+        p = end + 1;
+    }
+    return false;
+}
+
+static void* replayMain(void* arg) {
+    ReplayOptions* opts = arg;
+    epochThreadInit();
+
+    int64_t startNs = timestamp_get(CLOCK_MONOTONIC);
+    int64_t eventsCount = 0;
+    ReplayEvent ev;
+    while (replayReadEvent(&opts->reader, &ev)) {
+        if (!replaySourceSelected(opts, ev.sourceFileName)) {
+            clauseFree(ev.clause);
+            free(ev.destructorCode);
+            continue;
+        }
+        if (opts->speed > 0) {
+            int64_t dueNs = startNs + (int64_t)(ev.tNs / opts->speed);
+            int64_t nowNs = timestamp_get(CLOCK_MONOTONIC);
+            if (dueNs > nowNs) {
+                struct timespec ts = {
+                    .tv_sec = (dueNs - nowNs) / 1000000000,
+                    .tv_nsec = (dueNs - nowNs) % 1000000000
+                };
+                nanosleep(&ts, NULL);
+            }
+        }
+
+        switch (ev.op) {
+        case RECORD_ASSERT:
+            appropriateWorkQueuePush((WorkQueueItem) {
+               .op = ASSERT,
+               .assert = {
+                   .clause = ev.clause,
+                   .sourceFileName = strdup(ev.sourceFileName),
+                   .sourceLineNumber = ev.sourceLineNumber,
+                   .sourceLocationId = blockStatsInternCached(ev.sourceFileName,
+                                                              ev.sourceLineNumber),
+               }
+            });
+            break;
+        case RECORD_RETRACT:
+            appropriateWorkQueuePush((WorkQueueItem) {
+               .op = RETRACT,
+               .retract = { .pattern = ev.clause }
+            });
+            break;
+        case RECORD_HOLD:
+            HoldStatementGlobally(ev.key, ev.version,
+                                  ev.clause, ev.keepMs, ev.destructorCode,
+                                  ev.sourceFileName, ev.sourceLineNumber);
+            break;
+        case RECORD_NOTIFY:
+            NotifyGlobally(ev.clause);
+            clauseFree(ev.clause);
+            break;
+        }
+        free(ev.destructorCode);
+        eventsCount++;
+    }
+
+    // Let programs (and tests) know the replay is done.
+    Clause* finished = clauseNew(9);
+    const char* words[] = { "the", "replay", "of", opts->path, "has", "finished", "after" };
+    for (int i = 0; i < 7; i++) { finished->terms[i] = termNew(words[i], -1); }
+    char countStr[32]; snprintf(countStr, sizeof(countStr), "%" PRId64, eventsCount);
+    finished->terms[7] = termNew(countStr, -1);
+    finished->terms[8] = termNew("events", -1);
+    char key[1024]; snprintf(key, sizeof(key), "replay %s", opts->path);
+    HoldStatementGlobally(key, timestamp_get(CLOCK_MONOTONIC),
+                          finished, 0, NULL, "record-replay.c", __LINE__);
+
+    replayReaderClose(&opts->reader);
+    free(opts->path);
+    free(opts->sources);
+    free(opts);
+    epochThreadDestroy();
+    return NULL;
+}
+
+// Takes ownership of sources. Returns an error message, or NULL on
+// success.
+static const char* replayStart(const char* path, double speed, char* sources) {
+    ReplayOptions* opts = calloc(1, sizeof(ReplayOptions));
+    const char* err = replayReaderOpen(&opts->reader, path);
+    if (err != NULL) {
+        free(sources); free(opts);
+        return err;
+    }
+    opts->path = strdup(path);
+    opts->speed = speed;
+    opts->sources = sources;
+
+    pthread_t th;
+    pthread_create(&th, NULL, replayMain, opts);
+    pthread_detach(th);
+    return NULL;
+}
+
+void replayInit() {
+    const char* path = getenv("FOLK_REPLAY");
+    if (path == NULL || path[0] == '\0') { return; }
+
+    const char* speedStr = getenv("FOLK_REPLAY_SPEED");
+    double speed = speedStr ? atof(speedStr) : 1.0;
+    const char* sources = getenv("FOLK_REPLAY_SOURCES");
+
+    const char* err = replayStart(path, speed,
+                                  sources && sources[0] ? strdup(sources) : NULL);
+    if (err != NULL) {
+        fprintf(stderr, "replay: %s: %s\n", path, err);
+        exit(1);
+    }
+}
+
+////////////////////////////////////////////////////////////
+// Jim commands
+////////////////////////////////////////////////////////////
+
+// __recordStart path
+int __recordStartFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    if (argc != 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "path");
+        return JIM_ERR;
+    }
+    recordStop();
+    const char* err = recordStart(Jim_String(argv[1]));
+    if (err != NULL) {
+        Jim_SetResultFormatted(interp, "__recordStart: %#s: %s", argv[1], err);
+        return JIM_ERR;
+    }
+    return JIM_OK;
+}
+
+// __recordStop
+int __recordStopFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    recordStop();
+    return JIM_OK;
+}
+
+// __replayStart path ?speed? ?sources?
+int __replayStartFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    if (argc < 2 || argc > 4) {
+        Jim_WrongNumArgs(interp, 1, argv, "path ?speed? ?sources?");
+        return JIM_ERR;
+    }
+    double speed = 1.0;
+    if (argc >= 3 && Jim_GetDouble(interp, argv[2], &speed) != JIM_OK) {
+        return JIM_ERR;
+    }
+    char* sources = NULL;
+    if (argc >= 4 && Jim_Length(argv[3]) > 0) {
+        sources = strdup(Jim_String(argv[3]));
+    }
+    const char* err = replayStart(Jim_String(argv[1]), speed, sources);
+    if (err != NULL) {
+        Jim_SetResultFormatted(interp, "__replayStart: %#s: %s", argv[1], err);
+        return JIM_ERR;
+    }
+    return JIM_OK;
+}
+
+// __replayDump path: returns the events in a recording, as a list of
+// dicts.
+int __replayDumpFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv) {
+    if (argc != 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "path");
+        return JIM_ERR;
+    }
+    ReplayReader r;
+    const char* err = replayReaderOpen(&r, Jim_String(argv[1]));
+    if (err != NULL) {
+        Jim_SetResultFormatted(interp, "__replayDump: %#s: %s", argv[1], err);
+        return JIM_ERR;
+    }
+
+    Jim_Obj* ret = Jim_NewListObj(interp, NULL, 0);
+    ReplayEvent ev;
+    while (replayReadEvent(&r, &ev)) {
+        Jim_Obj* clauseObj = Jim_NewListObj(interp, NULL, 0);
+        for (int i = 0; i < ev.clause->nTerms; i++) {
+            Jim_ListAppendElement(interp, clauseObj,
+                                  Jim_NewStringObj(interp, termPtr(ev.clause->terms[i]),
+                                                   termLen(ev.clause->terms[i])));
+        }
+        Jim_Obj* evObj = Jim_NewDictObj(interp, NULL, 0);
+#define DUMP_FIELD(name, obj) \
+        Jim_DictAddElement(interp, evObj, Jim_NewStringObj(interp, name, -1), obj)
+        DUMP_FIELD("op", Jim_NewStringObj(interp, recordOpNames[ev.op], -1));
+        DUMP_FIELD("tNs", Jim_NewIntObj(interp, ev.tNs));
+        DUMP_FIELD("source", Jim_NewStringObj(interp, ev.sourceFileName, -1));
+        DUMP_FIELD("line", Jim_NewIntObj(interp, ev.sourceLineNumber));
+        DUMP_FIELD("clause", clauseObj);
+        if (ev.op == RECORD_HOLD) {
+            DUMP_FIELD("key", Jim_NewStringObj(interp, ev.key, -1));
+            DUMP_FIELD("version", Jim_NewDoubleObj(interp, ev.version));
+            DUMP_FIELD("keepMs", Jim_NewIntObj(interp, ev.keepMs));
+            DUMP_FIELD("destructorCode",
+                       Jim_NewStringObj(interp, ev.destructorCode ? ev.destructorCode : "", -1));
+        }
+#undef DUMP_FIELD
+        Jim_ListAppendElement(interp, ret, evObj);
+
+        clauseFree(ev.clause);
+        free(ev.destructorCode);
+    }
+    replayReaderClose(&r);
+
+    Jim_SetResult(interp, ret);
+    return JIM_OK;
+}
@@ -0,0 +1,39 @@
+#ifndef RECORD_REPLAY_H
+#define RECORD_REPLAY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <jim.h>
+
+#include "trie.h"
+
+// Input recording and replay. Set FOLK_RECORD to the path of a file
+// to record every external statement mutation (Assert!, Retract!,
+// HoldStatementGlobally! and Notify!) into; set FOLK_REPLAY to a
+// recording to feed it back into the system at startup.
+
+// True while recording is on.
+extern bool _Atomic recording;
+
+void recordInit(void);
+// Must be called once the worker pool is up.
+void replayInit(void);
+
+// The caller still owns all the arguments. These are no-ops if we're
+// not recording.
+void recordAssert(Clause* clause, const char* sourceFileName, int sourceLineNumber);
+void recordRetract(Clause* pattern, const char* sourceFileName, int sourceLineNumber);
+void recordHold(const char* key, double version,
+                Clause* clause, long keepMs, const char* destructorCode,
+                const char* sourceFileName, int sourceLineNumber);
+void recordNotify(Clause* clause, const char* sourceFileName, int sourceLineNumber);
+
+// Called from sysmon; flushes buffered events to the recording.
+void recordTick(void);
+
+int __recordStartFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv);
+int __recordStopFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv);
+int __replayStartFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv);
+int __replayDumpFunc(Jim_Interp *interp, int argc, Jim_Obj *const *argv);
+
+#endif
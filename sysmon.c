@@ -10,6 +10,8 @@
 #include <string.h>
 #include <stdatomic.h>
 #include <assert.h>
+#include <stdarg.h>
+#include <stdlib.h>
 
 #ifdef __linux__
 #include <sys/sysinfo.h>
@@ -23,6 +25,10 @@
 
 #include "common.h"
 #include "epoch.h"
+#include "boot-trace.h"
+#include "event-trace.h"
+#include "record-replay.h"
+#include "vendor/stb_ds.h"
 
 extern void installLocalStdoutAndStderr(int stdoutfd, int stderrfd);
 
@@ -33,8 +39,16 @@ extern void trace(const char* format, ...);
 extern void HoldStatementGlobally(const char *key, double version,
                                   Clause *clause, long keepMs, const char *destructorCode,
                                   const char *sourceFileName, int sourceLineNumber);
-extern void workerReactivateOrSpawn(int64_t msSinceBoot, int targetNotBlockedWorkersCount);
+extern void workerSpawn();
+extern _Atomic int globalWorkQueueSize;
+extern ssize_t unsafe_workQueueSize(WorkQueue* q);
 extern void dbGarbageCollectAtomicallys(Db* db, int64_t now);
+extern int64_t _Atomic notifyEventsCount;
+extern int64_t _Atomic notifyDeliveriesCount;
+extern int64_t _Atomic notifySubscribeItemsCount;
+extern bool _Atomic workerAffinityEnabled;
+extern int64_t _Atomic workerAffinityHitsCount;
+extern int64_t _Atomic workerAffinityMissesCount;
 
 // How many ms are in each tick? You probably want this to be less
 // than half of 16ms (1 frame).
@@ -54,13 +68,21 @@ int64_t _Atomic tick;
 
 int64_t timestampAtBoot;
 int targetNotBlockedWorkersCount;
+// How many CPUs the workers are allowed to run on.
+int cpuBudget;
 
-void sysmonInit(int targetCount) {
+void sysmonInit(int targetCount, int budget) {
     timestampAtBoot = timestamp_get(CLOCK_MONOTONIC);
     targetNotBlockedWorkersCount = targetCount;
+    cpuBudget = budget;
 }
 
 static void checkRam();
+static void checkTrie();
+static void checkAtomicallys();
+static void checkNotify();
+static void checkWorkerAffinity();
+static void manageWorkerPool();
 void sysmon() {
     /* trace("%" PRId64 "ns: Sysmon Tick", */
     /*       timestamp_get(CLOCK_MONOTONIC) - timestampAtBoot); */
@@ -105,56 +127,49 @@ void sysmon() {
     epochGlobalCollect();
 
     // Fourth: reap Atomically versions / attached statements that
-    // haven't had a new convergence in 'a long time'.
-    if (currentTick % 20 == 0) { // every 60ms or so.
+    // haven't had a new convergence in 'a long time'. This only
+    // visits keys whose deadline has passed, so it's cheap to do
+    // every tick.
+    {
         int64_t nowNs = timestamp_get(CLOCK_MONOTONIC);
         dbGarbageCollectAtomicallys(db, nowNs);
     }
 
+    // Fifth: if we're tracing boot, check if boot is done (and if
+    // so, write out the trace).
+    if (currentTick % 100 == 0) { bootTraceTick(); }
+
+    // Sixth: if someone sent us SIGUSR2, dump the event trace.
+    eventTraceTick();
+
+    // Seventh: if we're recording input, flush it to disk.
+    if (currentTick % 100 == 0) { recordTick(); }
+
     ///////////////////////////////////
     if (currentMs < 1000) { return; }
     // Don't do the management tasks after this if the system isn't
     // fully online yet.
     ///////////////////////////////////
 
-    // Fifth: manage the pool of worker threads.
-    // How many workers are _not_ blocked on I/O?
+    // Eighth: manage the pool of worker threads.
 #ifdef __linux__
-    int notBlockedWorkersCount = 0;
-    for (int i = 0; i < THREADS_MAX; i++) {
-        // We can be a little sketchy with the counting.
-        pid_t tid = threads[i].tid;
-        if (tid == 0 || threads[i].isDeactivated) { continue; }
-
-        char path[100]; snprintf(path, 100, "/proc/%d/stat", tid);
-        FILE *fp = fopen(path, "r");
-        if (fp == NULL) { continue; }
-        int _pid; char _name[100]; char state;
-        // TODO: doesn't deal with name with space in it.
-        if (fscanf(fp, "%d %s %c ", &_pid, _name, &state) != 3) {
-            fprintf(stderr, "sysmon: /proc/%d/stat scan failed\n", tid);
-        }
-        fclose(fp);
+    manageWorkerPool();
+#endif
 
-        // If it's running, then we'll count it as non-blocked.
-        if (state == 'R') {
-            notBlockedWorkersCount++;
-            threads[i].wasObservedAsBlocked = false;
-        } else {
-            // Mark that the thread was blocked on I/O so that the
-            // thread can deactivate when done with its current work
-            // item (so we don't get overcrowding of threads for the #
-            // of CPUs).
-            threads[i].wasObservedAsBlocked = true;
-        }
+    // Ninth: publish stats about the statement trie.
+    if (currentTick % 333 == 0) { // every 1s or so.
+        checkTrie();
     }
 
-    if (notBlockedWorkersCount < targetNotBlockedWorkersCount) {
-        workerReactivateOrSpawn(currentMs, targetNotBlockedWorkersCount);
+    // Tenth: publish convergence stats for each Atomically key,
+    // Notify rates, and how often work runs on its home worker.
+    if (currentTick % 333 == 0) { // every 1s or so.
+        checkAtomicallys();
+        checkNotify();
+        checkWorkerAffinity();
     }
-#endif
 
-    // Sixth: update the time statements in the database.
+    // Eleventh: update the time statements in the database.
     int64_t timeNs = timestamp_get(CLOCK_REALTIME);
 
     Clause* internalTimeClause = clauseFormat(
@@ -253,6 +268,385 @@ static void checkRam() {
     }
 }
 
+// Like clauseFormat, but replaces the last term (which should be a
+// placeholder in `fmt`) with `lastTerm`, which can contain spaces.
+static Clause* clauseFormatWithLastTerm(const char* lastTerm, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    char* formatted;
+    vasprintf(&formatted, fmt, args);
+    va_end(args);
+
+    Clause* c = clauseFormat("%s", formatted);
+    free(formatted);
+    free(c->terms[c->nTerms - 1]);
+    c->terms[c->nTerms - 1] = termNew(lastTerm, -1);
+    return c;
+}
+
+static void checkTrie() {
+    // Walk the current trie while in an epoch, so none of it can be
+    // freed out from under us.
+    TrieStats stats;
+    dbLockClauseToStatementRef(db);
+    trieStats(dbGetClauseToStatementRef(db), &stats);
+    dbUnlockClauseToStatementRef(db);
+
+    HoldStatementGlobally("trieSize", tick,
+                          clauseFormat("sysmon.c claims %s has trie of %" PRId64 " nodes and %" PRId64 " statements",
+                                       thisNode, stats.nodes, stats.values),
+                          0, NULL, "sysmon.c", __LINE__);
+    HoldStatementGlobally("trieBytes", tick,
+                          clauseFormat("sysmon.c claims %s has trie using %" PRId64 " bytes for nodes and %" PRId64 " bytes for terms",
+                                       thisNode, stats.nodeBytes, stats.termBytes),
+                          0, NULL, "sysmon.c", __LINE__);
+    HoldStatementGlobally("trieFanout", tick,
+                          clauseFormat("sysmon.c claims %s has trie fanout p50 %d p99 %d max %d",
+                                       thisNode, stats.p50Fanout, stats.p99Fanout, stats.maxFanout),
+                          0, NULL, "sysmon.c", __LINE__);
+
+    // The depth histogram is a single term: a list of depth, count
+    // pairs (only for depths that have statements).
+    char histogram[TRIE_STATS_DEPTH_MAX * 24] = "";
+    int n = 0;
+    for (int depth = 0; depth < TRIE_STATS_DEPTH_MAX; depth++) {
+        if (stats.valuesByDepth[depth] == 0) { continue; }
+        n += snprintf(histogram + n, sizeof(histogram) - n, "%s%d %" PRId64,
+                      n == 0 ? "" : " ", depth, stats.valuesByDepth[depth]);
+    }
+    HoldStatementGlobally("trieDepth", tick,
+                          clauseFormatWithLastTerm(histogram,
+                                                   "sysmon.c claims %s has trie depth max %d histogram -",
+                                                   thisNode, stats.maxDepth),
+                          0, NULL, "sysmon.c", __LINE__);
+
+    for (int i = 0; i < TRIE_STATS_FIRST_TERMS_MAX; i++) {
+        char key[100]; snprintf(key, sizeof(key), "trieFirstTerm%d", i);
+        // An empty clause unholds the key, if there are fewer first
+        // terms now than there were.
+        Clause* clause = i < stats.firstTermsCount ?
+            clauseFormatWithLastTerm(stats.firstTerms[i].term,
+                                     "sysmon.c claims %s has trie rank %d with %" PRId64 " statements under first term -",
+                                     thisNode, i, stats.firstTerms[i].values) :
+            clauseNew(0);
+        HoldStatementGlobally(key, tick, clause, 0, NULL, "sysmon.c", __LINE__);
+    }
+
+    HoldStatementGlobally("epochGarbage", tick,
+                          clauseFormat("sysmon.c claims %s has %d pointers awaiting epoch reclamation",
+                                       thisNode, epochGarbageCount()),
+                          0, NULL, "sysmon.c", __LINE__);
+
+    HoldStats holdStats; dbHoldStats(db, &holdStats);
+    HoldStatementGlobally("holdStats", tick,
+                          clauseFormat("sysmon.c claims %s has %" PRId64 " holds in %d shards with %" PRId64 " of %" PRId64 " hold locks contended",
+                                       thisNode, holdStats.holdsCount, holdStats.shardsCount,
+                                       holdStats.contendedCount, holdStats.lockCount),
+                          0, NULL, "sysmon.c", __LINE__);
+    HoldStatementGlobally("reinsertsSuppressed", tick,
+                          clauseFormat("sysmon.c claims %s has suppressed %" PRId64 " reinserts of identical statements",
+                                       thisNode, dbReinsertsSuppressedCount(db)),
+                          0, NULL, "sysmon.c", __LINE__);
+}
+
+// Like clauseFormatWithLastTerm, but for the term at `index`.
+static Clause* clauseFormatWithTermAt(int index, const char* term, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    char* formatted;
+    vasprintf(&formatted, fmt, args);
+    va_end(args);
+
+    Clause* c = clauseFormat("%s", formatted);
+    free(formatted);
+    free(c->terms[index]);
+    c->terms[index] = termNew(term, -1);
+    return c;
+}
+
+static void unholdAtomicallyStats(int id) {
+    const char* prefixes[] = { "atomicallyVersions", "atomicallyConvergence", "atomicallyChurn" };
+    for (int i = 0; i < sizeof(prefixes)/sizeof(prefixes[0]); i++) {
+        char holdKey[100];
+        snprintf(holdKey, sizeof(holdKey), "%s%d", prefixes[i], id);
+        HoldStatementGlobally(holdKey, tick, clauseNew(0), 0, NULL, "sysmon.c", __LINE__);
+    }
+}
+typedef struct { int key; int64_t value; } VersionsCreatedEntry;
+static void checkAtomicallys() {
+    // Atomically id -> versionsCreated at the last check, to turn
+    // the lifetime count into a rate (stb_ds hash map).
+    static VersionsCreatedEntry* prevVersionsCreated;
+    static int64_t prevNs;
+
+    int64_t nowNs = timestamp_get(CLOCK_MONOTONIC);
+    double seconds = prevNs == 0 ? 0 : (nowNs - prevNs) / 1e9;
+    prevNs = nowNs;
+
+    int n;
+    AtomicallyStats* stats = dbAtomicallyStats(db, &n);
+    VersionsCreatedEntry* versionsCreated = NULL;
+    for (int i = 0; i < n; i++) {
+        AtomicallyStats* st = &stats[i];
+        int id = st->id;
+        int64_t prev = hmget(prevVersionsCreated, id);
+        double versionsPerSecond = seconds > 0 ?
+            (st->versionsCreated - prev) / seconds : 0;
+        hmput(versionsCreated, id, st->versionsCreated);
+
+        // The key is term 5 in each of these.
+        char holdKey[100];
+        snprintf(holdKey, sizeof(holdKey), "atomicallyVersions%d", id);
+        HoldStatementGlobally(holdKey, tick,
+                              clauseFormatWithTermAt(5, st->key,
+                                                     "sysmon.c claims %s has atomically - with %" PRId64 " versions created at %.1f per second",
+                                                     thisNode, st->versionsCreated, versionsPerSecond),
+                              0, NULL, "sysmon.c", __LINE__);
+        snprintf(holdKey, sizeof(holdKey), "atomicallyConvergence%d", id);
+        HoldStatementGlobally(holdKey, tick,
+                              clauseFormatWithTermAt(5, st->key,
+                                                     "sysmon.c claims %s has atomically - with %" PRId64 " versions converged in p50 %.3f ms p99 %.3f ms max %.3f ms",
+                                                     thisNode, st->versionsConverged,
+                                                     st->convergenceP50Ns / 1e6, st->convergenceP99Ns / 1e6,
+                                                     st->convergenceMaxNs / 1e6),
+                              0, NULL, "sysmon.c", __LINE__);
+        snprintf(holdKey, sizeof(holdKey), "atomicallyChurn%d", id);
+        HoldStatementGlobally(holdKey, tick,
+                              clauseFormatWithTermAt(5, st->key,
+                                                     "sysmon.c claims %s has atomically - with %" PRId64 " versions reaped unconverged and max inflight %d and %" PRId64 " timeouts of %.0f ms",
+                                                     thisNode, st->versionsReapedUnconverged,
+                                                     st->maxInflightCount, st->timeoutsHit,
+                                                     st->timeoutNs / 1e6),
+                              0, NULL, "sysmon.c", __LINE__);
+        free(st->key);
+    }
+    free(stats);
+
+    // Keys that were freed since the last check take their stats
+    // with them.
+    for (int i = 0; i < hmlen(prevVersionsCreated); i++) {
+        if (hmgeti(versionsCreated, prevVersionsCreated[i].key) < 0) {
+            unholdAtomicallyStats(prevVersionsCreated[i].key);
+        }
+    }
+    hmfree(prevVersionsCreated);
+    prevVersionsCreated = versionsCreated;
+}
+
+static void checkNotify() {
+    static int64_t prevEventsCount;
+    static int64_t prevNs;
+
+    int64_t nowNs = timestamp_get(CLOCK_MONOTONIC);
+    double seconds = prevNs == 0 ? 0 : (nowNs - prevNs) / 1e9;
+    prevNs = nowNs;
+
+    int64_t eventsCount = atomic_load(&notifyEventsCount);
+    int64_t deliveriesCount = atomic_load(&notifyDeliveriesCount);
+    int64_t subscribeItemsCount = atomic_load(&notifySubscribeItemsCount);
+    double eventsPerSecond = seconds > 0 ? (eventsCount - prevEventsCount) / seconds : 0;
+    prevEventsCount = eventsCount;
+
+    // Fan-out is how many subscribers each event reached, on
+    // average; batching shows up as fewer subscribe work items than
+    // deliveries.
+    HoldStatementGlobally("notifyStats", tick,
+                          clauseFormat("sysmon.c claims %s has notified %" PRId64 " events at %.1f per second with fan-out %.2f in %" PRId64 " subscribe work items for %" PRId64 " deliveries",
+                                       thisNode, eventsCount, eventsPerSecond,
+                                       eventsCount > 0 ? (double) deliveriesCount / eventsCount : 0.0,
+                                       subscribeItemsCount, deliveriesCount),
+                          0, NULL, "sysmon.c", __LINE__);
+}
+
+static void checkWorkerAffinity() {
+    int64_t hitsCount = atomic_load(&workerAffinityHitsCount);
+    int64_t missesCount = atomic_load(&workerAffinityMissesCount);
+    if (!workerAffinityEnabled && hitsCount + missesCount == 0) { return; }
+
+    // Hit rate is the fraction of homed work items (When and
+    // Subscribe runs) that ran on their home worker rather than
+    // being stolen or sent elsewhere.
+    HoldStatementGlobally("workerAffinityStats", tick,
+                          clauseFormat("sysmon.c claims %s has worker affinity %s with hit rate %.2f from %" PRId64 " hits and %" PRId64 " misses",
+                                       thisNode, workerAffinityEnabled ? "on" : "off",
+                                       hitsCount + missesCount > 0 ?
+                                       (double) hitsCount / (hitsCount + missesCount) : 0.0,
+                                       hitsCount, missesCount),
+                          0, NULL, "sysmon.c", __LINE__);
+}
+
+#ifdef __linux__
+// Workers idle for this long can be retired if there are more of
+// them than CPUs in the budget (or if they're deactivated anyway).
+#define WORKER_RETIRE_IDLE_MS 5000
+// We don't add workers if Folk is already using this much of its
+// CPU budget; more threads would just preempt each other.
+#define WORKER_GROW_MAX_UTILIZATION 0.95
+// Arbitrarily picked: we don't want to have more than 15
+// background threads hanging around.
+#define WORKER_SURPLUS_MAX 15
+
+static void workerPoolDecide(const char* action, int threadIndex, const char* reason) {
+    static int decisionsCount;
+    int decision = decisionsCount++;
+    fprintf(stderr, "sysmon: worker pool decision %d: %s worker %d (%s)\n",
+            decision, action, threadIndex, reason);
+
+    // Keep the last few decisions around as statements.
+    char key[100]; snprintf(key, sizeof(key), "workerPoolDecision-%d", decision % 8);
+    HoldStatementGlobally(key, tick,
+                          clauseFormatWithLastTerm(reason,
+                                                   "sysmon.c claims %s worker pool decision %d was to %s worker %d because _",
+                                                   thisNode, decision, action, threadIndex),
+                          0, NULL, "sysmon.c", __LINE__);
+}
+
+// Sizes the pool of worker threads to demand: reactivates or spawns
+// a worker when there's queued work but too few workers that aren't
+// blocked to run it, and retires workers that have been idle a
+// while when there are more than the CPU budget calls for. Makes at
+// most one decision per tick.
+static void manageWorkerPool() {
+    // How many CPUs' worth of time the workers are using, measured
+    // over the last 100ms or so. Only worker threads count against
+    // the budget (not sysmon, the log writer, compilers, or threads
+    // that C modules start). workersCpuNs accumulates each worker's
+    // CPU time since the previous tick, so workers coming and going
+    // don't throw it off.
+    static double cpusUsed;
+    static int64_t workersCpuNs, prevCpuNs, prevWallNs;
+    static pid_t prevTids[THREADS_MAX];
+    static int64_t prevThreadCpuNs[THREADS_MAX];
+    static long clockTicksPerSec;
+    if (clockTicksPerSec == 0) { clockTicksPerSec = sysconf(_SC_CLK_TCK); }
+    int64_t nowNs = timestamp_get(CLOCK_MONOTONIC);
+
+    int livingWorkersCount = 0;
+    int notBlockedWorkersCount = 0;
+    int blockedWorkersCount = 0;
+    int deactivatedWorkersCount = 0;
+    int64_t queuedItemsCount = globalWorkQueueSize;
+    int deactivatedWorker = -1;
+    // The worker that's been idle the longest (never the main
+    // thread, worker 0).
+    int idlestWorker = -1;
+    int64_t idlestWorkerIdleNs = 0;
+    for (int i = 0; i < THREADS_MAX; i++) {
+        // We can be a little sketchy with the counting.
+        pid_t tid = threads[i].tid;
+        if (tid == 0) { continue; }
+        livingWorkersCount++;
+        if (threads[i].workQueue != NULL) {
+            ssize_t size = unsafe_workQueueSize(threads[i].workQueue);
+            if (size > 0) { queuedItemsCount += size; }
+        }
+        queuedItemsCount += threads[i].affinityInboxSize;
+
+        if (i != 0 && !threads[i].shouldRetire &&
+            threads[i].currentItemStartTimestamp == 0) {
+            int64_t idleNs = nowNs - threads[i].lastItemEndNs;
+            if (idleNs > idlestWorkerIdleNs) {
+                idlestWorker = i;
+                idlestWorkerIdleNs = idleNs;
+            }
+        }
+
+        char path[100]; snprintf(path, 100, "/proc/self/task/%d/stat", tid);
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL) { continue; }
+        int _pid; char _name[100]; char state;
+        unsigned long utime, stime;
+        // TODO: doesn't deal with name with space in it.
+        if (fscanf(fp, "%d %s %c %*d %*d %*d %*d %*d %*u %*lu %*lu %*lu %*lu %lu %lu",
+                   &_pid, _name, &state, &utime, &stime) != 5) {
+            fprintf(stderr, "sysmon: /proc/self/task/%d/stat scan failed\n", tid);
+            fclose(fp);
+            continue;
+        }
+        fclose(fp);
+
+        int64_t threadCpuNs = (int64_t)(utime + stime) * 1000000000 / clockTicksPerSec;
+        workersCpuNs += threadCpuNs - (prevTids[i] == tid ? prevThreadCpuNs[i] : 0);
+        prevTids[i] = tid;
+        prevThreadCpuNs[i] = threadCpuNs;
+
+        if (threads[i].isDeactivated) {
+            deactivatedWorkersCount++;
+            // Don't reactivate a worker that's on its way out.
+            if (!threads[i].shouldRetire) { deactivatedWorker = i; }
+            continue;
+        }
+
+        // If it's running, then we'll count it as non-blocked. So
+        // is a worker waiting on the compiler pool, since the
+        // compiler is running for it.
+        if (state == 'R' || threads[i].isWaitingOnCompile) {
+            notBlockedWorkersCount++;
+            threads[i].wasObservedAsBlocked = false;
+        } else {
+            // Mark that the thread was blocked on I/O so that the
+            // thread can deactivate when done with its current work
+            // item (so we don't get overcrowding of threads for the #
+            // of CPUs).
+            blockedWorkersCount++;
+            threads[i].wasObservedAsBlocked = true;
+        }
+    }
+
+    if (nowNs - prevWallNs > 100000000) {
+        if (prevWallNs != 0) {
+            cpusUsed = (double)(workersCpuNs - prevCpuNs) / (nowNs - prevWallNs);
+        }
+        prevCpuNs = workersCpuNs;
+        prevWallNs = nowNs;
+    }
+
+    if (tick % 333 == 0) { // every 1s or so.
+        HoldStatementGlobally("workerPool", tick,
+                              clauseFormat("sysmon.c claims %s has worker pool of %d workers with %d blocked and %d deactivated for CPU budget %d using %.2f CPUs with %" PRId64 " queued items",
+                                           thisNode, livingWorkersCount,
+                                           blockedWorkersCount, deactivatedWorkersCount,
+                                           cpuBudget, cpusUsed, queuedItemsCount),
+                              0, NULL, "sysmon.c", __LINE__);
+    }
+
+    if (notBlockedWorkersCount < targetNotBlockedWorkersCount && queuedItemsCount > 0) {
+        if (cpusUsed >= WORKER_GROW_MAX_UTILIZATION * cpuBudget) { return; }
+
+        if (deactivatedWorker != -1) {
+            sem_post(&threads[deactivatedWorker].reactivate);
+            workerPoolDecide("reactivate", deactivatedWorker,
+                             "work is queued and too many workers are blocked");
+
+        } else if (livingWorkersCount <= targetNotBlockedWorkersCount + WORKER_SURPLUS_MAX) {
+            workerSpawn();
+            workerPoolDecide("spawn", -1,
+                             "work is queued and too many workers are blocked");
+        }
+
+    } else if (queuedItemsCount == 0 && idlestWorker != -1 &&
+               idlestWorkerIdleNs > WORKER_RETIRE_IDLE_MS * 1000000LL) {
+        if (threads[idlestWorker].isDeactivated) {
+            threads[idlestWorker].shouldRetire = true;
+            sem_post(&threads[idlestWorker].reactivate);
+            workerPoolDecide("retire", idlestWorker,
+                             "it is deactivated and has been idle");
+
+        } else if (livingWorkersCount - deactivatedWorkersCount > cpuBudget) {
+            threads[idlestWorker].shouldRetire = true;
+            // If it deactivated since we looked, nobody else will wake
+            // it. (It checks shouldRetire after deactivating, so one
+            // of us sees the other.)
+            if (threads[idlestWorker].isDeactivated) {
+                sem_post(&threads[idlestWorker].reactivate);
+            }
+            workerPoolDecide("retire", idlestWorker,
+                             "there are more active workers than CPUs in the budget and it has been idle");
+        }
+    }
+}
+#endif
+
 void *sysmonMain(void *ptr) {
 #ifdef TRACY_ENABLE
     TracyCSetThreadName("sysmon");
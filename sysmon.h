@@ -1,7 +1,7 @@
 #ifndef SYSMON_H
 #define SYSMON_H
 
-void sysmonInit(int targetNotBlockedWorkersCount);
+void sysmonInit(int targetNotBlockedWorkersCount, int cpuBudget);
 void *sysmonMain(void *ptr);
 
 void sysmonScheduleRemoveAfter(StatementRef stmtRef, int afterMs);
@@ -125,6 +125,17 @@ bool clauseIsEqual(Clause* a, Clause* b) {
     return true;
 }
 
+uint64_t clauseHash(Clause* c) {
+    uint64_t hash = FNV1A_INIT;
+    for (int32_t i = 0; i < c->nTerms; i++) {
+        int len = termLen(c->terms[i]);
+        // Mix in the length so term boundaries count.
+        hash = (hash ^ (uint64_t)len) * 1099511628211ULL;
+        hash = fnv1a(hash, termPtr(c->terms[i]), len);
+    }
+    return hash;
+}
+
 const Trie* trieNew() {
     size_t size = sizeof(Trie);
     Trie* ret = (Trie*) calloc(size, 1);
@@ -254,7 +265,8 @@ bool trieVariableNameIsNonCapturing(const char* varName) {
 
 static void trieLookupAll(const Trie* trie,
                           uint64_t* results, size_t maxResults,
-                          int* resultsIdx) {
+                          int* resultsIdx, int* nodesVisited) {
+    (*nodesVisited)++;
     if (trie->hasValue) {
         if (*resultsIdx < maxResults) {
             results[(*resultsIdx)++] = trie->value;
@@ -262,14 +274,15 @@ static void trieLookupAll(const Trie* trie,
     }
     for (int j = 0; j < trie->branchesCount; j++) {
         trieLookupAll(trie->branches[j],
-                      results, maxResults, resultsIdx);
+                      results, maxResults, resultsIdx, nodesVisited);
     }
 }
 
 static void trieLookupImpl(bool isLiteral,
                            const Trie* trie, Clause* pattern, int patternIdx,
                            uint64_t* results, size_t maxResults,
-                           int* resultsIdx) {
+                           int* resultsIdx, int* nodesVisited) {
+    (*nodesVisited)++;
     int wordc = pattern->nTerms - patternIdx;
     if (wordc == 0) {
         if (trie->hasValue) {
@@ -298,13 +311,13 @@ static void trieLookupImpl(bool isLiteral,
             trieLookupImpl(isLiteral, trie->branches[j],
                            pattern, patternIdx + 1,
                            results, maxResults,
-                           resultsIdx);
+                           resultsIdx, nodesVisited);
 
         } else if (termType == TERM_TYPE_REST_VARIABLE) {
 
             trieLookupAll(trie->branches[j],
                           results, maxResults,
-                          resultsIdx);
+                          resultsIdx, nodesVisited);
 
         } else {
             char keyVarName[100];
@@ -314,20 +327,20 @@ static void trieLookupImpl(bool isLiteral,
                 if (keyVarName[0] == '.' && keyVarName[1] == '.' && keyVarName[2] == '.') {
                     trieLookupAll(trie->branches[j],
                                   results, maxResults,
-                                  resultsIdx);
+                                  resultsIdx, nodesVisited);
 
                 } else { // Or is the trie node a normal variable?
                     trieLookupImpl(isLiteral, trie->branches[j],
                                    pattern, patternIdx + 1,
                                    results, maxResults,
-                                   resultsIdx);
+                                   resultsIdx, nodesVisited);
                 }
             } else {
                 if (termEq(trie->branches[j]->key, term)) {
                     trieLookupImpl(isLiteral, trie->branches[j],
                                    pattern, patternIdx + 1,
                                    results, maxResults,
-                                   resultsIdx);
+                                   resultsIdx, nodesVisited);
                 }
             }
         }
@@ -381,9 +394,10 @@ static const Trie* trieRemoveImpl(bool isLiteral,
                                        resultsIdx);
 
         } else if (termType == TERM_TYPE_REST_VARIABLE) {
+            int nodesVisited = 0;
             trieLookupAll(trie->branches[j],
                           results, maxResults,
-                          resultsIdx);
+                          resultsIdx, &nodesVisited);
             // FIXME: this leaks
             newBranch = NULL;
 
@@ -393,8 +407,10 @@ static const Trie* trieRemoveImpl(bool isLiteral,
             if (!isLiteral && trieScanVariable(trie->branches[j]->key, keyVarName, 100)) {
                 // Is the trie node a rest variable?
                 if (keyVarName[0] == '.' && keyVarName[1] == '.' && keyVarName[2] == '.') {
+                    int nodesVisited = 0;
                     trieLookupAll(trie->branches[j],
-                                  results, maxResults, resultsIdx);
+                                  results, maxResults, resultsIdx,
+                                  &nodesVisited);
                     // FIXME: this leaks
                     newBranch = NULL;
 
@@ -440,22 +456,30 @@ static const Trie* trieRemoveImpl(bool isLiteral,
     return newTrie;
 }
 
-int trieLookup(const Trie* trie, Clause* pattern,
-               uint64_t* results, size_t maxResults) {
+int trieLookupWithStats(const Trie* trie, Clause* pattern,
+                        uint64_t* results, size_t maxResults,
+                        int* nodesVisited) {
     int resultCount = 0;
     trieLookupImpl(false, trie, pattern, 0,
                    results, maxResults,
-                   &resultCount);
+                   &resultCount, nodesVisited);
     /* fprintf(stderr, "trieLookup: (%s) -> %d\n", clauseToString(pattern), resultCount); */
     return resultCount;
 }
+int trieLookup(const Trie* trie, Clause* pattern,
+               uint64_t* results, size_t maxResults) {
+    int nodesVisited = 0;
+    return trieLookupWithStats(trie, pattern, results, maxResults,
+                               &nodesVisited);
+}
 
 int trieLookupLiteral(const Trie* trie, Clause* pattern,
                       uint64_t* results, size_t maxResults) {
     int resultCount = 0;
+    int nodesVisited = 0;
     trieLookupImpl(true, trie, pattern, 0,
                    results, maxResults,
-                   &resultCount);
+                   &resultCount, &nodesVisited);
     return resultCount;
 }
 
@@ -471,3 +495,82 @@ const Trie* trieRemove(const Trie* trie,
                           results, maxResults,
                           resultCount);
 }
+
+// Fanouts at or above this are all counted together (for the
+// percentiles; maxFanout is still exact).
+#define TRIE_STATS_FANOUT_MAX 1024
+
+static void trieStatsImpl(const Trie* trie, int depth, TrieStats* stats,
+                          int64_t* fanoutCounts) {
+    stats->nodes++;
+    stats->nodeBytes += SIZEOF_TRIE(trie->branchesCount);
+    if (trie->key != NULL) { stats->termBytes += SIZEOF_TERM(trie->key->len); }
+    if (trie->hasValue) {
+        stats->values++;
+        stats->valuesByDepth[depth < TRIE_STATS_DEPTH_MAX ? depth : TRIE_STATS_DEPTH_MAX - 1]++;
+        if (depth > stats->maxDepth) { stats->maxDepth = depth; }
+    }
+    if (trie->branchesCount > 0) {
+        fanoutCounts[trie->branchesCount < TRIE_STATS_FANOUT_MAX ?
+                     trie->branchesCount : TRIE_STATS_FANOUT_MAX]++;
+        if (trie->branchesCount > stats->maxFanout) {
+            stats->maxFanout = trie->branchesCount;
+        }
+    }
+    for (int j = 0; j < trie->branchesCount; j++) {
+        trieStatsImpl(trie->branches[j], depth + 1, stats, fanoutCounts);
+    }
+}
+
+static int fanoutPercentile(const int64_t* fanoutCounts, int64_t total, double p) {
+    int64_t rank = (int64_t)(p * total);
+    if (rank >= total) { rank = total - 1; }
+    int64_t seen = 0;
+    for (int i = 0; i <= TRIE_STATS_FANOUT_MAX; i++) {
+        seen += fanoutCounts[i];
+        if (seen > rank) { return i; }
+    }
+    return TRIE_STATS_FANOUT_MAX;
+}
+
+void trieStats(const Trie* trie, TrieStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    int64_t fanoutCounts[TRIE_STATS_FANOUT_MAX + 1] = {0};
+
+    stats->nodes++;
+    stats->nodeBytes += SIZEOF_TRIE(trie->branchesCount);
+    if (trie->branchesCount > 0) {
+        fanoutCounts[trie->branchesCount < TRIE_STATS_FANOUT_MAX ?
+                     trie->branchesCount : TRIE_STATS_FANOUT_MAX]++;
+        stats->maxFanout = trie->branchesCount;
+    }
+    // Walk each first term separately so we can tally values per
+    // first term, and keep the biggest ones (insertion sort).
+    for (int j = 0; j < trie->branchesCount; j++) {
+        const Trie* branch = trie->branches[j];
+        int64_t valuesBefore = stats->values;
+        trieStatsImpl(branch, 1, stats, fanoutCounts);
+        int64_t values = stats->values - valuesBefore;
+
+        int i = stats->firstTermsCount;
+        if (i == TRIE_STATS_FIRST_TERMS_MAX) {
+            if (values <= stats->firstTerms[i - 1].values) { continue; }
+            i--;
+        } else {
+            stats->firstTermsCount++;
+        }
+        for (; i > 0 && stats->firstTerms[i - 1].values < values; i--) {
+            stats->firstTerms[i] = stats->firstTerms[i - 1];
+        }
+        snprintf(stats->firstTerms[i].term, sizeof(stats->firstTerms[i].term),
+                 "%.*s", branch->key->len, branch->key->buf);
+        stats->firstTerms[i].values = values;
+    }
+
+    int64_t internalNodes = 0;
+    for (int i = 0; i <= TRIE_STATS_FANOUT_MAX; i++) { internalNodes += fanoutCounts[i]; }
+    if (internalNodes > 0) {
+        stats->p50Fanout = fanoutPercentile(fanoutCounts, internalNodes, 0.5);
+        stats->p99Fanout = fanoutPercentile(fanoutCounts, internalNodes, 0.99);
+    }
+}
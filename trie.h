@@ -25,7 +25,21 @@ void clauseFreeBorrowed(Clause* c);
 // Caller must free the string.
 char* clauseToString(Clause* c);
 
+// 64-bit FNV-1a. Start from FNV1A_INIT; feed more bytes by passing
+// the previous result back in as `hash`.
+#define FNV1A_INIT 14695981039346656037ULL
+static inline uint64_t fnv1a(uint64_t hash, const void* data, size_t len) {
+    const unsigned char* p = data;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
 bool clauseIsEqual(Clause* a, Clause* b);
+// 64-bit FNV-1a hash of the clause's terms. Equal clauses have
+// equal hashes.
+uint64_t clauseHash(Clause* c);
 
 typedef struct Trie Trie;
 struct Trie {
@@ -76,6 +90,11 @@ const Trie* trieRemove(const Trie* trie,
 // Fills `results` with the values of all clauses matching `pattern`.
 int trieLookup(const Trie* trie, Clause* pattern,
                uint64_t* results, size_t maxResults);
+// Same, but also adds the number of trie nodes it walked to
+// *nodesVisited (for the query profiler).
+int trieLookupWithStats(const Trie* trie, Clause* pattern,
+                        uint64_t* results, size_t maxResults,
+                        int* nodesVisited);
 
 // Only looks for literal matches of `literal` in the trie (does not
 // treat /variable/ as a variable). Used to check for an
@@ -83,6 +102,38 @@ int trieLookup(const Trie* trie, Clause* pattern,
 int trieLookupLiteral(const Trie* trie, Clause* literal,
                       uint64_t* results, size_t maxResults);
 
+// Structural stats about a trie, for capacity planning. Walks every
+// node, so the caller must keep `trie` alive (e.g., stay in an
+// epoch) for the duration of trieStats.
+#define TRIE_STATS_DEPTH_MAX 64
+#define TRIE_STATS_FIRST_TERMS_MAX 16
+typedef struct TrieStats {
+    int64_t nodes;
+    int64_t values;
+    // Bytes held by the nodes themselves and by their key terms.
+    int64_t nodeBytes;
+    int64_t termBytes;
+
+    // How many values (statements) live at each depth (= clause
+    // length); anything deeper than TRIE_STATS_DEPTH_MAX - 1 is
+    // counted in the last slot.
+    int64_t valuesByDepth[TRIE_STATS_DEPTH_MAX];
+    int maxDepth;
+
+    // Branch counts over internal (non-leaf) nodes.
+    int p50Fanout;
+    int p99Fanout;
+    int maxFanout;
+
+    // The first terms with the most values under them, most first.
+    struct {
+        char term[64];
+        int64_t values;
+    } firstTerms[TRIE_STATS_FIRST_TERMS_MAX];
+    int firstTermsCount;
+} TrieStats;
+void trieStats(const Trie* trie, TrieStats* stats);
+
 bool trieScanVariable(Term* term, char* outVarName, int sizeOutVarName);
 bool trieVariableNameIsNonCapturing(const char* varName);
 
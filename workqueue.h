@@ -4,10 +4,30 @@
 #include "db.h"
 #include "trie.h"
 
-typedef enum WorkQueueOp { NONE, ASSERT, RETRACT, RUN_WHEN, RUN_SUBSCRIBE, EVAL } WorkQueueOp;
+typedef enum WorkQueueOp { NONE, ASSERT, RETRACT, RUN_WHEN, RUN_WHEN_BATCH, RUN_SUBSCRIBE, EVAL } WorkQueueOp;
+
+// A new When's fan-out over the statements that already match it:
+// one allocation shared (refcounted) by every work item split off
+// from it, with one copy of the pattern.
+typedef struct RunWhenBatch {
+    int _Atomic rc;
+    StatementRef when;
+    Clause* whenPattern;
+    int64_t pushedNs;
+    // The When's home worker, or -1; every item split off the batch
+    // keeps it.
+    int home;
+    int stmtsCount;
+    StatementRef stmts[];
+} RunWhenBatch;
 typedef struct WorkQueueItem {
     WorkQueueOp op;
 
+    // The worker this item would rather run on, if it has one (see
+    // worker affinity in folk.c).
+    bool hasHome;
+    int home;
+
     // Clause pointers are the responsibility of the user of the
     // workqueue to keep alive (and to free once a work item is
     // processed). The workqueue does not itself copy or own or free
@@ -19,6 +39,10 @@ typedef struct WorkQueueItem {
             // on dequeue.
             char* sourceFileName;
             int sourceLineNumber;
+            // blockStatsIntern id of the source location, interned
+            // (through a per-thread cache) when the item is made, so
+            // running the item doesn't have to.
+            int sourceLocationId;
         } assert;
         struct { Clause* pattern; } retract;
         struct {
@@ -28,13 +52,26 @@ typedef struct WorkQueueItem {
             StatementRef when;
             Clause* whenPattern;
             StatementRef stmt;
+            // When this item was pushed (CLOCK_MONOTONIC ns), for
+            // measuring queueing delay.
+            int64_t pushedNs;
         } runWhen;
+        struct {
+            // Runs the When for stmts[start] up to (not including)
+            // stmts[end]. Holds one reference on batch.
+            RunWhenBatch* batch;
+            int start;
+            int end;
+        } runWhenBatch;
         struct {
             // The subscribeRef may be invalidated while this Run is
             // still in the workqueue -- if so, then the Run is invalidated.
             StatementRef subscribeRef;
             Clause* subscribePattern;
-            Clause* notifyClause;
+            // The subscribe block runs once for each of these, in
+            // order (a batch from one Notify).
+            int notifyClausesCount;
+            Clause** notifyClauses;
         } runSubscribe;
         struct {
             char* code;